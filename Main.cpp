@@ -4,7 +4,7 @@
 #include <sstream>
 #include <string>
 
-#define PROBLEM 4		// EVOLUTIONARY:0, MATRIX_MULT:1, RAYTRACER:2, SORT:3, TSP:4
+#define PROBLEM 4		// EVOLUTIONARY:0, MATRIX_MULT:1, RAYTRACER:2, SORT:3, TSP:4, IN_PROCESS:5, STREAM:6, GMP:7, STEALING:8
 
 #if (PROBLEM == 0)
 	#include "MainIslandModel.hpp"
@@ -24,6 +24,14 @@
 	#include "MainSort.hpp"
 #elif (PROBLEM == 4)
 	#include "MainParallelTSP.hpp"
+#elif (PROBLEM == 5)
+	#include "MainInProcessGroup.hpp"
+#elif (PROBLEM == 6)
+	#include "MainLargeStream.hpp"
+#elif (PROBLEM == 7)
+	#include "MainGmpTransfer.hpp"
+#elif (PROBLEM == 8)
+	#include "MainWorkStealing.hpp"
 #endif
 
 
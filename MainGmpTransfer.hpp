@@ -0,0 +1,135 @@
+#include <iostream>
+#include <string>
+
+#include "igcl/igcl.hpp"
+
+#ifndef GMP
+#error "this benchmark needs GMP (define GMP and link with -lgmpxx -lgmp)"
+#endif
+
+using namespace std;
+
+// GMP integers from 1K to "MAXBITS" bits sent to every peer, which sends them back. they are sent in binary
+// (as mpz_class) and, for comparison, as the decimal strings they used to be sent as. each size is sent
+// "nTests" times in a row before the replies are read, so the times show the cost of each value rather
+// than the latency of the network
+
+#define TEST_READY
+
+int MAXBITS = 1 << 20;
+int nTests = 20;
+int nParticipants = 2;
+void setSize(int val)   { MAXBITS = val; }
+void setNTests(int val) { nTests = val; }
+void setNNodes(int val) { nParticipants = val; }
+
+
+double elapsedMs(const timeval & start, const timeval & end)		// (timeDiff rounds to whole milliseconds)
+{
+	return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_usec - start.tv_usec) / 1e3;
+}
+
+
+void runCoordinator(igcl::Coordinator * coord)
+{
+	GroupLayout layout = GroupLayout::getMasterWorkersLayout(nParticipants);
+	coord->setLayout(layout);
+	coord->start();
+	coord->waitForNodes(nParticipants);
+
+	gmp_randclass random(gmp_randinit_default);
+	random.seed(42);
+
+	for (int bits = 1024; bits <= MAXBITS; bits *= 4)
+	{
+		mpz_class value = random.get_z_bits(bits);
+		if (bits % 2048 == 0)
+			value = -value;
+
+		timeval iniTime, endTime;
+		bool correct = true;
+
+		gettimeofday(&iniTime, NULL);
+		for (int test=0; test<nTests; ++test) {
+			coord->sendToAll(value);
+		}
+		for (uint i=0; i<nTests*coord->nDownstreamPeers(); ++i) {
+			igcl::peer_id id;
+			mpz_class back;
+			coord->waitRecvFromAny(id, back);
+			correct = correct and (back == value);
+		}
+		gettimeofday(&endTime, NULL);
+		double binaryMs = elapsedMs(iniTime, endTime) / nTests;
+
+		gettimeofday(&iniTime, NULL);
+		for (int test=0; test<nTests; ++test) {
+			coord->sendToAll(value.get_str(10));
+		}
+		for (uint i=0; i<nTests*coord->nDownstreamPeers(); ++i) {
+			igcl::peer_id id;
+			string strBack;
+			coord->waitRecvFromAny(id, strBack);
+			correct = correct and (mpz_class(strBack, 10) == value);
+		}
+		gettimeofday(&endTime, NULL);
+		double decimalMs = elapsedMs(iniTime, endTime) / nTests;
+
+		// conversion alone (what both ends spend on each value, without the network)
+		gettimeofday(&iniTime, NULL);
+		for (int test=0; test<nTests; ++test) {
+			igcl::Encoded<mpz_class> encoded(value);
+			mpz_class decoded;
+			correct = correct and igcl::Encoded<mpz_class>::decode(encoded.data(), encoded.size(), decoded);
+		}
+		gettimeofday(&endTime, NULL);
+		double binaryConvMs = elapsedMs(iniTime, endTime) / nTests;
+
+		gettimeofday(&iniTime, NULL);
+		for (int test=0; test<nTests; ++test) {
+			mpz_class decoded(value.get_str(10), 10);
+		}
+		gettimeofday(&endTime, NULL);
+		double decimalConvMs = elapsedMs(iniTime, endTime) / nTests;
+
+		if (!correct) {
+			printf("WRONG VALUE RECEIVED!!!!!!!\n");
+		}
+		printf("%8d bits: binary %9.3f ms, decimal %9.3f ms per value (%.1fx). conversion: binary %9.3f ms, decimal %9.3f ms (%.1fx)\n",
+				bits, binaryMs, decimalMs, decimalMs / std::max(binaryMs, 0.001),
+				binaryConvMs, decimalConvMs, decimalConvMs / std::max(binaryConvMs, 0.001));
+	}
+
+	for (igcl::peer_id id : coord->downstreamPeers()) {
+		coord->sendTo(id, mpz_class(0));
+	}
+	coord->terminate();
+}
+
+
+void runPeer(igcl::Peer * peer)
+{
+	peer->start();
+
+	while (1)
+	{
+		mpz_class value;
+		if (peer->waitRecvFrom(0, value) != igcl::SUCCESS or value == 0)
+			break;
+		peer->sendTo(0, value);
+
+		for (int test=1; test<nTests; ++test) {
+			peer->waitRecvFrom(0, value);
+			peer->sendTo(0, value);
+		}
+
+		for (int test=0; test<nTests; ++test) {
+			string str;
+			peer->waitRecvFrom(0, str);
+			mpz_class parsed(str, 10);
+			peer->sendTo(0, parsed.get_str(10));
+		}
+	}
+
+	peer->hang();
+}
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <set>
+
+#include "igcl/igcl.hpp"
+
+using namespace std;
+
+// runs the whole group inside the coordinator's process (one thread per peer), so that every
+// link uses the in-process transport. remote peers may still join with the usual command line.
+// after each test, checks a broadcast, a barrier and receiving from any peer over those links
+
+#define TEST_READY
+
+typedef double DATATYPE;
+
+int ARRAYSIZE = 10000000;
+int nTests = 10;
+int nParticipants = 4;
+const int BEFORE_BARRIER = 0, AFTER_BARRIER = 1;
+void setSize(int val)   { ARRAYSIZE = val; }
+void setNTests(int val) { nTests = val; }
+void setNNodes(int val) { nParticipants = val; }
+
+
+void peerWork(igcl::Peer * node)
+{
+	for (int test=0; test<nTests; ++test)
+	{
+		DATATYPE * section;
+		uint startIndex, endIndex;
+		igcl::peer_id masterId;
+
+		if (node->recvSection(section, startIndex, endIndex, masterId) != igcl::SUCCESS)
+			return;
+
+		for (uint i=0; i<endIndex-startIndex; ++i) {
+			section[i] *= 2;
+		}
+
+		node->sendResult(section, endIndex-startIndex, 1, startIndex, masterId);
+		free(section);
+
+		int broadcast;
+		if (node->waitRecvFrom(0, broadcast) != igcl::SUCCESS)
+			return;
+		if (broadcast != test)
+			printf("WRONG BROADCAST (%d instead of %d)!!!!!!!\n", broadcast, test);
+
+		node->sendTo(0, BEFORE_BARRIER);
+		node->barrier();
+		node->sendTo(0, AFTER_BARRIER);
+	}
+}
+
+
+// every peer sends one message before the barrier and one after it, so the coordinator must receive
+// the first message of every peer before any of the second ones
+bool checkCollectives(igcl::Coordinator * coord, int test)
+{
+	bool ok = (coord->sendToAll(test) == igcl::SUCCESS);
+	int nPeers = nParticipants-1;
+	std::set<igcl::peer_id> seen[2];
+
+	for (int i=0; i<2*nPeers; ++i)
+	{
+		igcl::peer_id id;
+		int phase;
+		if (coord->waitRecvFromAny(id, phase) != igcl::SUCCESS)
+			return false;
+
+		int expected = (i < nPeers ? BEFORE_BARRIER : AFTER_BARRIER);
+		if (phase != expected or !seen[phase].insert(id).second) {
+			printf("WRONG MESSAGE FROM PEER %d (%s barrier)!!!!!!!\n", id, (phase == BEFORE_BARRIER ? "before" : "after"));
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+void runLocalPeer(int ownPort, int coordinatorPort)
+{
+	auto peer = new igcl::Peer(ownPort, "127.0.0.1", coordinatorPort);
+	peer->start();
+	peerWork(peer);
+	peer->hang();
+	delete peer;
+}
+
+
+void runCoordinator(igcl::Coordinator * coord)
+{
+	GroupLayout layout = GroupLayout::getMasterWorkersLayout(nParticipants);
+	coord->setLayout(layout);
+	coord->start();
+
+	vector<thread> localPeers;
+	for (int i=1; i<nParticipants; ++i) {
+		localPeers.push_back(thread(runLocalPeer, coord->getPort()+i, coord->getPort()));
+	}
+
+	coord->waitForNodes(nParticipants);
+
+	DATATYPE * array = (DATATYPE*) malloc(ARRAYSIZE*sizeof(DATATYPE));
+
+	for (int test=0; test<nTests; ++test)
+	{
+		for (int i=0; i<ARRAYSIZE; ++i) {
+			array[i] = i;
+		}
+
+		timeval iniTime, endTime;
+		gettimeofday(&iniTime, NULL);
+
+		uint startIndex, endIndex;
+		coord->distribute(array, ARRAYSIZE, 1, startIndex, endIndex);
+		for (uint i=startIndex; i<endIndex; ++i) {
+			array[i] *= 2;
+		}
+		coord->collect(array, ARRAYSIZE, 1);
+
+		gettimeofday(&endTime, NULL);
+		printf("Time = %ld ms (distribute + collect)\n", timeDiff(iniTime, endTime));
+
+		for (int i=0; i<ARRAYSIZE; ++i) {
+			if (array[i] != 2.0*i) {
+				printf("WRONG RESULT AT INDEX %d!!!!!!!\n", i);
+				break;
+			}
+		}
+
+		if (checkCollectives(coord, test)) {
+			printf("Broadcast, barrier and receive from any: OK\n");
+		}
+	}
+
+	free(array);
+	coord->terminate();
+
+	for (thread & t : localPeers) {
+		t.join();
+	}
+}
+
+
+void runPeer(igcl::Peer * peer)
+{
+	peer->start();
+	peerWork(peer);
+	peer->hang();
+}
@@ -3,8 +3,11 @@
 #include "tsp/Operators.hpp"
 #include "tsp/GeneticAlgorithm.hpp"
 #include "tsp/TSP.hpp"
+#include "tsp/Migration.hpp"
 
 #include <iomanip>
+#include <thread>
+#include <algorithm>
 
 using namespace std;
 
@@ -13,12 +16,13 @@ TSPInstance * loadProblemInstance()
 {
 	TSPInstance * instance = new TSPInstance();
 
+	std::string file = "tsp/tsp_datasets/berlin52.tsp";
 	bool valid = false;
-	valid = instance->initializeFromFile("tsp/tsp_datasets/berlin52.tsp");
+	valid = instance->initializeFromFile(file);
 	if (!valid)
 		return NULL;
 
-	instance->precalculateDistances();
+	instance->precalculateDistancesCached(file + ".dists");		// (shared by the nodes of this machine)
 
 	cout << "Dataset size: " << instance->points.size() << endl;
 
@@ -34,6 +38,8 @@ TSP * loadAlgorithm(TSPInstance * instance)
 	tsp->mutationChance = 0.3;
 	tsp->crossoverChance = 0.8;
 	tsp->unionStrategy = new HalfAndHalfUnion(tsp->sortingFunctor);
+	// (threads only pay off when a generation takes far longer than handing it to them, as with lu980)
+	tsp->nThreads = (instance->points.size() >= 200 ? std::max(std::thread::hardware_concurrency(), 1u) : 1);
 	return tsp;
 }
 
@@ -42,6 +48,7 @@ void work(igcl::Peer * peer)
 {
 	TSPInstance * instance = loadProblemInstance();
 	TSP * tsp = loadAlgorithm(instance);
+	tsp->island = peer->getId();		// (peers started in the same second get the same seed)
 
 	timeval globalIniTime, ini, end;
 	cout << "START" << endl;
@@ -55,6 +62,10 @@ void work(igcl::Peer * peer)
 
 	double realTime = 0;
 	uint individualSize = instance->points.size();
+	uint statsInterval = (uint) (100 * 400.0/individualSize);
+
+	// (the best individual goes to every other island once per stats interval, without waiting for the network)
+	Migration migration(peer, tsp, Migration::ALL, statsInterval, 1, Migration::BEST, Migration::BEST);
 
 	while (1)
 	{
@@ -63,7 +74,9 @@ void work(igcl::Peer * peer)
 		gettimeofday(&end, NULL);
 		realTime += timeDiff(ini, end) / 1000.0;
 
-		if (tsp->doneGenerations % ((int) (100 * 400.0/individualSize)) == 0)
+		migration.exchange();
+
+		if (tsp->doneGenerations % statsInterval == 0)
 		{
 			gettimeofday(&end, NULL);
 
@@ -79,38 +92,9 @@ void work(igcl::Peer * peer)
 			cout << "doneMutations:      " << setw(9) << tsp->doneMutations			<< " (" << setw(8) << tsp->doneMutations/diff		<< " p/sec)" << endl;
 			cout << "doneRecombinations: " << setw(9) << tsp->doneRecombinations	<< " (" << setw(8) << tsp->doneRecombinations/diff	<< " p/sec)" << endl;
 			cout << "doneEvaluations:    " << setw(9) << tsp->doneEvaluations		<< " (" << setw(8) << tsp->doneEvaluations/diff		<< " p/sec)" << endl;
+			cout << "doneDeltaEvals:     " << setw(9) << tsp->doneDeltaEvaluations	<< " (" << setw(8) << tsp->doneDeltaEvaluations/diff	<< " p/sec)" << endl;
 
-			int count = 0;
-			int * received = NULL;
-			uint matSize = 0;
-			igcl::peer_id id;
-
-			while (peer->tryRecvNewFromAny(id, received, matSize) == igcl::SUCCESS)
-			{
-				std::cout << "received stuff from: " << id << std::endl;
-				vector<order_type> v(received, received+matSize);
-				free(received);
-				TSPIndividual * indiv = new TSPIndividual(v);
-				std::cout << "received indiv: " << *indiv << std::endl;
-
-				indiv->fitness = tsp->evaluateExternalIndividual(indiv);
-
-				uint index = tsp->population.size()-1-count;
-				delete tsp->population[index];
-				tsp->population[index] = indiv;
-
-				++count;
-			}
-
-			int indiv_arr[individualSize];
-			copy(bestIndiv->pointOrder.begin(), bestIndiv->pointOrder.end(), indiv_arr+0);
-			if (peer->sendToAll(indiv_arr+0, individualSize) == igcl::FAILURE) {
-			//if (peer->sendToAllPeersThroughCoordinator(indiv_arr+0, individualSize) == igcl::FAILURE) {
-				std::cout << "FAILURE" << std::endl;
-				return;
-			}
-
-			//peer->barrier();
+			cout << migration.statsToString() << endl;
 		}
 	}
 }
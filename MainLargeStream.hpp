@@ -0,0 +1,98 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+
+#include "igcl/igcl.hpp"
+
+using namespace std;
+
+// sends a large array to every peer as a stream. peers add up each chunk as it arrives, so they never
+// hold more than a few chunks in memory, and the array may be bigger than a single message allows
+
+#define TEST_READY
+
+typedef double DATATYPE;
+
+int ARRAYSIZE = 50000000;
+int nTests = 5;
+int nParticipants = 2;
+void setSize(int val)   { ARRAYSIZE = val; }
+void setNTests(int val) { nTests = val; }
+void setNNodes(int val) { nParticipants = val; }
+
+
+void runCoordinator(igcl::Coordinator * coord)
+{
+	GroupLayout layout = GroupLayout::getMasterWorkersLayout(nParticipants);
+	coord->setLayout(layout);
+	coord->start();
+	coord->waitForNodes(nParticipants);
+
+	uint64_t count = ARRAYSIZE;
+	DATATYPE * array = (DATATYPE*) malloc(count*sizeof(DATATYPE));
+	DATATYPE expected = 0;
+	for (uint64_t i=0; i<count; ++i) {
+		array[i] = i % 1000;
+		expected += array[i];
+	}
+
+	for (int test=0; test<nTests; ++test)
+	{
+		timeval iniTime, endTime;
+		gettimeofday(&iniTime, NULL);
+
+		vector<thread> senders;
+		for (igcl::peer_id id : coord->downstreamPeers()) {
+			senders.push_back(thread([coord, id, array, count]() { coord->sendStreamTo(id, array, count); }));
+		}
+		for (thread & t : senders) {
+			t.join();
+		}
+
+		for (uint i=0; i<coord->nDownstreamPeers(); ++i) {
+			igcl::peer_id id;
+			DATATYPE sum;
+			coord->waitRecvFromAny(id, sum);
+			if (sum != expected) {
+				printf("WRONG SUM FROM PEER %d!!!!!!!\n", id);
+			}
+		}
+
+		gettimeofday(&endTime, NULL);
+		long ms = timeDiff(iniTime, endTime);
+		double mb = count*sizeof(DATATYPE) * coord->nDownstreamPeers() / 1e6;
+		printf("Time = %ld ms (%.0f MB streamed, %.0f MB/s)\n", ms, mb, mb * 1000 / std::max(ms, 1L));
+	}
+
+	free(array);
+	coord->terminate();
+}
+
+
+void runPeer(igcl::Peer * peer)
+{
+	peer->start();
+
+	for (int test=0; test<nTests; ++test)
+	{
+		igcl::StreamHandle * stream;
+		if (peer->waitRecvStreamFrom(0, stream) != igcl::SUCCESS)
+			break;
+
+		DATATYPE sum = 0;
+		const char * chunk;
+		igcl::size_type nBytes;
+		while (stream->nextChunk(chunk, nBytes) == igcl::SUCCESS) {		// (chunks hold whole elements)
+			const DATATYPE * values = (const DATATYPE *) chunk;
+			for (uint i=0; i<nBytes/sizeof(DATATYPE); ++i) {
+				sum += values[i];
+			}
+		}
+		delete stream;
+
+		peer->sendTo(0, sum);
+	}
+
+	peer->hang();
+}
@@ -114,6 +114,7 @@ for (int i=0; i<nTests; i++) {
 	igcl::NBuffering buf(bufferingLevel, MATSIZE, 1, sendJob);
 	buffering = &buf;
 	buffering->addPeers(coord->downstreamPeers());
+	buffering->setAdaptiveDepth(4*bufferingLevel);		// (starts at "bufferingLevel" rows per peer)
 
 	timeval iniTime;
 	start(iniTime);
@@ -126,6 +127,7 @@ for (int i=0; i<nTests; i++) {
 		receiveResult();
 
 	finish(iniTime);
+	cout << buffering->statsToString() << endl;
 }
 
 	coord->terminate();
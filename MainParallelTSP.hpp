@@ -5,10 +5,6 @@
 #include <iostream>
 #include <cmath>
 
-#include <thread>
-#include <condition_variable>
-#include <mutex>
-#include <atomic>
 
 using namespace std;
 
@@ -21,196 +17,268 @@ void setNTests(int val) { nTests = val; }
 void setNNodes(int val) { nParticipants = val; }
 
 #define INF 100000000.0
-#define END_MINDIST_TAG -1.0f
 
-#define BITSET_OF_ONES(n) ((1 << n) - 1)
+typedef unsigned long long visited_type;
+
+#define BITSET_OF_ONES(n) ((n) < 64 ? ((visited_type) 1 << (n)) - 1 : ~(visited_type) 0)
 #define GET_BIT(set,i)    ((set >> i) & 1)
-#define SET_BIT(set,i)    (set | (1 << i))
-#define UNSET_BIT(set,i)  (set & (~(1 << i)))
+#define SET_BIT(set,i)    (set | ((visited_type) 1 << i))
+#define UNSET_BIT(set,i)  (set & (~((visited_type) 1 << i)))
 
-typedef unsigned long long visited_type;
+//#define DISABLE_EXCHANGE		// each node prunes with its own best tour only
+//#define DISABLE_STEALING		// each node only solves its part of an even split of the subproblems
 
-//#define DISABLE_EXCHANGE
+uint splitDepth = 2;		// subproblems are the paths of this many cities (scheduled by work stealing)
+const char * dataset = "berlin52";		// (its first "size" cities; e.g. "pr439" or "wi29")
 
 
 uint n;
 visited_type allVisited;
-std::vector< std::vector<float> > dists;
+const float * dists;				// rows of the instance's matrix ("stride" floats each), of which the first n are used
+uint stride;
+std::vector<uint> candidates;		// n*(n-1): the other cities of each city, nearest first
+std::vector<float> minEdge;			// shortest edge of each city (slightly lowered, so that rounding errors
+									// in the sums of bounds never prune the best path)
 
 igcl::Node * node;
-atomic<bool> isEnding;
+uint64_t nExpanded;			// paths extended by TSP() in the current test
+
+#ifndef DISABLE_EXCHANGE
+igcl::SharedBound * bound;
+
+inline float getBound()           { return bound->get(); }
+inline void offerBound(float val) { bound->offer(val); }
+#else
 float mindist;
-uint nFinishedPeers;
 
-std::mutex distMutex;
-std::mutex quittingMutex;
+inline float getBound()           { return mindist; }
+inline void offerBound(float val) { mindist = std::min(mindist, val); }
+#endif
 
 
-void updateBound()
+// depth-first search of every path that extends the given one (with an explicit stack). each unvisited city
+// will still be entered by one edge, at least as long as its shortest one, so a path is only extended if its
+// distance plus the shortest edges of the cities it did not visit yet ("rest") is below the best known tour
+void TSP(visited_type visited, uint ind, float curdist)
 {
-	float lastValue = INF;
-	igcl::peer_id id;
-	float * value;
-	uint valueSize;
-	bool sentLast = false;
-
-	std::unique_lock<std::mutex> mindistLock(distMutex);
-	mindistLock.unlock();
+	struct Frame
+	{
+		visited_type visited;
+		uint ind;
+		uint next;			// index of the next candidate to try
+		float curdist, rest;
+	};
+
+	Frame stack[64];		// (one frame per city of the path)
+	float rest = 0;
+	for (uint i = 0; i < n; i++) {
+		if (GET_BIT(visited, i) == 0)
+			rest += minEdge[i];
+	}
+	stack[0] = { visited, ind, 0, curdist, rest };
+	int top = 0;
+	nExpanded++;
 
-	while (1)
+	while (top >= 0)
 	{
-		if (isEnding) {
-			if (!sentLast) {
-				if (node->getId() != 0 or nFinishedPeers == node->getNPeers()-1) {
-					//cout << "sent end" << endl;
-					float value[2];
-					value[0] = mindist;
-					value[1] = END_MINDIST_TAG;
-					node->sendToAll(value);
-					//cout << "sent to all" << endl;
-					sentLast = true;
-
-					if (nFinishedPeers == node->getNPeers()-1) {
-						//cout << "returning" << endl;
-						return;
-					}
-				}
-			}
-		} else {
-#ifndef DISABLE_EXCHANGE
-			mindistLock.lock();
-			float tmp = mindist;
-			mindistLock.unlock();
+		Frame & frame = stack[top];
 
-			if (tmp < lastValue) {
-				node->sendToAll(tmp);
-				lastValue = tmp;
-			}
-#endif
+		if (frame.visited == allVisited) {	// no place left to go to (and distance previously confirmed to be smaller than current min)
+			offerBound(frame.curdist);
+			top--;
+			continue;
 		}
 
-		while (node->tryRecvNewFromAny(id, value, valueSize) == igcl::SUCCESS)
+		const float * row = &dists[frame.ind * stride];
+		const uint * cands = &candidates[frame.ind * (n-1)];
+		bool extended = false;
+
+		while (frame.next < n-1)
 		{
-			//cout << "(from " << id << ") ";
-			if (valueSize == 2) {
-				//cout << "tag: " << value[1] << ", value: " << value[0] << endl;
-				nFinishedPeers++;
-				//cout << "end finished:" << nFinishedPeers << " id: " << id << endl;
-			} else {
-				//assert(valueSize == 1);
-				//cout << "value: " << value[0] << endl;
+			uint i = cands[frame.next++];
+			if (GET_BIT(frame.visited, i))
+				continue;
+
+			float res = frame.curdist + row[i];
+			float bound = getBound();
+			if (res >= bound) {		// (the next candidates are all farther)
+				frame.next = n-1;
+				break;
 			}
 
-			float received = value[0];
-			free(value);
-
-#ifndef DISABLE_EXCHANGE
-			mindistLock.lock();
-			if (mindist > received) {
-				mindist = received;
-				lastValue = mindist;
+			float restAfter = frame.rest - minEdge[i];
+			if (res + restAfter < bound) {
+				stack[++top] = { SET_BIT(frame.visited, i), i, 0, res, restAfter };
+				nExpanded++;
+				extended = true;
+				break;
 			}
-			mindistLock.unlock();
-#endif
+		}
 
-			if (nFinishedPeers == node->getNPeers()-1 and sentLast) {
-				//cout << "returning" << endl;
-				return;
+		if (!extended)
+			top--;
+	}
+}
+
+
+// candidate lists of the first n cities and their shortest edges
+void prepareSearch(const TSPInstance & instance)
+{
+	dists = instance.row(0);
+	stride = instance.getStride();
+	candidates.resize(n * (n-1));
+	minEdge.assign(n, INF);
+
+	for (uint i = 0; i < n; i++) {
+		uint * cands = &candidates[i * (n-1)];
+		uint k = 0;
+		for (uint j = 0; j < n; j++) {
+			if (j != i) {
+				cands[k++] = j;
+				minEdge[i] = std::min(minEdge[i], dists[i*stride + j]);
 			}
 		}
+		std::sort(cands, cands + (n-1), [i](uint a, uint b) { return dists[i*stride + a] < dists[i*stride + b]; });
+		minEdge[i] *= 0.9999f;
+	}
+}
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+// number of paths of "depth" different cities
+uint64_t nSubproblemsOf(uint depth)
+{
+	uint64_t count = 1;
+	for (uint level = 0; level < depth; level++) {
+		count *= n - level;
 	}
+	return count;
 }
 
 
-void TSP(visited_type visited, uint ind, float curdist)
+// solves every path that starts with subproblem "job": its cities are the digits of "job", in a mixed
+// radix where each digit chooses one of the cities not yet visited
+void solveSubproblem(uint64_t job, uint depth)
 {
-	if (visited == allVisited) {	// no place left to go to (and distance previously confirmed to be smaller than current min)
-#ifndef DISABLE_EXCHANGE
-		std::unique_lock<std::mutex> minDistLock(distMutex);
-#endif
-		if (mindist > curdist) {
-			mindist = curdist;
-		}
-#ifndef DISABLE_EXCHANGE
-		minDistLock.unlock();
-#endif
-		return;
+	uint digits[depth];
+	for (int level = depth-1; level >= 0; level--) {
+		digits[level] = job % (n - level);
+		job /= n - level;
 	}
 
-	for (uint i = 0; i < n; i++)	// for each not-visited place
-	{
-		if (GET_BIT(visited, i) == 0)
-		{
-			float res = curdist + dists[ind][i];
-			if (res < mindist) {	// check if it's possible to find a smaller (than mindist) distance this way
-				TSP(SET_BIT(visited, i), i, res);	/* next call, with place set as visited */
-			}
+	visited_type visited = 0;
+	uint ind = 0;
+	float curdist = 0;
+
+	for (uint level = 0; level < depth; level++) {
+		uint i = 0;
+		for (uint k = digits[level]; GET_BIT(visited, i) or k > 0; i++) {		// the k-th city not visited
+			if (GET_BIT(visited, i) == 0)
+				k--;
+		}
+
+		if (level > 0) {
+			curdist += dists[ind*stride + i];
+			if (curdist >= getBound())
+				return;
 		}
+		visited = SET_BIT(visited, i);
+		ind = i;
 	}
+
+	TSP(visited, ind, curdist);
 }
 
 
-void solve(uint iniI, uint endI)
+void solve(igcl::WorkStealing & stealing)
 {
 	// reset
+#ifndef DISABLE_EXCHANGE
+	bound->reset(INF);
+#else
 	mindist = INF;
-	nFinishedPeers = 0;
-	isEnding = false;
-	std::thread th(updateBound);
+#endif
+	nExpanded = 0;
 
 	timeval globalIniTime, end;
 	//cout << "START" << endl;
 	gettimeofday(&globalIniTime, NULL);
 
-	visited_type visited = 0;
+	uint depth = std::min(splitDepth, n);
+	uint64_t nSubproblems = nSubproblemsOf(depth);
 
-	// initial call. chooses the origin for the remaining algorithm
-	for(uint i = iniI; i < endI; i++) {
-		TSP(SET_BIT(visited, i), i, 0);
+#ifndef DISABLE_STEALING
+	stealing.start(nSubproblems);
+	uint64_t job;
+	while (stealing.next(job)) {
+		solveSubproblem(job, depth);
 	}
+	double busyMs = stealing.getBusyMs();
+#else
+	uint64_t nNodes = node->getNPeers(), id = node->getId();
+	uint64_t nPerNode = nSubproblems / nNodes, remainder = nSubproblems % nNodes;
+	uint64_t iniJob = nPerNode * id + std::min(id, remainder);
+	uint64_t endJob = iniJob + nPerNode + (id < remainder ? 1 : 0);
+	for (uint64_t job = iniJob; job < endJob; job++) {
+		solveSubproblem(job, depth);
+	}
+	gettimeofday(&end, NULL);
+	double busyMs = timeDiff(globalIniTime, end);
+#endif
 
-	isEnding = true;
-	th.join();
-	// when thread joins, we are guaranteed to have received everything from other nodes in this test
+	// every node tells the others its best tour (the last improvements may still be on their way)
+	float best = getBound();
+	node->sendUrgentToAll(best);
+
+	for (igcl::peer_id id = 0; id < (igcl::peer_id) node->getNPeers(); id++) {
+		float received;
+		if (id != node->getId() and node->waitRecvFrom(id, received) == igcl::SUCCESS) {
+			best = std::min(best, received);
+		}
+	}
 
 	gettimeofday(&end, NULL);
 	double diff = timeDiff(globalIniTime, end) / 1000.0;
 	cout << "time elapsed: " << diff << " sec" << endl;
-	//cout << "mindist: " << mindist << endl;
+
+	// (idle time includes waiting for the other nodes to finish)
+	cout << "node " << node->getId() << ": busy: " << (long) busyMs << " ms, idle: " << (long) (diff*1000 - busyMs) << " ms";
+#ifndef DISABLE_STEALING
+	cout << " (" << stealing.statsToString() << ")";
+#endif
+	cout << endl;
+	cout << "node " << node->getId() << ": expanded: " << nExpanded;
+#ifndef DISABLE_EXCHANGE
+	cout << " (" << bound->statsToString() << ")";
+#endif
+	cout << endl;
+	//cout << "mindist: " << best << endl;
 }
 
 
 void work(igcl::Node * node)
 {
 	TSPInstance * instance = new TSPInstance();
-	//bool valid = instance->initializeFromFile("tsp/tsp_datasets/wi29.tsp");
-	bool valid = instance->initializeFromFile("tsp/tsp_datasets/berlin52.tsp");
-	if (!valid)
-		valid = instance->initializeFromFile("../tsp/tsp_datasets/berlin52.tsp");
+	std::string file = std::string("tsp/tsp_datasets/") + dataset + ".tsp";
+	bool valid = instance->initializeFromFile(file);
+	if (!valid) {
+		file = "../" + file;
+		valid = instance->initializeFromFile(file);
+	}
 	if (!valid)
 		return;
 
-	instance->precalculateDistances();
+	instance->precalculateDistancesCached(file + ".dists");		// (shared by the nodes of this machine)
 
-	dists = instance->dists;
 	n = std::min((uint) ::size, (uint) instance->points.size());
+	n = std::min(n, (uint) (8 * sizeof(visited_type)));
 	allVisited = BITSET_OF_ONES(n);
+	prepareSearch(*instance);
 
-	uint iniI, endI;
-	uint sizePerPeer = n / node->getNPeers();
-	int remainder = n % node->getNPeers();
-
-	if (node->getId() < remainder) {
-		iniI = sizePerPeer * node->getId() + node->getId();
-		endI = iniI + sizePerPeer + 1;
-	} else {
-		iniI = sizePerPeer * node->getId() + remainder;
-		endI = iniI + sizePerPeer;
-	}
-
-	//cout << iniI << " " << endI << endl;
+	igcl::WorkStealing stealing(node);
+#ifndef DISABLE_EXCHANGE
+	igcl::SharedBound sharedBound(node);
+	bound = &sharedBound;
+#endif
 
 	for (int test=0; test<nTests; ++test)
 	{
@@ -219,8 +287,9 @@ void work(igcl::Node * node)
 		float dummy;
 		igcl::peer_id dummyId;
 
-		if (node->getId() == 0) {		// synchronize everything for next test
-			node->sendToAll((float) 12345.5);
+		// synchronize everything for next test (urgently, like the bounds, so that they cannot overtake it)
+		if (node->getId() == 0) {
+			node->sendUrgentToAll((float) 12345.5);
 
 			for (int i=0; i<nParticipants-1; i++) {
 				node->waitRecvFromAny(dummyId, dummy);
@@ -231,7 +300,7 @@ void work(igcl::Node * node)
 				}
 			}
 
-			node->sendToAll((float) 34512.5);
+			node->sendUrgentToAll((float) 34512.5);
 		} else {
 			node->waitRecvFrom(0, dummy);
 			if (!(dummy == (float) 12345.5)) {
@@ -239,7 +308,7 @@ void work(igcl::Node * node)
 				uint a;
 				std::cin >> a;
 			}
-			node->sendTo(0, (float) 54321.5);
+			node->sendUrgentTo(0, (float) 54321.5);
 			node->waitRecvFrom(0, dummy);
 			if (!(dummy == (float) 34512.5)) {
 				cout << dummy << " != 34512.5 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << endl;
@@ -248,7 +317,7 @@ void work(igcl::Node * node)
 			}
 		}
 
-		solve(iniI, endI);
+		solve(stealing);
 	}
 }
 
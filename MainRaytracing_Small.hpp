@@ -16,9 +16,12 @@ using namespace std;
 
 #define TEST_READY
 
-typedef pair<int, int> Job;
+typedef pair<uint, uint> Job;		// first pixel and number of pixels
 
-static const uint blockSize = 10000;
+static const uint blockSize = 10000;			// pixels per job (at most, since they adapt to each peer)
+static const uint minBlockSize = 1000;
+static const uint maxBufferingLevel = 64;
+static const uint jobTimeoutMs = 5000;		// jobs are sent again to other peers after this long
 int bufferingLevel = 10;
 int nTests = 30;
 int nParticipants = 1;
@@ -44,14 +47,14 @@ struct color_s_char {
 };
 
 igcl::Coordinator * coord;
-igcl::NBuffering * buffering;
+igcl::NBuffering * buffering = NULL;
 
 BmpImage * image;
 uint imageSize;
 Raytracer * raytracer;
 
 std::thread * th;
-std::queue<uint> threadJobs;
+std::queue<Job> threadJobs;
 
 std::mutex threadJobsAccessMutex;
 std::condition_variable threadJobsAccessCondVar;
@@ -66,15 +69,24 @@ void runThread()
 		std::unique_lock<std::mutex> threadQueueLock(threadJobsAccessMutex);
 
 		while (threadJobs.empty()) {
-			threadJobsAccessCondVar.wait(threadQueueLock);
+			// while idle, also gives the jobs of peers that timed out to other peers
+			if (threadJobsAccessCondVar.wait_for(threadQueueLock, std::chrono::milliseconds(jobTimeoutMs)) == std::cv_status::timeout) {
+				threadQueueLock.unlock();
+				std::unique_lock<std::mutex> bufferLock(bufferingAccessMutex);
+				if (buffering != NULL) {
+					buffering->checkTimeouts();
+				}
+				bufferLock.unlock();
+				threadQueueLock.lock();
+			}
 		}
-		uint startIndex = threadJobs.front();
+		Job job = threadJobs.front();
 		threadJobs.pop();
 
 		threadQueueLock.unlock();
 
-		uint nIndexes = std::min(blockSize, imageSize-startIndex);
-		uint endIndex = startIndex + nIndexes;
+		uint startIndex = job.first;
+		uint endIndex = startIndex + job.second;
 		countJobs++;
 		for (uint i=startIndex; i<endIndex; ++i) {
 			int row = i / IMAGE_WIDTH;
@@ -84,46 +96,65 @@ void runThread()
 		}
 
 		std::unique_lock<std::mutex> bufferLock(bufferingAccessMutex);
-		buffering->completeJob(0);
-		buffering->bufferTo(0);
-		if (buffering->allJobsCompleted()) {
-			coord->sendToSelf((char) 0);
+		if (buffering != NULL) {
+			buffering->completeJob(0);
+			buffering->bufferTo(0);
+			if (buffering->allJobsCompleted()) {
+				coord->sendToSelf((char) 0);
+			}
 		}
 		bufferLock.unlock();
 	}
 }
 
 
-void sendJob(igcl::peer_id id, uint sendIndex) {
+void sendJob(igcl::peer_id id, uint sendIndex, uint nIndexes) {
 	//cout << "sendJob() to " << id << " index: " << sendIndex << endl;
 	if (id == 0) {
 		std::lock_guard<std::mutex> threadQueueLock(threadJobsAccessMutex);
-		threadJobs.push(sendIndex);
+		threadJobs.push(Job(sendIndex, nIndexes));
 		threadJobsAccessCondVar.notify_one();
 	} else {
-		coord->sendTo(id, sendIndex);
+		coord->sendTo(id, Job(sendIndex, nIndexes));
+	}
+}
+
+
+// the jobs of peers that left are given up, since their results never arrive (called with "bufferingAccessMutex" locked)
+void removePeersThatLeft() {
+	std::vector<igcl::peer_id> peerIds = coord->getPeerIds();
+	for (igcl::peer_id id : buffering->getPeers()) {
+		if (id != 0 and std::find(peerIds.begin(), peerIds.end(), id) == peerIds.end()) {
+			buffering->removePeer(id);
+		}
 	}
 }
 
 
-void receiveResult() {
+// returns false if "wait" is not set and no result had arrived yet
+bool receiveResult(bool wait = true) {
 	//cout << "receiveResult()" << endl;
 	igcl::peer_id sourceId;
 	color_s_char * buffer=NULL; uint size;
 
-	coord->waitRecvNewFromAny(sourceId, buffer, size);
+	if (wait) {
+		coord->waitRecvNewFromAny(sourceId, buffer, size);
+	} else if (coord->tryRecvNewFromAny(sourceId, buffer, size) != igcl::SUCCESS) {
+		return false;
+	}
 	//cout << "got result" << endl;
 
 	if (sourceId == 0) {	// was a coordinator self-send
 		//cout << "was a coordinator self-send" << endl;
 		free(buffer);
-		return;
+		return true;
 	}
 
 	std::unique_lock<std::mutex> bufferLock(bufferingAccessMutex);
-	uint indexIni = buffering->completeJob(sourceId);
+	uint indexIni;
+	bool isFirst = buffering->completeJob(sourceId, indexIni);
 	bufferLock.unlock();
-	uint indexEnd = indexIni+size;
+	uint indexEnd = (isFirst ? indexIni+size : indexIni);		// (another peer already sent these pixels)
 
 	for (uint i = indexIni; i < indexEnd; ++i) {
 		const color_s_char & c = buffer[i-indexIni];
@@ -134,6 +165,7 @@ void receiveResult() {
 	bufferLock.lock();
 	buffering->bufferTo(sourceId);
 	bufferLock.unlock();
+	return true;
 }
 
 
@@ -190,6 +222,10 @@ for (int i=0; i<nTests; i++) {
 	buffering = &buf;
 	buffering->addPeers(coord->downstreamPeers());
 	buffering->addPeer(0);
+	buffering->setSpeculation(2);
+	buffering->setJobTimeout(jobTimeoutMs);
+	buffering->setAdaptiveDepth(maxBufferingLevel);
+	buffering->setGuidedBlocks(minBlockSize);
 	bufferLock.unlock();
 
 	timeval iniTime;
@@ -213,6 +249,22 @@ for (int i=0; i<nTests; i++) {
 	cout << "count: " << countJobs << endl;
 
 	finish(iniTime);
+
+	// results of copies sent to slower peers still arrive, and must not be taken for the next image's. every peer
+	// still in the group is waited for (those that left are checked for while waiting)
+	bufferLock.lock();
+	removePeersThatLeft();
+	while (buffering->nPendingResults() > 0) {
+		bufferLock.unlock();
+		if (!receiveResult(false)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		bufferLock.lock();
+		removePeersThatLeft();
+	}
+	cout << buffering->statsToString() << endl;
+	buffering = NULL;
+	bufferLock.unlock();
 }
 
 	coord->terminate();
@@ -233,13 +285,14 @@ void runPeer(igcl::Peer * peer)
 
 	while (1)
 	{
-		uint startIndex = 0;
-		igcl::result_type res = peer->waitRecvFrom(0, startIndex);
+		Job job;
+		igcl::result_type res = peer->waitRecvFrom(0, job);
 		if (res != igcl::SUCCESS)
 			break;
 		//std::cout << "received " << startIndex << endl;
 
-		uint nIndexes = std::min(blockSize, imageSize-startIndex);
+		uint startIndex = job.first;
+		uint nIndexes = job.second;
 		uint endIndex = startIndex + nIndexes;
 
 		color_s_char array[nIndexes];
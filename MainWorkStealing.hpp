@@ -0,0 +1,149 @@
+#include <iostream>
+#include <cmath>
+
+#include "igcl/igcl.hpp"
+
+using namespace std;
+
+// jobs whose cost grows with their index, so an even split of them gives the last nodes far more work than the
+// first. each test runs them once split evenly and once with work stealing. every node sends node 0 the sum of
+// the indexes of the jobs it did, which must add up to the sum of all of them
+
+#define TEST_READY
+
+int nJobs = 2000;
+int nTests = 5;
+int nParticipants = 4;
+void setSize(int val)   { nJobs = val; }
+void setNTests(int val) { nTests = val; }
+void setNNodes(int val) { nParticipants = val; }
+
+
+struct Report
+{
+	uint64_t indexSum;
+	double busyMs, idleMs;
+};
+
+
+double doJob(uint64_t job)
+{
+	double x = 0;
+	uint64_t nIterations = 200 + job * job / 20;
+	for (uint64_t i=0; i<nIterations; ++i) {
+		x += sqrt((double) (i ^ job));
+	}
+	return x;
+}
+
+
+// node 0 gets everyone's report and prints how long the slowest node took, and how busy each one was
+void collect(igcl::Node * node, const Report & own, const timeval & iniTime, const char * mode)
+{
+	timeval endTime;
+	uint64_t indexSum = own.indexSum;
+	double maxBusyMs = own.busyMs, sumBusyMs = own.busyMs, sumIdleMs = own.idleMs;
+
+	for (uint id=1; id<node->getNPeers(); ++id) {
+		Report report;
+		node->waitRecvFrom(id, report);
+		indexSum += report.indexSum;
+		maxBusyMs = std::max(maxBusyMs, report.busyMs);
+		sumBusyMs += report.busyMs;
+		sumIdleMs += report.idleMs;
+	}
+	gettimeofday(&endTime, NULL);
+
+	uint64_t expected = (uint64_t) nJobs * (nJobs-1) / 2;
+	printf("%-8s time: %5ld ms, busiest node: %8.1f ms, mean busy: %8.1f ms, mean idle: %8.1f ms%s\n", mode,
+			timeDiff(iniTime, endTime), maxBusyMs, sumBusyMs / node->getNPeers(), sumIdleMs / node->getNPeers(),
+			(indexSum == expected ? "" : "  WRONG JOBS!!!!!!!"));
+}
+
+
+void work(igcl::Node * node)
+{
+	igcl::WorkStealing stealing(node);
+	volatile double sink = 0;
+
+	for (int test=0; test<nTests; ++test)
+	{
+		// even split
+		float go;
+		if (node->getId() == 0) {
+			node->sendUrgentToAll((float) 1);
+		} else {
+			node->waitRecvFrom(0, go);
+		}
+
+		timeval iniTime, endTime;
+		gettimeofday(&iniTime, NULL);
+
+		uint nNodes = node->getNPeers();
+		uint64_t perNode = nJobs / nNodes, remainder = nJobs % nNodes, id = node->getId();
+		uint64_t begin = perNode * id + std::min(id, remainder);
+		uint64_t end = begin + perNode + (id < remainder ? 1 : 0);
+
+		Report report = { 0, 0, 0 };
+		for (uint64_t job = begin; job < end; ++job) {
+			sink = sink + doJob(job);
+			report.indexSum += job;
+		}
+		gettimeofday(&endTime, NULL);
+		report.busyMs = timeDiff(iniTime, endTime);
+
+		if (node->getId() == 0) {
+			collect(node, report, iniTime, "split");
+		} else {
+			node->sendTo(0, report);
+		}
+
+		// work stealing
+		if (node->getId() == 0) {
+			for (uint id=1; id<nNodes; ++id) {
+				node->waitRecvFrom(id, go);		// (every node starts the round at the same time)
+			}
+			node->sendUrgentToAll((float) 1);
+		} else {
+			node->sendTo(0, (float) 1);
+			node->waitRecvFrom(0, go);
+		}
+
+		gettimeofday(&iniTime, NULL);
+		stealing.start(nJobs);
+
+		report.indexSum = 0;
+		uint64_t job;
+		while (stealing.next(job)) {
+			sink = sink + doJob(job);
+			report.indexSum += job;
+		}
+		report.busyMs = stealing.getBusyMs();
+		report.idleMs = stealing.getIdleMs();
+
+		if (node->getId() == 0) {
+			collect(node, report, iniTime, "stealing");
+			cout << "node 0: " << stealing.statsToString() << endl;
+		} else {
+			node->sendTo(0, report);
+		}
+	}
+}
+
+
+void runCoordinator(igcl::Coordinator * coord)
+{
+	coord->setLayout(GroupLayout::getAllToAllLayout(nParticipants));
+	coord->start();
+	coord->waitForNodes(nParticipants);
+	work(coord);
+	coord->terminate();
+}
+
+
+void runPeer(igcl::Peer * peer)
+{
+	peer->start();
+	work(peer);
+	peer->hang();
+}
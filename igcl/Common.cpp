@@ -2,6 +2,7 @@
 
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <algorithm>
 
 
@@ -35,12 +36,146 @@ namespace igcl		// Internet Group-Communication Library
 					case DESCRIPTOR_NICE:
 						ss << "stream " << peer.second.desc << sep;
 						break;
+					case DESCRIPTOR_SHM:
+						ss << "shared memory channel " << peer.second.desc << sep;
+						break;
+					case DESCRIPTOR_UDP:
+						ss << "udp channel " << peer.second.desc << sep;
+						break;
 				}
 			});
 
 		return ss.str();
 	}
 
+	const long ConnectionCache::SAVE_DELAY_MS;
+	const long ConnectionCache::RELAYED_RETRY_SECONDS;
+
+
+	ConnectionCache::~ConnectionCache()
+	{
+		{ // lock scope
+			std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+			stopping = true;
+		}
+		condVar.notify_one();
+		if (saverThread != NULL) {
+			saverThread->join();	// saves whatever is still pending
+			delete saverThread;
+		}
+	}
+
+
+	connection_type ConnectionCache::get(const address & addr1, const address & addr2)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		auto it = outcomes.find(makeKey(addr1, addr2));
+		if (it == outcomes.end())
+			return CONNECTION_UNKNOWN;
+
+		// a relay may only have been needed due to a transient failure, so every now and then
+		// give no hint and let the pair try a direct connection again (its report updates the entry)
+		std::time_t now = std::time(NULL);
+		if (it->second.type == CONNECTION_RELAYED and now - it->second.triedAt >= RELAYED_RETRY_SECONDS) {
+			it->second.triedAt = now;
+			return CONNECTION_UNKNOWN;
+		}
+		return it->second.type;
+	}
+
+
+	void ConnectionCache::set(const address & addr1, const address & addr2, connection_type type)
+	{
+		{ // lock scope
+			std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+			auto it = outcomes.find(makeKey(addr1, addr2));
+			if (it == outcomes.end()) {
+				outcomes[makeKey(addr1, addr2)] = { type, std::time(NULL) };
+			} else if (it->second.type != type) {
+				it->second = { type, std::time(NULL) };
+			} else {
+				return;		// a hint was just followed again, nothing new to save
+			}
+			dirty = true;
+		}
+		condVar.notify_one();
+	}
+
+
+	bool ConnectionCache::setFile(const std::string & filepath)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		this->filepath = filepath;
+		if (saverThread == NULL) {
+			saverThread = new std::thread(&ConnectionCache::saverLoop, this);
+		}
+
+		std::ifstream file(filepath);
+		if (file.fail())
+			return false;
+
+		// one "ip:port ip:port type [triedAt]" entry per line
+		std::string line, addr1, addr2;
+		while (std::getline(file, line)) {
+			std::istringstream ss(line);
+			int type;
+			long long triedAt = 0;
+			if (ss >> addr1 >> addr2 >> type) {
+				ss >> triedAt;
+				outcomes[key_type(addr1, addr2)] = { (connection_type) type, (std::time_t) triedAt };
+			}
+		}
+		return true;
+	}
+
+
+	void ConnectionCache::saverLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condVar.wait(lock, [this] { return dirty or stopping; });
+			if (!dirty)
+				return;
+			if (!stopping) {
+				condVar.wait_for(lock, std::chrono::milliseconds(SAVE_DELAY_MS), [this] { return stopping; });
+			}
+
+			// write a snapshot outside the lock, so that reporting peers are never held up by the disk
+			std::string path = filepath;
+			std::map<key_type, outcome> snapshot = outcomes;
+			dirty = false;
+			lock.unlock();
+			saveToFile(path, snapshot);
+			lock.lock();
+		}
+	}
+
+
+	bool ConnectionCache::saveToFile(const std::string & filepath, const std::map<key_type, outcome> & outcomes)
+	{
+		std::ofstream file(filepath, std::ios::trunc);
+		if (file.fail())
+			return false;
+
+		for (auto & outcome : outcomes) {
+			file << outcome.first.first << ' ' << outcome.first.second << ' ' << (int) outcome.second.type
+				<< ' ' << (long long) outcome.second.triedAt << '\n';
+		}
+		return true;
+	}
+
+
+	ConnectionCache::key_type ConnectionCache::makeKey(const address & addr1, const address & addr2)
+	{
+		std::stringstream ss1, ss2;
+		ss1 << addr1;
+		ss2 << addr2;
+		if (ss2.str() < ss1.str())		// a pair's outcome is the same regardless of who requested the connection
+			return key_type(ss2.str(), ss1.str());
+		return key_type(ss1.str(), ss2.str());
+	}
+
+
 	std::string Stats::toString() {
 		std::stringstream ss;
 		ss << "# bytes sent:     " << nBytesSent << " (" << nSends << " sends)";
@@ -5,8 +5,17 @@
 #include <map>
 #include <list>
 #include <queue>
+#include <deque>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
 #include <functional>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <ctime>
 
 
 namespace igcl		// Internet Group-Communication Library
@@ -105,7 +114,8 @@ namespace igcl		// Internet Group-Communication Library
 		inline peer_id descriptorToId(descriptor_pair desc)
 		{
 			std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
-			return fdToId[desc];
+			auto it = fdToId.find(desc);	// unknown descriptors (new connections) must not be added to the table
+			return (it == fdToId.end() ? INVALID_PEER_ID : it->second);
 		}
 
 		inline std::vector<peer_id> getAllIds()
@@ -143,6 +153,53 @@ namespace igcl		// Internet Group-Communication Library
 		std::string toString(const char * sep = "\n");
 	};
 
+	// ======================================================
+	// ============== CONNECTION CACHE CLASS ================
+	// ======================================================
+
+	// thread safe table that remembers how each pair of peer addresses last managed to connect,
+	// so that reconnections and repeated runs can skip connection methods that are known to fail
+	class ConnectionCache
+	{
+		typedef std::pair<std::string, std::string> key_type;
+
+		struct outcome
+		{
+			connection_type type;
+			std::time_t triedAt;		// when this type was last actually tried (not just hinted)
+		};
+
+		static const long SAVE_DELAY_MS = 1000;		// reports arriving close together are saved in one write
+		static const long RELAYED_RETRY_SECONDS = 600;	// after this, a relayed pair is tried directly again
+
+	private:
+		std::map<key_type, outcome> outcomes;
+		std::string filepath;
+		bool dirty = false, stopping = false;
+		std::mutex mutex;
+		std::condition_variable condVar;
+		std::thread * saverThread = NULL;
+
+	public:
+		~ConnectionCache();
+
+		connection_type get(const address & addr1, const address & addr2);
+		void set(const address & addr1, const address & addr2, connection_type type);
+
+		inline uint size()
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+			return outcomes.size();
+		}
+
+		bool setFile(const std::string & filepath);		// loads the file (if it exists) and keeps it updated
+
+	private:
+		void saverLoop();
+		static bool saveToFile(const std::string & filepath, const std::map<key_type, outcome> & outcomes);
+		static key_type makeKey(const address & addr1, const address & addr2);
+	};
+
 	// ======================================================
 	// ============= SOCKET DESCRIPTORS CLASS ===============
 	// ======================================================
@@ -225,26 +282,118 @@ namespace igcl		// Internet Group-Communication Library
 	// ================= BUFFERING CLASS ====================
 	// ======================================================
 
+	/*
+	 * Splits "size" elements in jobs of "blockSize" and keeps up to "bufferingDepth" of them queued at each peer,
+	 * which returns their results in order.
+	 * Stragglers can be worked around in two ways, both off by default:
+	 *  - a job timeout: a job that has been in flight for longer is sent again to the next peer that asks for work
+	 *    (see checkTimeouts), as one copy more than speculation allows, in place of the one that expired;
+	 *  - speculation: when no new jobs are left, a peer that runs out of work gets a copy of the oldest job still
+	 *    in flight elsewhere (each job being in at most "maxCopies" peers at once).
+	 * The first result of a job wins, and completeJob tells the caller to discard the others.
+	 * The time each peer takes can also be measured to adapt, per peer, the depth (enough jobs to cover its round
+	 * trip) and the size of new jobs (guided self-scheduling: a share of the remaining elements that shrinks as the
+	 * end nears, and follows the speed of the peer).
+	 */
 	class NBuffering
 	{
-		uint nJobs, blockSize, nSentJobs, nCompletedJobs;
+		typedef std::chrono::steady_clock clock;
+
+		static constexpr double RATE_SMOOTHING = 0.25;		// weight of each new sample of a peer's speed
+		static const uint GUIDED_FACTOR = 2;					// new jobs get 1/GUIDED_FACTOR of a peer's share of the rest
+
+		struct JobState
+		{
+			uint index, nElements;
+			bool done;
+			uint nCopies;					// peers that currently have it
+			clock::time_point lastSent;
+
+			JobState(uint index, uint nElements) : index(index), nElements(nElements), done(false), nCopies(0) {}
+		};
+
+		struct SentJob
+		{
+			uint job;
+			bool isCopy;					// (not the first time it was sent)
+			clock::time_point time;
+		};
+
+		struct SendRecord
+		{
+			uint job;
+			clock::time_point time;
+		};
+
+		struct PeerStats
+		{
+			uint nLateResults;				// results of jobs that another peer had already completed
+			uint nExpiredJobs;				// jobs that exceeded the timeout at this peer
+
+			// measured speed (adaptive mode)
+			uint depth;
+			double msPerElement;			// (0 while unknown)
+			double minRoundTripMs;
+			clock::time_point lastCompletion;
+
+			PeerStats() : nLateResults(0), nExpiredJobs(0), depth(0), msPerElement(0), minRoundTripMs(-1) {}
+		};
+
+		uint size, blockSize, nextIndex, nCompletedElements;
 
 		uint bufferingDepth;
-		std::map< peer_id, std::queue<uint> > sentJobs;
-		std::function<void (peer_id, uint)> sendJob;
+		std::map< peer_id, std::deque<SentJob> > sentJobs;
+		std::function<void (peer_id, uint, uint)> sendJob;
 		std::queue<uint> jobsToRetry;
 
+		std::vector<JobState> jobs;
+		std::deque<SendRecord> sendOrder;		// in-flight jobs, oldest first
+		uint timeoutMs, maxCopies;
+		uint maxDepth, minBlockSize;			// (0 when not adaptive)
+
+		std::map<peer_id, PeerStats> peerStats;
+		uint nCopiesSent, nCopiesWasted, nCopyWins, nExpired;
+
 	public:
+		// "sendJob" gets the first element of each job (the job has "blockSize" elements, fewer if it is the last)
 		NBuffering (uint bufferingDepth, uint size, uint blockSize, std::function<void (peer_id, uint)> sendJob)
-			: nJobs(size/blockSize+(size % blockSize ? 1:0)), blockSize(blockSize), nSentJobs(0), nCompletedJobs(0),
-			  bufferingDepth(bufferingDepth), sendJob(sendJob) {}
+			: NBuffering(bufferingDepth, size, blockSize,
+					[sendJob] (peer_id id, uint index, uint) { sendJob(id, index); }) {}
+
+		// "sendJob" gets the first element and the number of elements of each job
+		NBuffering (uint bufferingDepth, uint size, uint blockSize, std::function<void (peer_id, uint, uint)> sendJob)
+			: size(size), blockSize(blockSize), nextIndex(0), nCompletedElements(0),
+			  bufferingDepth(bufferingDepth), sendJob(sendJob), timeoutMs(0), maxCopies(1), maxDepth(0), minBlockSize(0),
+			  nCopiesSent(0), nCopiesWasted(0), nCopyWins(0), nExpired(0) {}
 
 		inline void setBufferingDepth(uint bufferingDepth) {
 			this->bufferingDepth = bufferingDepth;
 		}
 
+		// jobs in flight for longer than "ms" are sent again (0 disables it)
+		inline void setJobTimeout(uint ms) {
+			timeoutMs = ms;
+		}
+
+		// lets idle peers take copies of outstanding jobs, up to "maxCopies" peers per job (1 disables it)
+		inline void setSpeculation(uint maxCopies) {
+			this->maxCopies = std::max(maxCopies, 1u);
+		}
+
+		// adapts the depth of each peer, starting at "bufferingDepth", to the time it takes (0 disables it)
+		inline void setAdaptiveDepth(uint maxDepth) {
+			this->maxDepth = maxDepth;
+		}
+
+		// new jobs get sizes between "minBlockSize" and "blockSize", as fits each peer (0 disables it). the elements
+		// of a job are then only known from sendJob's second argument or from completeJob
+		inline void setGuidedBlocks(uint minBlockSize) {
+			this->minBlockSize = std::min(minBlockSize, blockSize);
+		}
+
 		inline void addPeer(peer_id id) {
-			sentJobs[id] = std::queue<uint>();
+			sentJobs[id] = std::deque<SentJob>();
+			peerStats[id].depth = bufferingDepth;
 		}
 
 		inline void addPeers(const std::vector<peer_id> & peerIds) {
@@ -253,78 +402,291 @@ namespace igcl		// Internet Group-Communication Library
 			}
 		}
 
-		inline void removePeer(peer_id id) {
-			auto & q = sentJobs[id];
-			uint size = q.size();
-			nSentJobs -= size;
-
-			while (!q.empty()) {
-				jobsToRetry.push(q.front());
-				q.pop();
+		inline std::vector<peer_id> getPeers() {
+			std::vector<peer_id> ids;
+			for (auto & id_queue : sentJobs) {
+				ids.push_back(id_queue.first);
 			}
+			return ids;
 		}
 
-		inline void bufferToAll() {
-			if (allJobsSent())
+		// the jobs of a peer that left are sent to others, unless some other peer has them too
+		inline void removePeer(peer_id id) {
+			auto it = sentJobs.find(id);
+			if (it == sentJobs.end())
 				return;
 
-			std::list<peer_id> available;
-			for (auto & id_queue : sentJobs) {
-				if (id_queue.second.size() < bufferingDepth) {
-					available.push_back(id_queue.first);
+			for (const SentJob & sent : it->second) {
+				JobState & state = jobs[sent.job];
+				--state.nCopies;
+				if (!state.done and state.nCopies == 0) {
+					jobsToRetry.push(sent.job);
 				}
 			}
+			sentJobs.erase(it);
+		}
 
-			while (!available.empty())
-			{
-				std::list<peer_id>::iterator it = available.begin();
-
-				while (it != available.end()) {
-					if (allJobsSent())
-						return;
-
-					auto & q = sentJobs[*it];
-
-					if (q.size() < bufferingDepth) {
-						if (!jobsToRetry.empty()) {
-							uint job = jobsToRetry.front();
-							jobsToRetry.pop();
-							sendJob(*it, job*blockSize);
-							q.push(job);
-						} else {
-							sendJob(*it, nSentJobs*blockSize);
-							q.push(nSentJobs);
-						}
-						++nSentJobs;
-						++it;
-					} else {
-						it = available.erase(it);
+		inline void bufferToAll() {
+			bool sentAny = true;
+			while (sentAny) {
+				sentAny = false;
+				for (auto & id_queue : sentJobs) {
+					if (id_queue.second.size() < depthOf(id_queue.first)) {
+						sentAny = sendNextJob(id_queue.first, id_queue.second) or sentAny;
 					}
 				}
 			}
 		}
 
 		inline void bufferTo(peer_id id) {
-			while (sentJobs[id].size() < bufferingDepth and !allJobsSent()) {
-				sendJob(id, nSentJobs*blockSize);
-				sentJobs[id].push(nSentJobs);
-				++nSentJobs;
+			auto it = sentJobs.find(id);
+			if (it == sentJobs.end())
+				return;
+
+			uint depth = depthOf(id);
+			while (it->second.size() < depth and sendNextJob(id, it->second));
+
+			if (timeoutMs > 0) {
+				checkTimeouts();
+			}
+		}
+
+		// gives expired jobs to peers that ran out of work. it is also done whenever a peer is buffered to,
+		// but if every other peer may be idle it must be called periodically (e.g. by a timer)
+		inline void checkTimeouts() {
+			for (auto & id_queue : sentJobs) {
+				if (id_queue.second.empty()) {
+					sendNextJob(id_queue.first, id_queue.second);
+				}
 			}
 		}
 
+		// pops the oldest job of peer "id" and sets "index" and "nElements" to its elements. returns false if the
+		// job had already been completed by another peer, in which case the result must be discarded (as must those
+		// of removed peers, which have no jobs)
+		inline bool completeJob(peer_id id, uint & index, uint & nElements) {
+			auto it = sentJobs.find(id);
+			if (it == sentJobs.end() or it->second.empty()) {
+				index = nElements = 0;
+				return false;
+			}
+			auto & q = it->second;
+			SentJob sent = q.front();
+			q.pop_front();
+
+			JobState & state = jobs[sent.job];
+			--state.nCopies;
+			index = state.index;
+			nElements = state.nElements;
+
+			if (maxDepth > 0 or minBlockSize > 0) {
+				measure(id, sent, nElements);
+			}
+
+			if (state.done) {
+				++nCopiesWasted;
+				++peerStats[id].nLateResults;
+				return false;
+			}
+			state.done = true;
+			nCompletedElements += nElements;
+			if (sent.isCopy) {
+				++nCopyWins;
+			}
+			return true;
+		}
+
+		inline bool completeJob(peer_id id, uint & index) {
+			uint nElements;
+			return completeJob(id, index, nElements);
+		}
+
 		inline uint completeJob(peer_id id) {
-			uint job = sentJobs[id].front();
-			sentJobs[id].pop();
-			++nCompletedJobs;
-			return job*blockSize;
+			uint index;
+			completeJob(id, index);
+			return index;
 		}
 
 		inline bool allJobsSent() {
-			return nSentJobs >= nJobs;
+			return nextIndex >= size and jobsToRetry.empty();
 		}
 
 		inline bool allJobsCompleted() {
-			return nCompletedJobs >= nJobs;
+			return nCompletedElements >= size;
+		}
+
+		// results still to be received, including those of copies that will be discarded
+		inline uint nPendingResults() {
+			uint n = 0;
+			for (auto & id_queue : sentJobs) {
+				n += id_queue.second.size();
+			}
+			return n;
+		}
+
+		inline uint depthOf(peer_id id) {
+			return (maxDepth > 0 ? peerStats[id].depth : bufferingDepth);
+		}
+
+		std::string statsToString() {
+			std::stringstream ss;
+			ss << "jobs: " << jobs.size() << ", copies sent: " << nCopiesSent << ", won: " << nCopyWins << ", wasted: " << nCopiesWasted;
+			ss << ", expired jobs: " << nExpired;
+			for (auto & id_stats : peerStats) {
+				const PeerStats & stats = id_stats.second;
+				ss << "; peer " << id_stats.first << ": " << stats.nLateResults << " late, " << stats.nExpiredJobs << " expired";
+				if (maxDepth > 0 or minBlockSize > 0) {
+					ss << ", depth " << depthOf(id_stats.first) << ", " << stats.msPerElement << " ms/element, round trip "
+					   << stats.minRoundTripMs << " ms";
+				}
+			}
+			return ss.str();
+		}
+
+	private:
+		inline bool sendNextJob(peer_id id, std::deque<SentJob> & q) {
+			uint job;
+			bool isCopy;
+			if (!nextJobFor(id, q, job, isCopy))
+				return false;
+
+			JobState & state = jobs[job];
+			++state.nCopies;
+			state.lastSent = clock::now();
+			if (timeoutMs > 0 or maxCopies > 1) {
+				sendOrder.push_back({job, state.lastSent});
+			}
+			if (isCopy) {
+				++nCopiesSent;
+			}
+			q.push_back({job, isCopy, state.lastSent});
+			sendJob(id, state.index, state.nElements);
+			return true;
+		}
+
+		// retried jobs first, then expired ones, then new ones and, when there are none left, copies for idle peers
+		inline bool nextJobFor(peer_id id, const std::deque<SentJob> & q, uint & job, bool & isCopy) {
+			while (!jobsToRetry.empty()) {
+				job = jobsToRetry.front();
+				jobsToRetry.pop();
+				if (!jobs[job].done) {
+					isCopy = (jobs[job].nCopies > 0);
+					return true;
+				}
+			}
+
+			// (a record is stale if its job was completed or sent again since, or if it expired with as many copies
+			// in flight as a timeout allows)
+			while (!sendOrder.empty() and (jobs[sendOrder.front().job].done
+					or jobs[sendOrder.front().job].lastSent != sendOrder.front().time
+					or (isExpired(sendOrder.front()) and jobs[sendOrder.front().job].nCopies > maxCopies))) {
+				sendOrder.pop_front();
+			}
+
+			if (timeoutMs > 0 and !sendOrder.empty()) {
+				const SendRecord & oldest = sendOrder.front();
+				if (isExpired(oldest) and !isQueuedAt(q, oldest.job)) {
+					job = oldest.job;
+					isCopy = true;
+					sendOrder.pop_front();
+					++nExpired;
+					for (auto & id_queue : sentJobs) {
+						if (isQueuedAt(id_queue.second, job)) {
+							++peerStats[id_queue.first].nExpiredJobs;
+						}
+					}
+					return true;
+				}
+			}
+
+			if (nextIndex < size) {
+				uint nElements = std::min(blockSizeFor(id), size - nextIndex);
+				job = jobs.size();
+				jobs.push_back(JobState(nextIndex, nElements));
+				nextIndex += nElements;
+				isCopy = false;
+				return true;
+			}
+
+			if (maxCopies > 1 and q.empty()) {
+				for (const SendRecord & record : sendOrder) {
+					const JobState & state = jobs[record.job];
+					if (!state.done and state.nCopies < maxCopies and state.lastSent == record.time) {
+						job = record.job;
+						isCopy = true;
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		inline bool isExpired(const SendRecord & record) {
+			return timeoutMs > 0 and clock::now() - record.time > std::chrono::milliseconds(timeoutMs);
+		}
+
+		static inline bool isQueuedAt(const std::deque<SentJob> & q, uint job) {
+			for (const SentJob & sent : q) {
+				if (sent.job == job)
+					return true;
+			}
+			return false;
+		}
+
+		// ------------------------------------------------------
+		// Adaptive mode
+		// ------------------------------------------------------
+
+		// updates the speed of a peer with the job it just returned
+		inline void measure(peer_id id, const SentJob & sent, uint nElements) {
+			PeerStats & stats = peerStats[id];
+			clock::time_point now = clock::now();
+
+			// the peer worked on this job since it got it or since it returned the previous one, whatever came last
+			clock::time_point start = std::max(sent.time, stats.lastCompletion);
+			double serviceMs = std::chrono::duration<double, std::milli>(now - start).count();
+			double roundTripMs = std::chrono::duration<double, std::milli>(now - sent.time).count();
+			stats.lastCompletion = now;
+
+			if (nElements == 0)
+				return;
+			double sample = serviceMs / nElements;
+			stats.msPerElement = (stats.msPerElement > 0 ? (1-RATE_SMOOTHING) * stats.msPerElement + RATE_SMOOTHING * sample : sample);
+			if (stats.minRoundTripMs < 0 or roundTripMs < stats.minRoundTripMs) {
+				stats.minRoundTripMs = roundTripMs;
+			}
+
+			if (maxDepth > 0) {
+				// enough jobs to keep it busy while results and new jobs are on their way (and one more being worked on)
+				double jobMs = std::max(stats.msPerElement * blockSizeFor(id), 0.001);
+				double latencyMs = std::max(stats.minRoundTripMs - stats.msPerElement * nElements, 0.0);
+				uint depth = 1 + (uint) std::ceil(latencyMs / jobMs);
+				stats.depth = std::max(1u, std::min(depth, maxDepth));
+			}
+		}
+
+		// the size of new jobs: the peer's share of the remaining elements (by its speed) split in its depth
+		inline uint blockSizeFor(peer_id id) {
+			if (minBlockSize == 0)
+				return blockSize;
+
+			// (peers not yet measured count as the average of the others)
+			double sumSpeed = 0, ownSpeed = 0;
+			uint nMeasured = 0;
+			for (auto & id_queue : sentJobs) {
+				const PeerStats & stats = peerStats[id_queue.first];
+				if (stats.msPerElement > 0) {
+					sumSpeed += 1 / stats.msPerElement;
+					++nMeasured;
+				}
+			}
+			double averageSpeed = (nMeasured > 0 ? sumSpeed / nMeasured : 1);
+			sumSpeed += averageSpeed * (sentJobs.size() - nMeasured);
+			ownSpeed = (peerStats[id].msPerElement > 0 ? 1 / peerStats[id].msPerElement : averageSpeed);
+
+			double share = (size - nextIndex) * ownSpeed / sumSpeed;
+			uint nElements = (uint) std::ceil(share / (GUIDED_FACTOR * depthOf(id)));
+			return std::max(minBlockSize, std::min(nElements, blockSize));
 		}
 	};
 
@@ -346,7 +708,7 @@ namespace igcl		// Internet Group-Communication Library
 
 		virtual void cbStart() {}
 		virtual void cbTerminate() {}
-		virtual void cbNewPeerReady(peer_id id) {}
+		virtual void cbNewPeerReady(peer_id) {}
 
 	private:
 		// private -> only the Coordinator (friend class) can set itself as owner
@@ -8,6 +8,11 @@
 #define FORCE_LIBNICE
 //#define FORCE_RELAYED
 //#define USE_SEND_QUEUE
+//#define DISABLE_SHARED_MEMORY
+//#define DISABLE_UDP
+//#define PREFER_UDP
+//#define UDP_EMULATION 0.01, 50, 10		// loss rate, delay and jitter (ms) of an emulated link, for testing
+//#define COMPRESSION_THRESHOLD 65536		// compress messages of at least this many bytes sent through the network
 
 #define QUIT_IF_UNSUCCESSFUL(res) if ((res) != igcl::SUCCESS) return (res);
 #define QUIT_IF_FAILURE(res) if ((res) == igcl::FAILURE) return (res);
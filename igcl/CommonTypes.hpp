@@ -18,6 +18,8 @@ namespace igcl		// Internet Group-Communication Library
 	typedef char result_type;
 	typedef uint size_type;
 	typedef char descriptor_type;
+	typedef char connection_type;
+	typedef unsigned char lane_type;
 
 	// ======================================================
 	// ==================== CONSTANTS =======================
@@ -26,6 +28,26 @@ namespace igcl		// Internet Group-Communication Library
 	const descriptor_type DESCRIPTOR_NONE = 0;
 	const descriptor_type DESCRIPTOR_SOCK = 1;
 	const descriptor_type DESCRIPTOR_NICE = 2;
+	const descriptor_type DESCRIPTOR_SHM = 3;
+	const descriptor_type DESCRIPTOR_UDP = 4;
+
+	// ways by which a pair of peers managed to connect (kept in the coordinator's connection cache)
+	const connection_type CONNECTION_UNKNOWN = 0;
+	const connection_type CONNECTION_LOCAL_IP = 1;
+	const connection_type CONNECTION_PUBLIC_IP = 2;
+	const connection_type CONNECTION_NICE = 3;
+	const connection_type CONNECTION_RELAYED = 4;
+	const connection_type CONNECTION_SHARED_MEMORY = 5;
+	const connection_type CONNECTION_IN_PROCESS = 6;
+	const connection_type CONNECTION_UDP = 7;
+
+	// transport offers (never valid shared memory names)
+	const char * const IN_PROCESS_OFFER = "@in-process";
+	const char * const UDP_OFFER = "@udp";
+
+	// lanes of a link. small urgent messages travel apart from bulk data, so they do not wait behind it
+	const lane_type DATA_LANE = 0;
+	const lane_type CONTROL_LANE = 1;
 
 	const size_type SIZE_TYPE_MAX = UINT_MAX;
 
@@ -34,18 +56,21 @@ namespace igcl		// Internet Group-Communication Library
 	const result_type NOTHING = 2;
 
 	//const peer_id SEND_TO_ALL_FILTER = 0;
+	const peer_id INVALID_PEER_ID = -1;		// (of descriptors that belong to no known peer)
 
 	// possible message types (headers)
 	const msg_type NONE = 0;
 	const msg_type REGISTER = 1;
 	const msg_type DEREGISTER = 2;
 	const msg_type DEREGISTER_PEER = 3;
+	const msg_type REGISTER_CONTROL_LANE = 4;
 	// peer to coordinator:
 	const msg_type REQUEST_PEER_CREDENTIALS = 101;
 	const msg_type PROVIDE_PEER_CREDENTIALS = 102;
 	const msg_type REQUEST_NICE_PEER_CREDENTIALS = 103;
 	const msg_type PROVIDE_NICE_PEER_CREDENTIALS = 104;
 	const msg_type SET_RELAYED_CONNECTION = 109;
+	const msg_type REPORT_CONNECTION_TYPE = 110;
 	// coordinator to peers:
 	const msg_type GET_PEER_CREDENTIALS = 105;
 	const msg_type GIVE_PEER_CREDENTIALS = 106;
@@ -59,6 +84,16 @@ namespace igcl		// Internet Group-Communication Library
 	const msg_type SEND_TO_PEER = 34;
 	const msg_type SEND_TO_PEER_RELAYED = 35;
 	const msg_type SEND_TO_ALL_RELAYED = 36;
+	const msg_type STREAM_CHUNK = 37;
+	const msg_type STREAM_CREDIT = 38;
+	const msg_type SEND_TO_PEER_COMPRESSED = 39;
+	const msg_type STREAM_CHUNK_COMPRESSED = 40;
+	const msg_type WORK_STEAL = 41;
+	const msg_type WORK_GIVEN = 42;
+	const msg_type WORK_DONE = 43;
+	const msg_type WORK_FINISHED = 44;
+	const msg_type BOUND_UPDATE = 45;
+	const msg_type MIGRANTS = 46;
 }
 
 
@@ -58,19 +58,6 @@ namespace igcl
 		return send_(socketfd, value.c_str(), value.length());	// send value as char[] with a certain size
 	}
 
-
-#ifdef GMP
-	// sends an mpz_class value
-	result_type Communication::send_(int socketfd, const mpz_class & value)
-	{
-		size_t size = mpz_sizeinbase(value.get_mpz_t(), 10) + 2;
-		char str[size];
-		mpz_get_str(str, 10, value.get_mpz_t());
-		//std::cout << "sending " << size << " bytes" << std::endl;
-		return send_(socketfd, str, size);	// send value as char[] with a certain size
-	}
-#endif
-
 	//--------------------------------------------------
 	// Receive methods
 	//--------------------------------------------------
@@ -100,28 +87,6 @@ namespace igcl
 		return res;
 	}
 
-
-#ifdef GMP
-	// receives an mpz_class value
-	result_type Communication::recv_(int socketfd, flag_type flags, mpz_class & value)
-	{
-		size_type nBytes;
-		result_type res;
-
-		res = recv_size_(socketfd, flags, nBytes);
-		QUIT_IF_UNSUCCESSFUL(res);
-
-		char data[nBytes];
-		res = recv_all_(socketfd, 0, data, nBytes);
-		QUIT_IF_UNSUCCESSFUL(res);
-		//std::cout << "receiving " << nBytes << " bytes" << std::endl;
-
-		value.set_str(data, 10);
-
-		return SUCCESS;
-	}
-#endif
-
 	//--------------------------------------------------
 	//
 	//--------------------------------------------------
@@ -5,6 +5,9 @@
 #include "Debug.hpp"
 #include "BlockingQueue.hpp"
 #include "LibniceHelper.hpp"
+#include "SharedMemoryHelper.hpp"
+#include "UdpHelper.hpp"
+#include "Serialization.hpp"
 
 #include <string>
 #include <cassert>
@@ -12,10 +15,6 @@
 #include <thread>
 #include <sys/socket.h>
 
-#ifdef GMP
-#include <gmpxx.h>
-#endif
-
 
 namespace igcl
 {
@@ -49,6 +48,12 @@ namespace igcl
 #ifndef DISABLE_LIBNICE
 		LibniceHelper nice;
 #endif
+#ifndef DISABLE_SHARED_MEMORY
+		SharedMemoryHelper shm;
+#endif
+#ifndef DISABLE_UDP
+		UdpHelper udp;
+#endif
 
 	private:
 		Stats stats;
@@ -77,11 +82,6 @@ namespace igcl
 		result_type recv_type_(int fd, flag_type flags, msg_type & type);
 		result_type recv_(int socketfd, flag_type flags, std::string & value);
 
-#ifdef GMP
-		result_type send_(int socketfd, const mpz_class & value);
-		result_type recv_(int socketfd, flag_type flags, mpz_class & value);
-#endif
-
 	public:
 		Stats getStats() { return stats; }
 
@@ -110,11 +110,12 @@ namespace igcl
 		}
 
 
-		// sends a (non-pointer) value
+		// sends a (non-pointer) value. trivially-copyable values are sent as T[] of size 1, others are serialized
 		template<typename T>
 		result_type send_(int socketfd, const T & value)
 		{
-			return send_(socketfd, &value, 1);	// send value as T[] of size 1
+			Encoded<T> encoded(value);
+			return send_(socketfd, encoded.data(), encoded.size());
 		}
 
 		// ------------------------------------------------------
@@ -154,12 +155,18 @@ namespace igcl
 			res = recv_size_(socketfd, flags, nBytes);
 			QUIT_IF_UNSUCCESSFUL(res);
 			//std::cout << "receiving " << nBytes << " bytes" << std::endl;
-			if (nBytes != sizeof(value))
-				return FAILURE;
 
-			res = recv_all_(socketfd, 0, &value, nBytes);
+			if (IsTriviallySerializable<T>::value) {
+				if (nBytes != sizeof(value))
+					return FAILURE;
+				return recv_all_(socketfd, 0, (void *) &value, nBytes);
+			}
 
-			return res;
+			std::vector<char> bytes(nBytes);
+			res = recv_all_(socketfd, 0, bytes.data(), nBytes);
+			QUIT_IF_UNSUCCESSFUL(res);
+
+			return (Encoded<T>::decode(bytes.data(), nBytes, value) ? SUCCESS : FAILURE);
 		}
 
 		// ------------------------------------------------------
@@ -303,12 +310,13 @@ namespace igcl
 		}
 
 
-		// sends a (non-pointer) value
+		// sends a (non-pointer) value (serialized if it is not trivially copyable)
 		template<typename T>
 		result_type nice_send_(uint streamId, const T & value)
 		{
 			static_assert(!std::is_pointer<T>::value, "T must be non-pointer");
-			return nice_send_(streamId, &value, 1);	// send value as T[] of size 1
+			Encoded<T> encoded(value);
+			return nice_send_(streamId, encoded.data(), encoded.size());
 		}
 
 
@@ -333,28 +341,110 @@ namespace igcl
 		}
 
 
-		// sends data until "nBytes" have been sent
+		// hands "nBytes" to the stream, which sends later what cannot be sent now
 		inline result_type nice_send_all_(uint streamId, const void * data, size_type nBytes)
 		{
-			uint totalBytesSent = 0;
-			//std::cout << "total to send: " << nBytes << std::endl;
-			while (totalBytesSent < nBytes)
-			{
-				nice.waitWritable(streamId);
-				int bytesSent = nice.send(streamId, ((char *)data)+totalBytesSent, nBytes-totalBytesSent);
-				//std::cout << "nBytes sent: " << bytesSent << std::endl;
-				if (bytesSent < 0) {
-					if (errno != 0 and errno != 92) {
-						std::cout << "fail with errno == " << errno << std::endl;
-						//return FAIL;
-					}
-				} else {
-					totalBytesSent += bytesSent;
-				}
-			}
 			//stats.incNSends(1);
 			//stats.incNBytesSent(bytesSentTotal);
-			return SUCCESS;
+			return (nice.send(streamId, (const char *) data, nBytes) ? SUCCESS : FAILURE);
+		}
+#endif
+
+#ifndef DISABLE_SHARED_MEMORY
+		// ------------------------------------------------------
+		// Internal shared memory send and recv methods
+		// ------------------------------------------------------
+
+	protected:
+		// sends an array of data of size "size" as a single message of type "type"
+		template<typename T>
+		result_type shm_send_(int channelId, msg_type type, const T * data, uint size)
+		{
+			assert(size*sizeof(T) <= SIZE_TYPE_MAX);
+			size_type nBytes = size*sizeof(T);
+			dbg("sending", nBytes, "bytes");
+			return shm.send(channelId, type, data, nBytes);
+		}
+
+
+		// sends a (non-pointer) value (serialized if it is not trivially copyable)
+		template<typename T>
+		result_type shm_send_(int channelId, msg_type type, const T & value)
+		{
+			static_assert(!std::is_pointer<T>::value, "T must be non-pointer");
+			Encoded<T> encoded(value);
+			return shm_send_(channelId, type, encoded.data(), encoded.size());
+		}
+
+
+		// sends a std::string
+		result_type shm_send_(int channelId, msg_type type, const std::string & value)
+		{
+			return shm_send_(channelId, type, value.c_str(), value.length());
+		}
+
+
+		// receives the message type. returns NOTHING if no message arrives for a while
+		result_type shm_recv_type_(int channelId, msg_type & type)
+		{
+			return shm.recv(channelId, &type, sizeof(type), true);
+		}
+
+
+		// receives to new array of size "size" (array is allocated with malloc)
+		template<typename T>
+		result_type shm_recv_new_(int channelId, T * & data, uint & size)
+		{
+			size_type nBytes;
+			result_type res;
+
+			res = shm.recv(channelId, &nBytes, sizeof(nBytes), false);
+			QUIT_IF_UNSUCCESSFUL(res);
+
+			size = nBytes / sizeof(T);
+			data = (T *) malloc(nBytes);
+
+			return shm.recv(channelId, data, nBytes, false);
+		}
+#endif
+
+#ifndef DISABLE_UDP
+		// ------------------------------------------------------
+		// Internal udp send and recv methods
+		// ------------------------------------------------------
+
+	protected:
+		// sends an array of data of size "size" as a single message of type "type". each lane is a separate udp stream
+		template<typename T>
+		result_type udp_send_(int channelId, lane_type lane, msg_type type, const T * data, uint size)
+		{
+			assert(size*sizeof(T) <= SIZE_TYPE_MAX);
+			size_type nBytes = size*sizeof(T);
+			dbg("sending", nBytes, "bytes");
+			return udp.send(channelId, lane, type, data, nBytes);
+		}
+
+
+		// sends a (non-pointer) value (serialized if it is not trivially copyable)
+		template<typename T>
+		result_type udp_send_(int channelId, lane_type lane, msg_type type, const T & value)
+		{
+			static_assert(!std::is_pointer<T>::value, "T must be non-pointer");
+			Encoded<T> encoded(value);
+			return udp_send_(channelId, lane, type, encoded.data(), encoded.size());
+		}
+
+
+		// sends a std::string
+		result_type udp_send_(int channelId, lane_type lane, msg_type type, const std::string & value)
+		{
+			return udp_send_(channelId, lane, type, value.c_str(), value.length());
+		}
+
+		// receives a whole message (its data is allocated with malloc). returns NOTHING if no message arrives for a while
+		result_type udp_recv_(int channelId, msg_type & type, char * & data, size_type & size)
+		{
+			return udp.recv(channelId, type, data, size, true);
 		}
 #endif
 
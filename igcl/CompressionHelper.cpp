@@ -0,0 +1,313 @@
+#include "CompressionHelper.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+
+namespace igcl		// Internet Group-Communication Library
+{
+	typedef std::chrono::steady_clock clock;
+
+	static inline uint32_t read32(const uint8_t * p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+
+	static inline uint64_t read64(const uint8_t * p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+
+	static inline uint32_t hashOf(uint32_t sequence, uint hashLog)
+	{
+		return (sequence * 2654435761U) >> (32 - hashLog);
+	}
+
+
+	// writes the part of a length that does not fit in the token's 4 bits
+	static inline uint8_t * writeLength(uint8_t * op, size_type length)
+	{
+		for (; length >= 255; length -= 255) {
+			*op++ = 255;
+		}
+		*op++ = (uint8_t) length;
+		return op;
+	}
+
+	// ------------------------------------------------------
+	// Constructor
+	// ------------------------------------------------------
+
+	CompressionHelper::CompressionHelper()
+		: nCompressed(0), nNotCompressed(0), nDecompressed(0), nBytesIn(0), nBytesOut(0), compressNs(0), decompressNs(0)
+	{
+	}
+
+	// ------------------------------------------------------
+	// Message payloads
+	// ------------------------------------------------------
+
+	// compresses "data" into a new buffer (allocated with malloc) prefixed by the original size.
+	// returns false (and allocates nothing) if the payload does not shrink
+	bool CompressionHelper::pack(const void * data, size_type nBytes, char * & packed, size_type & packedBytes)
+	{
+		if (nBytes <= sizeof(size_type) + MATCH_FIND_LIMIT) {
+			nNotCompressed++;
+			return false;
+		}
+
+		clock::time_point start = clock::now();
+
+		size_type capacity = nBytes - sizeof(size_type) - 1;		// the packed payload must be smaller than the original
+		packed = (char *) malloc(sizeof(size_type) + capacity);
+		size_type n = compress((const char *) data, nBytes, packed + sizeof(size_type), capacity);
+
+		compressNs += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+		if (n == 0) {
+			free(packed);
+			packed = NULL;
+			nNotCompressed++;
+			return false;
+		}
+
+		memcpy(packed, &nBytes, sizeof(size_type));
+		packedBytes = sizeof(size_type) + n;
+		nCompressed++;
+		nBytesIn += nBytes;
+		nBytesOut += packedBytes;
+		return true;
+	}
+
+
+	// restores a payload made by "pack" into a new buffer (allocated with malloc)
+	bool CompressionHelper::unpack(const char * packed, size_type packedBytes, char * & data, size_type & nBytes)
+	{
+		if (packedBytes < sizeof(size_type))
+			return false;
+
+		clock::time_point start = clock::now();
+
+		memcpy(&nBytes, packed, sizeof(size_type));
+		data = (char *) malloc(nBytes);
+		bool ok = decompress(packed + sizeof(size_type), packedBytes - sizeof(size_type), data, nBytes);
+
+		decompressNs += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+		nDecompressed++;
+
+		if (!ok) {
+			free(data);
+			data = NULL;
+		}
+		return ok;
+	}
+
+
+	std::string CompressionHelper::statsToString()
+	{
+		double ratio = (nBytesOut > 0 ? (double) nBytesIn / nBytesOut : 0);
+		double compressMBs = (compressNs > 0 ? nBytesIn * 1e3 / compressNs : 0);
+
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(2);
+		ss << "compressed: " << nCompressed << " (" << nBytesIn << " -> " << nBytesOut << " bytes, ratio " << ratio << ")";
+		ss << ", not compressible: " << nNotCompressed;
+		ss << ", compression time: " << compressNs / 1000000.0 << " ms (" << compressMBs << " MB/s)";
+		ss << ", decompressed: " << nDecompressed << " in " << decompressNs / 1000000.0 << " ms";
+		return ss.str();
+	}
+
+	// ------------------------------------------------------
+	// Codec
+	// ------------------------------------------------------
+
+	size_type CompressionHelper::maxCompressedSize(size_type nBytes)
+	{
+		return nBytes + nBytes/255 + 16;
+	}
+
+
+	// compresses "nBytes" from "src" into "dst". returns the compressed size, or 0 if it exceeds "capacity"
+	size_type CompressionHelper::compress(const char * src, size_type nBytes, char * dst, size_type capacity)
+	{
+		const uint8_t * const base = (const uint8_t *) src;
+		const uint8_t * const iend = base + nBytes;
+		const uint8_t * const mflimit = iend - MATCH_FIND_LIMIT;
+		const uint8_t * const matchlimit = iend - LAST_LITERALS;
+		const uint8_t * ip = base;
+		const uint8_t * anchor = base;
+		uint8_t * op = (uint8_t *) dst;
+		uint8_t * const oend = op + capacity;
+
+		if (nBytes > MATCH_FIND_LIMIT)
+		{
+			std::vector<uint32_t> table(1 << HASH_LOG, 0);		// last position of each hashed sequence
+			uint nAttempts = 1 << SKIP_TRIGGER;
+
+			while (ip < mflimit)
+			{
+				uint32_t sequence = read32(ip);
+				uint32_t h = hashOf(sequence, HASH_LOG);
+				const uint8_t * ref = base + table[h];
+				table[h] = ip - base;
+
+				if (ref >= ip or ip - ref > MAX_OFFSET or read32(ref) != sequence) {
+					ip += (nAttempts++ >> SKIP_TRIGGER);
+					continue;
+				}
+
+				nAttempts = 1 << SKIP_TRIGGER;
+				while (ip > anchor and ref > base and ip[-1] == ref[-1]) {		// extend the match backwards
+					ip--;
+					ref--;
+				}
+
+				// literals
+				size_type literals = ip - anchor;
+				if (op + 1 + literals + literals/255 + 2 + LAST_LITERALS > oend)
+					return 0;
+				uint8_t * token = op++;
+				if (literals >= 15) {
+					*token = 15 << 4;
+					op = writeLength(op, literals - 15);
+				} else {
+					*token = literals << 4;
+				}
+				memcpy(op, anchor, literals);
+				op += literals;
+
+				// match
+				uint16_t offset = ip - ref;
+				memcpy(op, &offset, sizeof(offset));		// (little-endian, as the block format wants)
+				op += sizeof(offset);
+
+				const uint8_t * matchStart = ip;
+				ip += MIN_MATCH;
+				ref += MIN_MATCH;
+				while (ip + 8 <= matchlimit) {
+					uint64_t diff = read64(ip) ^ read64(ref);
+					if (diff != 0) {
+						ip += __builtin_ctzll(diff) >> 3;
+						goto matchEnd;
+					}
+					ip += 8;
+					ref += 8;
+				}
+				while (ip < matchlimit and *ip == *ref) {
+					ip++;
+					ref++;
+				}
+			matchEnd:
+				size_type matchLength = ip - matchStart - MIN_MATCH;
+				if (op + matchLength/255 + 1 + LAST_LITERALS > oend)
+					return 0;
+				if (matchLength >= 15) {
+					*token |= 15;
+					op = writeLength(op, matchLength - 15);
+				} else {
+					*token |= matchLength;
+				}
+
+				anchor = ip;
+				if (ip < mflimit) {
+					table[hashOf(read32(ip-2), HASH_LOG)] = ip - 2 - base;
+				}
+			}
+		}
+
+		// last literals
+		size_type literals = iend - anchor;
+		if (op + 1 + literals + literals/255 + 1 > oend)
+			return 0;
+		if (literals >= 15) {
+			*op++ = 15 << 4;
+			op = writeLength(op, literals - 15);
+		} else {
+			*op++ = literals << 4;
+		}
+		memcpy(op, anchor, literals);
+		op += literals;
+
+		return op - (uint8_t *) dst;
+	}
+
+
+	// decompresses a block that must expand to exactly "originalBytes". rejects malformed blocks
+	bool CompressionHelper::decompress(const char * src, size_type nBytes, char * dst, size_type originalBytes)
+	{
+		const uint8_t * ip = (const uint8_t *) src;
+		const uint8_t * const iend = ip + nBytes;
+		uint8_t * op = (uint8_t *) dst;
+		uint8_t * const ostart = op;
+		uint8_t * const oend = op + originalBytes;
+
+		while (ip < iend)
+		{
+			uint8_t token = *ip++;
+
+			size_type literals = token >> 4;
+			if (literals == 15) {
+				uint8_t b;
+				do {
+					if (ip >= iend)
+						return false;
+					b = *ip++;
+					literals += b;
+				} while (b == 255);
+			}
+			if (literals > (size_type) (iend - ip) or literals > (size_type) (oend - op))
+				return false;
+			memcpy(op, ip, literals);
+			op += literals;
+			ip += literals;
+
+			if (ip >= iend)		// the last sequence has no match
+				break;
+
+			if (iend - ip < 2)
+				return false;
+			uint16_t offset;
+			memcpy(&offset, ip, sizeof(offset));
+			ip += sizeof(offset);
+			if (offset == 0 or offset > op - ostart)
+				return false;
+
+			size_type matchLength = token & 15;
+			if (matchLength == 15) {
+				uint8_t b;
+				do {
+					if (ip >= iend)
+						return false;
+					b = *ip++;
+					matchLength += b;
+				} while (b == 255);
+			}
+			matchLength += MIN_MATCH;
+			if (matchLength > (size_type) (oend - op))
+				return false;
+
+			// the match may overlap the bytes it produces (it then repeats the last "offset" bytes). copying
+			// from its start in steps of everything written since keeps every copy free of overlap
+			const uint8_t * match = op - offset;
+			while (matchLength > 0) {
+				size_type n = std::min((size_type) (op - match), matchLength);
+				memcpy(op, match, n);
+				op += n;
+				matchLength -= n;
+			}
+		}
+
+		return op == oend;
+	}
+}
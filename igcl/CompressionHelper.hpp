@@ -0,0 +1,57 @@
+#ifndef COMPRESSIONHELPER_HPP_
+#define COMPRESSIONHELPER_HPP_
+
+#include "CommonTypes.hpp"
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+
+namespace igcl
+{
+	/*
+	 * Fast LZ77 codec (LZ4's block format) for message payloads. Compressed messages carry their original size
+	 * in front of the compressed block. Payloads that would not shrink are left alone, so enabling compression
+	 * costs little more than a failed attempt on data that does not compress. Every node can decompress, so
+	 * each sender decides by itself whether to compress.
+	 */
+	class CompressionHelper
+	{
+		// ======================================================
+		// ==================== DEFINITIONS =====================
+		// ======================================================
+
+		static const uint HASH_LOG = 14;
+		static const uint MIN_MATCH = 4;
+		static const uint MAX_OFFSET = 65535;
+		static const uint LAST_LITERALS = 5;		// the block always ends with this many literals
+		static const uint MATCH_FIND_LIMIT = 12;	// (and no match starts this close to its end)
+		static const uint SKIP_TRIGGER = 6;			// the search step grows by 1 every 2^SKIP_TRIGGER failed attempts
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
+	private:
+		std::atomic<ulong> nCompressed, nNotCompressed, nDecompressed;
+		std::atomic<ulong> nBytesIn, nBytesOut;
+		std::atomic<ulong> compressNs, decompressNs;
+
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
+	public:
+		CompressionHelper();
+
+		bool pack(const void * data, size_type nBytes, char * & packed, size_type & packedBytes);
+		bool unpack(const char * packed, size_type packedBytes, char * & data, size_type & nBytes);
+
+		std::string statsToString();
+
+		static size_type maxCompressedSize(size_type nBytes);
+		static size_type compress(const char * src, size_type nBytes, char * dst, size_type capacity);
+		static bool decompress(const char * src, size_type nBytes, char * dst, size_type originalBytes);
+	};
+}
+
+#endif /* COMPRESSIONHELPER_HPP_ */
@@ -10,6 +10,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 
 
 namespace igcl
@@ -64,6 +65,15 @@ namespace igcl
 	}
 
 
+	// keeps the outcome of every connection attempt in a file, so that subsequent runs can reuse them
+	void Coordinator::setConnectionCacheFile(const std::string & filepath)
+	{
+		if (connectionCache.setFile(filepath)) {
+			std::cout << "loaded " << connectionCache.size() << " cached connection outcomes" << std::endl;
+		}
+	}
+
+
 	uint Coordinator::getNPeers()
 	{
 		return layout.size();
@@ -101,7 +111,7 @@ namespace igcl
 		for (descriptor_pair desc : knownPeers.getAllDescriptors())	// ask every peer to shutdown
 		{
 			if (desc.type == DESCRIPTOR_SOCK) {
-				send_type_(desc.desc, SHUTDOWN);
+				sendControlType(desc, SHUTDOWN);
 			} else {
 				// it never happens in the coordinator :)
 			}
@@ -119,8 +129,22 @@ namespace igcl
 		result_type res;
 		int sourceFd = sourceDesc.desc;
 
+		int sourcePort, sourcePid;
+		std::string sourceHostKey;
+		res = recv_(sourceFd, 0, sourcePort);		// receive listening port of peer
+		res = recv_(sourceFd, 0, sourceHostKey);
+		res = recv_(sourceFd, 0, sourcePid);
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
+
+		sockaddr addr;
+		socklen_t addrlen = sizeof(addr);
+		int rc = getpeername(sourceFd, &addr, &addrlen);
+		assert(rc == 0);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(sourceDesc));		// (others may send to it once it is known)
 		peer_id id = currentId++;
 		knownPeers.registerPeer(descriptor_pair(sourceFd, DESCRIPTOR_SOCK), id);
+		peerAddresses[id].set(inet_ntoa((*(sockaddr_in*)&addr).sin_addr), sourcePort);
 		res = send_(sourceFd, id);	// respond with id
 		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 
@@ -163,6 +187,22 @@ namespace igcl
 		res = send_(sourceFd, &connectable[0], connectable.size());
 		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 
+		std::vector<connection_type> hints;		// how each connectable peer was last reached from this address
+		for (peer_id targetId : connectable) {
+			hints.push_back(connectionCache.get(peerAddresses[id], peerAddresses[targetId]));
+		}
+		res = send_(sourceFd, &hints[0], hints.size());
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
+
+		bool inProcess = (sourceHostKey == getHostKey() and sourcePid == getpid());
+		std::shared_ptr<LocalLink> sourceNode = (inProcess ? findLocalNode(sourcePort) : NULL);
+		if (sourceNode != NULL) {
+			TEST() std::cout << "peer " << id << " is in the same process. using in-process transport" << std::endl;
+			setInProcessPeer(sourceDesc, sourceNode);
+		}
+		res = send_(sourceFd, (sourceNode != NULL));
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
+
 		return res;
 	}
 
@@ -191,6 +231,7 @@ namespace igcl
 			TEST() std::cout << "requested ID is registered. proceeding" << std::endl;
 			const descriptor_pair & targetDesc = knownPeers.idToDescriptor(targetId);
 			int targetFd = targetDesc.desc;
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(targetDesc));
 			res = send_type_(targetFd, GET_PEER_CREDENTIALS);
 			res = send_(targetFd, sourceId);
 			QUIT_IF_UNSUCCESSFUL(res);
@@ -201,6 +242,7 @@ namespace igcl
 			TEST() std::cout << "sent request for credentials (to " << targetId << ")" << std::endl;
 		} else {
 			TEST() std::cout << "requested ID is NOT registered" << std::endl;
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(sourceDesc));
 			res = send_type_(sourceFd, GIVE_PEER_CREDENTIALS);
 			res = send_(sourceFd, std::string(""));
 			LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
@@ -245,6 +287,7 @@ namespace igcl
 			assert(rc == 0);
 			std::string requesterIp(inet_ntoa((*(sockaddr_in*)&addr).sin_addr));
 
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(requesterDesc));
 			res = send_type_(requesterFd, GIVE_PEER_CREDENTIALS);
 			if (requesterIp == targetIp) {
 				TEST() std::cout << "target is in the same network as requester" << std::endl;
@@ -280,6 +323,7 @@ namespace igcl
 			TEST() std::cout << "requested ID is registered. proceeding" << std::endl;
 			const descriptor_pair & targetDesc = knownPeers.idToDescriptor(targetId);
 			int targetFd = targetDesc.desc;
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(targetDesc));
 			res = send_type_(targetFd, GET_NICE_PEER_CREDENTIALS);
 			res = send_(targetFd, sourceId);
 			LOG_AND_QUIT_IF_UNSUCCESSFUL(res, targetDesc);
@@ -291,6 +335,7 @@ namespace igcl
 			TEST() std::cout << "sent request for nice credentials (to " << targetId << ")" << std::endl;
 		} else {
 			TEST() std::cout << "requested ID is NOT registered" << std::endl;
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(sourceDesc));
 			res = send_type_(sourceFd, GIVE_NICE_PEER_CREDENTIALS);
 			res = send_(sourceFd, std::string(""));
 			LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
@@ -321,15 +366,23 @@ namespace igcl
 
 			const descriptor_pair & requesterDesc = knownPeers.idToDescriptor(requesterId);
 			int requesterFd = requesterDesc.desc;
-			res = send_type_(requesterFd, GIVE_NICE_PEER_CREDENTIALS);
-			res = send_(requesterFd, targetCandidates);		// give target credentials to source (includes ID)
-			res = send_(requesterFd, targetId);
+			// lock scope
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(requesterDesc));
+				res = send_type_(requesterFd, GIVE_NICE_PEER_CREDENTIALS);
+				res = send_(requesterFd, targetCandidates);		// give target credentials to source (includes ID)
+				res = send_(requesterFd, targetId);
+			}
 			LOG_AND_QUIT_IF_UNSUCCESSFUL(res, requesterDesc);
 			TEST() std::cout << "sent target creds to source (" << requesterId << ")" << std::endl;
 
-			res = send_type_(targetFd, GIVE_NICE_PEER_CREDENTIALS);
-			res = send_(targetFd, requesterCandidates);		// give source credentials to target (includes ID)
-			res = send_(targetFd, requesterId);
+			// lock scope
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(sourceDesc));
+				res = send_type_(targetFd, GIVE_NICE_PEER_CREDENTIALS);
+				res = send_(targetFd, requesterCandidates);		// give source credentials to target (includes ID)
+				res = send_(targetFd, requesterId);
+			}
 			LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 			TEST() std::cout << "sent source creds to target (" << targetId << ")" << std::endl;
 		}
@@ -350,6 +403,7 @@ namespace igcl
 		if (knownPeers.idExists(targetId)) {
 			descriptor_pair targetDesc = knownPeers.idToDescriptor(targetId);
 			if (layout.areConnected(sourceId, targetId)) {
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(targetDesc));
 				res = send_type_(targetDesc.desc, SET_RELAYED_CONNECTION);
 				res = send_(targetDesc.desc, sourceId);
 			}
@@ -359,6 +413,25 @@ namespace igcl
 	}
 
 
+	result_type Coordinator::whenPeerReportsConnectionType(const descriptor_pair & sourceDesc, peer_id sourceId)
+	{
+		result_type res;
+		peer_id targetId;
+		connection_type type;
+		res = recv_(sourceDesc.desc, 0, targetId);
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
+		res = recv_(sourceDesc.desc, 0, type);
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
+		TEST() std::cout << "connection from " << sourceId << " to " << targetId << " established with type " << (int) type << std::endl;
+
+		if (peerAddresses.count(sourceId) > 0 and peerAddresses.count(targetId) > 0) {
+			connectionCache.set(peerAddresses[sourceId], peerAddresses[targetId], type);
+		}
+
+		return res;
+	}
+
+
 	result_type Coordinator::whenPeerIsReady(const descriptor_pair & sourceDesc, peer_id sourceId)
 	{
 		TEST() std::cout << "peer is ready " << sourceId << std::endl;
@@ -417,6 +490,7 @@ namespace igcl
 	{
 		result_type res = SUCCESS;
 
+		std::lock_guard<std::mutex> lockWhileInsideScope(barrierMutex);
 		barrierBlockedPeers.insert(sourceId);
 
 		if (barrierBlockedPeers.size() == knownPeers.size())
@@ -439,6 +513,12 @@ namespace igcl
 				return whenPeerRegisters(sourceDesc);
 			}
 
+			case REGISTER_CONTROL_LANE:
+			{
+				dbg("msg type -> REGISTER_CONTROL_LANE");
+				return whenControlLaneRegisters(sourceDesc);
+			}
+
 			case DEREGISTER:
 			{
 				dbg("msg type -> DEREGISTER");
@@ -477,6 +557,12 @@ namespace igcl
 				return whenReceivedSetRelayedConnection(sourceDesc, sourceId);
 			}
 
+			case REPORT_CONNECTION_TYPE:
+			{
+				dbg("msg type -> REPORT_CONNECTION_TYPE");
+				return whenPeerReportsConnectionType(sourceDesc, sourceId);
+			}
+
 			case READY:
 			{
 				dbg("msg type -> READY");
@@ -519,6 +605,7 @@ namespace igcl
 		Node::deregisterPeer(sourceDesc, id);
 
 		layout.removeNode(id);
+		peerAddresses.erase(id);
 
 		std::vector< std::pair<peer_id, peer_id> > toDelete;
 
@@ -538,6 +625,7 @@ namespace igcl
 		for (auto & elem : toDelete)
 			credentialsRequestsNice.erase(elem);
 
+		std::lock_guard<std::mutex> lockWhileInsideScope(barrierMutex);
 		barrierBlockedPeers.erase(id);
 	}
 
@@ -569,6 +657,7 @@ namespace igcl
 				descriptor_pair desc = knownPeers.idToDescriptor(targetId);
 
 				if (desc.type == DESCRIPTOR_SOCK) {
+					std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(desc));
 					send_type_(desc.desc, DEREGISTER_PEER);
 					send_(desc.desc, id);
 				} else {
@@ -34,6 +34,7 @@ namespace igcl
 	private:
 		peer_id currentId;
 		std::set<peer_id> barrierBlockedPeers;
+		std::mutex barrierMutex;		// barriers of in-process peers arrive from their own threads
 		uint readyPeers;
 
 		std::mutex nPeersMutex;
@@ -44,6 +45,9 @@ namespace igcl
 		std::map<std::pair<peer_id, peer_id>, peer_credentials>      credentialsRequests;
 		std::map<std::pair<peer_id, peer_id>, peer_credentials_nice> credentialsRequestsNice;
 
+		std::map<peer_id, address> peerAddresses;	// public IP and listening port of each peer
+		ConnectionCache connectionCache;
+
 		CoordinatorCallbacks * callbacks;
 		bool usingDfltCallbacks;
 
@@ -56,6 +60,7 @@ namespace igcl
 
 		void setCallbacks(CoordinatorCallbacks * callbacks);
 		void setLayout(const GroupLayout & layout);
+		void setConnectionCacheFile(const std::string & filepath);
 
 		virtual uint getNPeers();
 		result_type waitForNodes(uint n);
@@ -71,6 +76,7 @@ namespace igcl
 		result_type whenPeerRequestsTargetNiceCredentials(const descriptor_pair & sourceDesc, peer_id sourceId);
 		result_type whenTargetProvidesNiceCredentials(const descriptor_pair & sourceDesc, peer_id sourceId);
 		result_type whenReceivedSetRelayedConnection(const descriptor_pair & sourceDesc, peer_id sourceId);
+		result_type whenPeerReportsConnectionType(const descriptor_pair & sourceDesc, peer_id sourceId);
 		result_type whenPeerIsReady(const descriptor_pair & desc, peer_id id);
 
 		result_type whenReceivedRelayedSendTo(const descriptor_pair & desc, peer_id id);
@@ -87,24 +93,7 @@ namespace igcl
 		// Public messaging methods
 		// ------------------------------------------------------
 
-		template <typename ...T>
-		result_type sendToAll(T && ...data)
-		{
-			result_type final = SUCCESS;
-
-			for (descriptor_pair desc : knownPeers.getAllDescriptors()) {
-				if (desc.type == DESCRIPTOR_SOCK) {
-					result_type res;
-					res = send_type_(desc.desc, SEND_TO_PEER);
-					res = send_(desc.desc, std::forward<T>(data)...);
-					if (res != SUCCESS) final = res;
-				} else {
-					// it never happens in the coordinator :)
-				}
-			}
-
-			return final;
-		}
+		using Node::sendToAll;		// (the common send path, so broadcasts get compressed like any other send)
 
 		// ------------------------------------------------------
 		// Private messaging methods
@@ -121,6 +110,7 @@ namespace igcl
 			result_type res = SUCCESS;
 
 			if (desc.type == DESCRIPTOR_SOCK) {
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(desc));
 				res = send_type_(desc.desc, SEND_TO_PEER_RELAYED);
 				res = send_(desc.desc, sourceId);	// send identifier of source
 				res = send_(desc.desc, std::forward<T>(data)...);
@@ -145,13 +135,14 @@ namespace igcl
 				std::cout << "sendToAllRelayed " << desc.desc << std::endl;
 
 				if (desc.type == DESCRIPTOR_SOCK) {
+					std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(desc));
 					result_type res;
 					res = send_type_(desc.desc, SEND_TO_PEER_RELAYED);
 					res = send_(desc.desc, sourceId);	// send identifier of source
 					res = send_(desc.desc, std::forward<T>(data)...);
 					if (res != SUCCESS) {
 						final = res;
-						failedPeers.insert(desc);
+						markFailed(desc);
 					}
 				} else {
 					// it never happens in the coordinator :)
@@ -169,10 +160,9 @@ namespace igcl
 			for (descriptor_pair desc : knownPeers.getAllDescriptors())
 			{
 				if (desc.type == DESCRIPTOR_SOCK) {
-					result_type res = send_type_(desc.desc, BARRIER_REPLY);
+					result_type res = sendControlType(desc, BARRIER_REPLY);
 					if (res != SUCCESS) {
-						final = res;
-						failedPeers.insert(desc);
+						final = res;		// (the failure is noticed again through the peer's main socket)
 					}
 				} else {
 					// it never happens in the coordinator :)
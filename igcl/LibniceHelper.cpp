@@ -8,16 +8,16 @@
 
 namespace igcl		// Internet Group-Communication Library
 {
-	// VERY ugly but necessary :(
-	GMainLoop * LibniceHelper::mainLoop;
-	GMainContext * LibniceHelper::mainContext;
-	NiceAgent * LibniceHelper::agent;
-	std::mutex LibniceHelper::gatheredMutex, LibniceHelper::connectedMutex, LibniceHelper::startedMutex, LibniceHelper::writableMutex;
-	std::condition_variable LibniceHelper::gatheredCondVar, LibniceHelper::connectedCondVar, LibniceHelper::startedCondVar, LibniceHelper::writableCondVar;
-	int LibniceHelper::isConnected, LibniceHelper::hasGathered, LibniceHelper::hasStarted;
-	char * LibniceHelper::localInfo;
-	std::map<uint, bool> LibniceHelper::isWritable;
-	NiceAgentRecvFunc LibniceHelper::cb_nice_recv;
+	const uint LibniceHelper::QUIT_FLUSH_MS;
+
+	// ------------------------------------------------------
+	// Constructor
+	// ------------------------------------------------------
+
+	LibniceHelper::LibniceHelper()
+		: mainLoop(NULL), mainContext(NULL), agent(NULL), nextWorker(0), nStartedLoops(0), stopping(false), cb_nice_recv(NULL), cb_nice_recv_data(NULL)
+	{
+	}
 
 	// ------------------------------------------------------
 	// Public methods
@@ -25,45 +25,92 @@ namespace igcl		// Internet Group-Communication Library
 
 	void LibniceHelper::start()
 	{
-		localInfo = NULL;
-		hasStarted = 0;
-		std::thread th(init);
-		th.detach();
+		g_type_init();
+
+		mainContext = g_main_context_new();
+		agent = nice_agent_new_reliable(mainContext, NICE_COMPATIBILITY_RFC5245);
+		mainLoop = g_main_loop_new(mainContext, FALSE);
+
+		g_object_set(G_OBJECT(agent), "stun-server", "192.198.87.70", "stun-server-port", 3478, NULL);	// stun.3cx.com
+
+		g_signal_connect(G_OBJECT(agent), "candidate-gathering-done",	 G_CALLBACK(cb_candidate_gathering_done), this);
+		g_signal_connect(G_OBJECT(agent), "component-state-changed",	 G_CALLBACK(cb_component_state_changed), this);
+		g_signal_connect(G_OBJECT(agent), "reliable-transport-writable", G_CALLBACK(cb_reliable_transport_writable), this);
+
+		workers.resize(N_WORKER_CONTEXTS);
+		for (WorkerContext & worker : workers) {
+			worker.context = g_main_context_new();
+			worker.loop = g_main_loop_new(worker.context, FALSE);
+		}
+
+		loopThreads.push_back(std::thread(&LibniceHelper::runLoop, this, mainLoop));
+		for (WorkerContext & worker : workers) {
+			loopThreads.push_back(std::thread(&LibniceHelper::runLoop, this, worker.loop));
+		}
 
 		std::unique_lock<std::mutex> lock(startedMutex);
-		while (hasStarted == 0) {
+		while (nStartedLoops < 1 + workers.size()) {
 			startedCondVar.wait(lock);
 		}
-		lock.unlock();
 	}
 
 
+	// waits a while for unsent data (e.g. the last messages of the node) before stopping the agent
 	void LibniceHelper::quit()
 	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+			stopping = true;
+		}
+
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(QUIT_FLUSH_MS);
+		std::vector<StreamState *> states;
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+			for (auto & pair : streams) {
+				states.push_back(&pair.second);
+			}
+		}
+		for (StreamState * state : states) {
+			std::unique_lock<std::mutex> lock(state->sendMutex);
+			state->sendCondVar.notify_all();		// (senders waiting for room give up)
+			state->sendCondVar.wait_until(lock, deadline, [state]() { return state->pending.empty(); });
+		}
+
+		for (WorkerContext & worker : workers) {
+			g_main_loop_quit(worker.loop);
+		}
 		g_main_loop_quit(mainLoop);
+
+		// no callback may be running once the agent is gone
+		for (std::thread & loopThread : loopThreads) {
+			loopThread.join();
+		}
+		loopThreads.clear();
 		g_object_unref(agent);
 	}
 
 
 	bool LibniceHelper::startNewStream(guint & stream_id, std::string & info)
 	{
-		hasGathered = 0;
-
 		stream_id = nice_agent_add_stream(agent, 1);
-		nice_agent_attach_recv(agent, stream_id, 1, mainContext, cb_nice_recv, NULL);	// needed for server reflexive candidates
+		getStream(stream_id);
+
+		// each stream is received by one of the worker loops (this is also needed for server reflexive candidates)
+		WorkerContext & worker = workers[nextWorker++ % workers.size()];
+		nice_agent_attach_recv(agent, stream_id, 1, worker.context, cb_nice_recv, cb_nice_recv_data);
 		nice_agent_gather_candidates(agent, stream_id);
 
-		std::unique_lock<std::mutex> lock(gatheredMutex);
-		while (hasGathered == 0) {
-			gatheredCondVar.wait(lock);
+		std::unique_lock<std::mutex> lock(streamsMutex);
+		StreamState & state = streams[stream_id];
+		while (state.hasGathered == 0) {
+			streamsCondVar.wait(lock);
 		}
-		lock.unlock();
 
-		if (hasGathered == 1) {
-			isWritable[stream_id] = false;
-			info.assign(localInfo);
-			free(localInfo);
-			localInfo = NULL;
+		if (state.localInfo != NULL) {
+			info.assign(state.localInfo);
+			free(state.localInfo);
+			state.localInfo = NULL;
 			return true;
 		}
 		return false;
@@ -72,129 +119,161 @@ namespace igcl		// Internet Group-Communication Library
 
 	bool LibniceHelper::connect(guint stream_id, const std::string & remoteInfo)
 	{
-		isConnected = 0;
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+			streams[stream_id].isConnected = 0;
+		}
 
 		establishConnection(stream_id, remoteInfo.c_str());
 
-		std::unique_lock<std::mutex> lock(connectedMutex);
-		while (isConnected == 0) {
-			connectedCondVar.wait(lock);
+		std::unique_lock<std::mutex> lock(streamsMutex);
+		StreamState & state = streams[stream_id];
+		while (state.isConnected == 0) {
+			streamsCondVar.wait(lock);
 		}
-		lock.unlock();
 
-		if (isConnected == 1) {
-			return true;
-		}
-		return false;
+		return (state.isConnected == 1);
 	}
 
 
-	int LibniceHelper::send(guint stream_id, const char * data, uint size)
+	// sends what the agent takes now and keeps the rest, which is sent when the stream becomes writable again.
+	// only waits if the stream already has too much unsent data. returns false if the agent is stopping
+	bool LibniceHelper::send(guint stream_id, const char * data, size_t size)
 	{
-		int nBytesSent = nice_agent_send(agent, stream_id, 1, size, data);
-		if (nBytesSent < 0) {
-			std::unique_lock<std::mutex> lock(writableMutex);
-			isWritable[stream_id] = false;
+		StreamState & state = getStream(stream_id);
+		std::unique_lock<std::mutex> lock(state.sendMutex);
+
+		while (state.pendingBytes >= MAX_PENDING_BYTES and !stopping) {
+			state.sendCondVar.wait(lock);
 		}
-		return nBytesSent;
+		if (state.pendingBytes >= MAX_PENDING_BYTES)
+			return false;
+
+		// pseudo-tcp only signals writability after a send that takes nothing, so a short send is retried
+		while (size > 0 and state.pending.empty() and state.isWritable)
+		{
+			int nBytesSent = nice_agent_send(agent, stream_id, 1, size, data);
+			if (nBytesSent <= 0) {
+				state.isWritable = false;		// (the agent signals when it takes data again)
+				break;
+			}
+			data += nBytesSent;
+			size -= nBytesSent;
+		}
+
+		if (size > 0) {
+			PendingData pending;
+			pending.data = (char *) malloc(size);
+			memcpy(pending.data, data, size);
+			pending.size = size;
+			pending.offset = 0;
+			state.pending.push_back(pending);
+			state.pendingBytes += size;
+		}
+		return true;
 	}
 
 
 	void LibniceHelper::waitWritable(guint stream_id)
 	{
-		std::unique_lock<std::mutex> lock(writableMutex);
-		while (!isWritable[stream_id]) {
-			writableCondVar.wait(lock);
+		StreamState & state = getStream(stream_id);
+		std::unique_lock<std::mutex> lock(state.sendMutex);
+		while (!state.isWritable) {
+			state.sendCondVar.wait(lock);
 		}
-		lock.unlock();
 	}
 
 	// ------------------------------------------------------
 	// Setup
 	// ------------------------------------------------------
 
-	void LibniceHelper::init()
+	void LibniceHelper::runLoop(GMainLoop * loop)
 	{
-		g_type_init();
-
-		mainContext = g_main_context_new();
-		agent = nice_agent_new_reliable(mainContext, NICE_COMPATIBILITY_RFC5245);
-		mainLoop = g_main_loop_new(mainContext, FALSE);
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(startedMutex);
+			nStartedLoops++;
+			startedCondVar.notify_one();
+		}
 
-		g_object_set(G_OBJECT(agent), "stun-server", "192.198.87.70", "stun-server-port", 3478, NULL);	// stun.3cx.com
+		g_main_loop_run(loop);
+	}
 
-		g_signal_connect(G_OBJECT(agent), "candidate-gathering-done",	 G_CALLBACK(cb_candidate_gathering_done), NULL);
-		g_signal_connect(G_OBJECT(agent), "component-state-changed",	 G_CALLBACK(cb_component_state_changed), NULL);
-		g_signal_connect(G_OBJECT(agent), "reliable-transport-writable", G_CALLBACK(cb_reliable_transport_writable), NULL);
+	LibniceHelper::StreamState & LibniceHelper::getStream(guint stream_id)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+		return streams[stream_id];
+	}
 
-		hasStarted = 1;
-		startedMutex.lock();
-		startedCondVar.notify_one();
-		startedMutex.unlock();
 
-		g_main_loop_run (mainLoop);
+	// gives the agent as much unsent data as it takes (called with the stream's "sendMutex" locked)
+	void LibniceHelper::sendPending(guint stream_id, StreamState & state)
+	{
+		while (!state.pending.empty())
+		{
+			PendingData & pending = state.pending.front();
+			int nBytesSent = nice_agent_send(agent, stream_id, 1, pending.size - pending.offset, pending.data + pending.offset);
+			if (nBytesSent <= 0) {
+				state.isWritable = false;
+				break;
+			}
+			pending.offset += nBytesSent;
+			state.pendingBytes -= nBytesSent;
+			if (pending.offset < pending.size)
+				continue;		// (a short send does not mean the agent is full)
+			free(pending.data);
+			state.pending.pop_front();
+		}
+		state.sendCondVar.notify_all();
 	}
 
-
 	// ------------------------------------------------------
 	// Callbacks
 	// ------------------------------------------------------
 
-	void LibniceHelper::cb_candidate_gathering_done (NiceAgent * agent, guint stream_id, gpointer data_)
+	void LibniceHelper::cb_candidate_gathering_done (NiceAgent * agent, guint stream_id, gpointer data)
 	{
-		//std::cout << "cb_candidate_gathering_done" << std::endl;
-
-		char * tmp = getLocalInfo(stream_id);
-		localInfo = tmp;
-
-		//std::cout << "local info:  " << localInfo << std::endl;
-
-		std::lock_guard<std::mutex> scoped_lock(gatheredMutex);
-		hasGathered = 1;
-		gatheredCondVar.notify_one();
+		LibniceHelper * helper = (LibniceHelper *) data;
+		char * localInfo = helper->getLocalInfo(stream_id);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(helper->streamsMutex);
+		StreamState & state = helper->streams[stream_id];
+		state.localInfo = localInfo;
+		state.hasGathered = 1;
+		helper->streamsCondVar.notify_all();
 	}
 
 
 	void LibniceHelper::cb_component_state_changed (NiceAgent * agent, guint stream_id, guint component_id, guint state, gpointer data)
 	{
+		LibniceHelper * helper = (LibniceHelper *) data;
+		int isConnected = 0;
+
 		if (state == NICE_COMPONENT_STATE_READY)
 		{
-			//std::cout << "Component state is READY" << std::endl;
-
 			NiceCandidate *local, *remote;
+			isConnected = (nice_agent_get_selected_pair(agent, stream_id, component_id, &local, &remote) ? 1 : -1);
+		}
+		else if (state == NICE_COMPONENT_STATE_FAILED)
+		{
+			isConnected = -1;
+		}
 
-			if (nice_agent_get_selected_pair (agent, stream_id, component_id, &local, &remote))
-			{
-				/*gchar localIp [INET6_ADDRSTRLEN];
-				gchar remoteIp[INET6_ADDRSTRLEN];
-				int localPort, remotePort;
-
-				nice_address_to_string(&local->addr, localIp);
-				localPort = nice_address_get_port(&local->addr);
-				printf("Negotiation complete: (local:[%s]:%d,", localIp, localPort);
-
-				nice_address_to_string(&remote->addr, remoteIp);
-				remotePort = nice_address_get_port(&remote->addr);
-				printf(" remote:[%s]:%d)\n", remoteIp, remotePort);*/
-
-				std::lock_guard<std::mutex> scoped_lock(connectedMutex);
-				isConnected = 1;
-				connectedCondVar.notify_one();
-			} else {
-				std::lock_guard<std::mutex> scoped_lock(connectedMutex);
-				isConnected = -1;
-				connectedCondVar.notify_one();
-			}
+		if (isConnected != 0) {
+			std::lock_guard<std::mutex> lockWhileInsideScope(helper->streamsMutex);
+			helper->streams[stream_id].isConnected = isConnected;
+			helper->streamsCondVar.notify_all();
 		}
 	}
 
 
-	void LibniceHelper::cb_reliable_transport_writable (NiceAgent * agent, guint stream_id, guint component_id, gpointer user_data)
+	void LibniceHelper::cb_reliable_transport_writable (NiceAgent * agent, guint stream_id, guint component_id, gpointer data)
 	{
-		//std::cout << "cb_reliable_transport_writable " << stream_id << std::endl;
-		std::lock_guard<std::mutex> scoped_lock(writableMutex);
-		isWritable[stream_id] = true;
-		writableCondVar.notify_all();
+		LibniceHelper * helper = (LibniceHelper *) data;
+		StreamState & state = helper->getStream(stream_id);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(state.sendMutex);
+		state.isWritable = true;
+		helper->sendPending(stream_id, state);
 	}
 
 
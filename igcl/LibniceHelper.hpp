@@ -11,9 +11,12 @@
 #include <string>
 #include <cassert>
 #include <map>
+#include <vector>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <sys/time.h>
 
 #include <nice/agent.h>
@@ -21,40 +24,98 @@
 
 namespace igcl
 {
+	/*
+	 * Libnice agent of a node. Each node has its own agent, so several nodes may live in the same process.
+	 * Signals (gathering, connection state, writability) are handled by the agent's own main loop, while
+	 * the data of each stream is received by one of several worker loops, so streams are received in parallel.
+	 */
 	class LibniceHelper
 	{
+		// ======================================================
+		// ==================== DEFINITIONS =====================
+		// ======================================================
+
+		static const uint N_WORKER_CONTEXTS = 2;
+		static const size_t MAX_PENDING_BYTES = 16 << 20;		// senders wait while a stream has this much unsent data
+		static const uint QUIT_FLUSH_MS = 2000;					// how long quit waits for unsent data
+
+		struct PendingData
+		{
+			char * data;			// allocated with malloc
+			size_t size, offset;
+		};
+
+		struct StreamState
+		{
+			int hasGathered;		// 0 while gathering, 1 when done
+			int isConnected;		// 0 while connecting, 1 if connected, -1 if it failed
+			char * localInfo;
+
+			// outgoing data that the agent did not take yet, sent when the stream becomes writable again
+			std::deque<PendingData> pending;
+			size_t pendingBytes;
+			bool isWritable;
+			std::mutex sendMutex;
+			std::condition_variable sendCondVar;
+
+			StreamState() : hasGathered(0), isConnected(0), localInfo(NULL), pendingBytes(0), isWritable(false) {}
+		};
+
+		struct WorkerContext
+		{
+			GMainContext * context;
+			GMainLoop * loop;
+		};
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
 	private:
-		static GMainLoop * mainLoop;
-		static GMainContext * mainContext;
-		static NiceAgent * agent;
+		GMainLoop * mainLoop;
+		GMainContext * mainContext;
+		NiceAgent * agent;
+		std::vector<WorkerContext> workers;
+		std::vector<std::thread> loopThreads;
+		uint nextWorker;
 
-		static std::mutex gatheredMutex, connectedMutex, startedMutex, writableMutex;
-		static std::condition_variable gatheredCondVar, connectedCondVar, startedCondVar, writableCondVar;
-		static int isConnected, hasGathered, hasStarted;
-		static char * localInfo;
-		static std::map<uint, bool> isWritable;
+		std::mutex startedMutex;
+		std::condition_variable startedCondVar;
+		uint nStartedLoops;
+
+		std::map<guint, StreamState> streams;		// (elements keep their address, so they are used outside the lock)
+		std::mutex streamsMutex;
+		std::condition_variable streamsCondVar;
+		bool stopping;
 
 	public:
-		static NiceAgentRecvFunc cb_nice_recv;
+		NiceAgentRecvFunc cb_nice_recv;		// receives the data of every stream, with "cb_nice_recv_data" as user data
+		gpointer cb_nice_recv_data;
 
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
 	public:
-		static void start();
-		static void quit();
-		static bool startNewStream(guint & stream_id, std::string & info);
-		static bool connect(guint stream_id, const std::string & remoteInfo);
-		static int send(guint stream_id, const char * data, uint size);
-		static void waitWritable(guint stream_id);
+		LibniceHelper();
+
+		void start();
+		void quit();
+		bool startNewStream(guint & stream_id, std::string & info);
+		bool connect(guint stream_id, const std::string & remoteInfo);
+		bool send(guint stream_id, const char * data, size_t size);
+		void waitWritable(guint stream_id);
 
 	private:
-		static void init();
+		void runLoop(GMainLoop * loop);
+		StreamState & getStream(guint stream_id);
+		void sendPending(guint stream_id, StreamState & state);
 
-		static void cb_candidate_gathering_done (NiceAgent * agent, guint stream_id, gpointer data_);
+		static void cb_candidate_gathering_done (NiceAgent * agent, guint stream_id, gpointer data);
 		static void cb_component_state_changed (NiceAgent * agent, guint stream_id, guint component_id, guint state, gpointer data);
-		static void cb_reliable_transport_writable (NiceAgent * agent, guint stream_id, guint component_id, gpointer user_data);
+		static void cb_reliable_transport_writable (NiceAgent * agent, guint stream_id, guint component_id, gpointer data);
 
-		static void establishConnection(guint stream_id, const char * remoteInfo);
-		static char * getLocalInfo(guint stream_id);
-		static NiceCandidate * parseCandidate(guint stream_id, char * str);
+		void establishConnection(guint stream_id, const char * remoteInfo);
+		char * getLocalInfo(guint stream_id);
+		NiceCandidate * parseCandidate(guint stream_id, char * str);
 	};
 }
 
@@ -2,19 +2,21 @@
 #include "Common.hpp"
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/select.h>
 #include <arpa/inet.h>
 #include <cstring>
+#include <fstream>
 #include <unistd.h>
 #include <netdb.h>
+#include <poll.h>
 
 
 namespace igcl
 {
-#ifndef DISABLE_LIBNICE
-	std::map<uint, Node::NiceReceivedData> Node::receivedData;
-	Node * Node::instance;
-#endif
+	std::map<int, std::shared_ptr<Node::LocalLink> > Node::localNodes;
+	std::mutex Node::localNodesMutex;
+	const int Node::CONTROL_LANE_POLL_MS;
 
 	//--------------------------------------------------
 	// Constructor/destructor
@@ -24,11 +26,33 @@ namespace igcl
 	{
 		ownAddr.set("127.0.0.1", ownPort);
 		shouldStop = false;
+		loopRunning = false;
+		nLaneThreads = 0;
+		nChannelThreads = 0;
+		nextStreamId = 0;
+		streamLink = std::make_shared<StreamLink>();
+		streamLink->node = this;
+		localLink = std::make_shared<LocalLink>();
+		localLink->node = this;
+		localLink->nDeliveries = 0;
+		compressionThreshold = 0;
+		workStealing = NULL;
+		sharedBound = NULL;
 		receiverThread = NULL;
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(localNodesMutex);
+			localNodes[ownPort] = localLink;
+		}
 #ifndef DISABLE_LIBNICE
-		instance = this;
 		nice.cb_nice_recv = libniceRecv;
+		nice.cb_nice_recv_data = this;
 		nice.start();
+#endif
+#ifdef UDP_EMULATION
+		udp.setEmulation(UDP_EMULATION);
+#endif
+#ifdef COMPRESSION_THRESHOLD
+		setCompression(COMPRESSION_THRESHOLD);
 #endif
 	}
 
@@ -36,6 +60,42 @@ namespace igcl
 	Node::~Node()
 	{
 		// see "terminate" method instead
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(localNodesMutex);
+			localNodes.erase(ownAddr.port);
+		}
+		// lock scope
+		{
+			std::unique_lock<std::mutex> uniqueLock(localLink->mutex);
+			localLink->node = NULL;
+			while (localLink->nDeliveries > 0) {
+				localLink->condVar.wait(uniqueLock);
+			}
+		}
+
+		// the receiver thread may still be handling the message that terminated this node
+		// (which matters when several nodes live, and are deleted, in the same process)
+		terminateStatusOn();
+		std::unique_lock<std::mutex> uniqueLock(stopMutex);
+		while (loopRunning or nLaneThreads > 0 or nChannelThreads > 0) {
+			stopCondVar.wait(uniqueLock);
+		}
+		uniqueLock.unlock();
+
+		// (waits for a handle that is giving a credit through this node)
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamLink->mutex);
+			streamLink->node = NULL;
+		}
+
+#ifndef DISABLE_LIBNICE
+		for (NiceReceivedData * data : receivedData) {
+			if (data != NULL) {
+				free(data->bytes);
+				delete data;
+			}
+		}
+#endif
 	}
 
 	//--------------------------------------------------
@@ -59,6 +119,60 @@ namespace igcl
 		return ownId;
 	}
 
+
+	int Node::getPort()
+	{
+		return ownAddr.port;
+	}
+
+
+	// ids of the peers this node knows (not its own)
+	std::vector<peer_id> Node::getPeerIds()
+	{
+		std::vector<peer_id> ids = knownPeers.getAllIds();
+		ids.erase(std::remove(ids.begin(), ids.end(), ownId), ids.end());
+		return ids;
+	}
+
+#ifndef DISABLE_UDP
+	// makes this node's udp links behave like lossy, high-latency ones (see UdpHelper)
+	void Node::setUdpEmulation(double lossRate, uint delayMs, uint jitterMs)
+	{
+		udp.setEmulation(lossRate, delayMs, jitterMs);
+	}
+
+
+	std::string Node::getUdpStats()
+	{
+		return udp.statsToString();
+	}
+#endif
+
+	// compresses messages (and stream chunks) of at least "minBytes" that go through the network. 0 disables it.
+	// receivers need no setting, since every node decompresses what it gets
+	void Node::setCompression(size_type minBytes)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(compressionMutex);
+		compressionThreshold = minBytes;
+	}
+
+
+	// overrides the node's compression setting for the link to one peer (e.g. for a slow remote one)
+	void Node::setCompressionFor(peer_id id, size_type minBytes)
+	{
+		if (knownPeers.idExists(id)) {
+			std::lock_guard<std::mutex> lockWhileInsideScope(compressionMutex);
+			peerCompressionThresholds[knownPeers.idToDescriptor(id)] = minBytes;
+		}
+	}
+
+
+	// ratio and time spent by this node's compression (of sent messages) and decompression (of received ones)
+	std::string Node::getCompressionStats()
+	{
+		return compression.statsToString();
+	}
+
 	//--------------------------------------------------
 	// Listen, receive and process messages
 	//--------------------------------------------------
@@ -105,6 +219,7 @@ namespace igcl
 
 	void Node::threadedLoop()
 	{
+		loopRunning = true;
 		receiverThread = new std::thread(&Node::loop, this);
 		receiverThread->detach();
 	}
@@ -131,6 +246,10 @@ namespace igcl
 				std::cout << "errno: " << errno << std::endl;
 			}
 		}
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+		loopRunning = false;
+		stopCondVar.notify_all();
 	}
 
 
@@ -167,10 +286,7 @@ namespace igcl
 
 					if (processRes == FAILURE) {
 						std::cout << "FAILURE WHILE PROCESSING MESSAGE" << std::endl;
-						for (const descriptor_pair & desc : failedPeers) {
-							actOnFailure(desc);	// virtual call
-						}
-						failedPeers.clear();
+						actOnFailedPeers();
 					}
 				}
 				--desc_ready;
@@ -182,11 +298,13 @@ namespace igcl
 
 
 #ifndef DISABLE_LIBNICE
+	// reassembles the messages of a stream from the pieces libnice gives. each piece is copied once, straight
+	// into the buffer of its message, which is then handed over like the payloads of other transports.
+	// every stream is always received by the same thread
 	void Node::libniceRecv(NiceAgent * agent, guint stream_id, guint component_id, guint len, gchar * buf, gpointer user_data)
 	{
-		//std::cout << "cb_nice_recv with len " << len << std::endl;
-
-		NiceReceivedData & data = receivedData[stream_id];
+		Node * instance = (Node *) user_data;
+		NiceReceivedData & data = instance->getReceivedData(stream_id);
 
 		while (len > 0)
 		{
@@ -194,134 +312,301 @@ namespace igcl
 				data.type = buf[0];
 				buf++;
 				len--;
+				continue;
 			}
 
-			if (len == 0) {
-				return;
+			if (data.readSizeBytes < sizeof(size_type))		// the size may also come in pieces
+			{
+				uint nNewBytes = std::min((size_type) len, (size_type) (sizeof(size_type) - data.readSizeBytes));
+				memcpy(data.sizeBytes + data.readSizeBytes, buf, nNewBytes);
+				data.readSizeBytes += nNewBytes;
+				buf += nNewBytes;
+				len -= nNewBytes;
+
+				if (data.readSizeBytes < sizeof(size_type))
+					break;
+				memcpy(&data.size, data.sizeBytes, sizeof(size_type));
+				data.bytes = (char *) malloc(data.size);
 			}
 
-			uint nNewBytes = 0;
+			uint nNewBytes = std::min((size_type) len, data.size - data.readBytes);
+			memcpy(data.bytes + data.readBytes, buf, nNewBytes);
+			data.readBytes += nNewBytes;
+			buf += nNewBytes;
+			len -= nNewBytes;
 
-			if (data.size == 0)		// size not yet set
+			if (data.readBytes == data.size)
 			{
-				if (data.readSizeBytes == 0 and len >= sizeof(size_type))		// buf contains whole size -> read directly
-				{
-					data.size = ((size_type *) buf)[0];
-					data.bytes = (char *) malloc(data.size);
-					nNewBytes = sizeof(size_type);
-				}
-				else							// incomplete read (either some bytes of "size" were already read or buf doesn't contain all bytes of "size")
-				{
-					char * address = data.sizeBytes + data.readSizeBytes;
-
-					if (data.readSizeBytes + len >= sizeof(size_type))		// buf contains enough bytes to fill remaining size value
-					{
-						nNewBytes = sizeof(size_type) - data.readSizeBytes;
-						memcpy(address, buf, nNewBytes);		// read remaining bytes
-						data.readSizeBytes += nNewBytes;
-
-						// NODE: the following line gives a warning and will not work for big-endian systems
-						data.size = *((size_type *) data.sizeBytes);	// set size and allocate space for data
-						data.bytes = (char *) malloc(data.size);
-					}
-					else
-					{
-						nNewBytes = len;
-						memcpy(address, buf, nNewBytes);				// else save partial bytes of size
-						data.readSizeBytes += nNewBytes;
-					}
+				msg_type type = data.type;
+				char * bytes = data.bytes;
+				size_type size = data.size;
+				data = NiceReceivedData();
+
+				result_type processRes = instance->processMessageOfType(descriptor_pair(stream_id, DESCRIPTOR_NICE), type, bytes, size);
+
+				if (processRes == FAILURE) {
+					std::cout << "FAILURE WHILE PROCESSING MESSAGE" << std::endl;
+					instance->actOnFailedPeers();
+					return;
 				}
+			}
+		}
+	}
 
-				buf += nNewBytes;
-				len -= nNewBytes;
+
+	// state of a stream's incomplete message. stream ids are small and consecutive, so they index a vector.
+	// states are never deleted before the node is, so they can be used without the lock
+	Node::NiceReceivedData & Node::getReceivedData(uint streamId)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(receivedDataMutex);
+		if (streamId >= receivedData.size()) {
+			receivedData.resize(streamId + 1, NULL);
+		}
+		if (receivedData[streamId] == NULL) {
+			receivedData[streamId] = new NiceReceivedData();
+		}
+		return *receivedData[streamId];
+	}
+#endif
+
+
+#ifndef DISABLE_SHARED_MEMORY
+	void Node::startSharedMemoryReceiver(int channelId)
+	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+			nChannelThreads++;
+		}
+		std::thread th(&Node::sharedMemoryLoop, this, channelId);
+		th.detach();
+	}
+
+
+	// reads messages from a shared memory channel until it fails or the node stops
+	void Node::sharedMemoryLoop(int channelId)
+	{
+		const descriptor_pair desc(channelId, DESCRIPTOR_SHM);
+
+		for(;;) {
+			// lock scope
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+				if (shouldStop)
+					break;
+			}
+
+			msg_type type = NONE;
+			result_type res = shm_recv_type_(channelId, type);	// returns NOTHING from time to time to check "shouldStop"
+
+			if (res == NOTHING)
+				continue;
+			if (res == SUCCESS)
+				res = processMessageOfType(desc, type);
+			else
+				markFailed(desc);
+
+			if (res == FAILURE) {
+				std::cout << "FAILURE WHILE PROCESSING MESSAGE" << std::endl;
+				actOnFailedPeers();
+				break;
 			}
+		}
+
+		shm.release(channelId);		// (nothing reads the channel anymore)
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+		nChannelThreads--;
+		stopCondVar.notify_all();
+	}
+#endif
+
+
+#ifndef DISABLE_UDP
+	void Node::startUdpReceiver(int channelId)
+	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+			nChannelThreads++;
+		}
+		std::thread th(&Node::udpLoop, this, channelId);
+		th.detach();
+	}
+
 
-			/*if (! ((data.size != 0) == (len > 0))) {
-				std::cout << "size: " << data.size << std::endl;
-				std::cout << "len: " << len << std::endl;
-				uint a;
-				std::cin >> a;
-			}*/
+	// reads messages from a udp channel until it fails or the node stops
+	void Node::udpLoop(int channelId)
+	{
+		const descriptor_pair desc(channelId, DESCRIPTOR_UDP);
 
-			if (data.size != 0)		// size is set -> read message
+		for(;;) {
+			// lock scope
 			{
-				char * address = data.bytes + data.readBytes;
+				std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+				if (shouldStop)
+					break;
+			}
 
-				if (data.readBytes + len >= data.size)		// buf contains enough bytes to fill remaining data
-				{
-					nNewBytes = data.size - data.readBytes;
-					memcpy(address, buf, nNewBytes);		// read remaining bytes
-					data.readBytes += nNewBytes;
+			msg_type type = NONE;
+			char * bytes;
+			size_type size;
+			result_type res = udp_recv_(channelId, type, bytes, size);	// returns NOTHING from time to time to check "shouldStop"
 
-					//std::cout << "processMessage through libnice" << std::endl;
+			if (res == NOTHING)
+				continue;
+			if (res == SUCCESS)
+				res = processMessageOfType(desc, type, bytes, size);
+			else
+				markFailed(desc);
 
-					result_type processRes = instance->processMessage(descriptor_pair(stream_id, DESCRIPTOR_NICE));
+			if (res == FAILURE) {
+				std::cout << "FAILURE WHILE PROCESSING MESSAGE" << std::endl;
+				actOnFailedPeers();
+				break;
+			}
+		}
 
-					if (processRes == FAILURE) {
-						std::cout << "FAILURE WHILE PROCESSING MESSAGE" << std::endl;
-						for (const descriptor_pair & desc : instance->failedPeers) {
-							instance->actOnFailure(desc);	// virtual call
-						}
-						instance->failedPeers.clear();
-					}
+		std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+		nChannelThreads--;
+		stopCondVar.notify_all();
+	}
+#endif
 
-					data = NiceReceivedData();
-				}
-				else
-				{
-					nNewBytes = len;
-					memcpy(address, buf, nNewBytes);				// else save partial bytes of size
-					data.readBytes += nNewBytes;
+
+	void Node::startControlLaneReceiver(int laneFd)
+	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+			nLaneThreads++;
+		}
+		std::thread th(&Node::controlLaneLoop, this, laneFd);
+		th.detach();
+	}
+
+
+	// reads the messages of a control lane until it fails, is closed or the node stops.
+	// lanes only carry urgent messages (see isUrgentType)
+	void Node::controlLaneLoop(int laneFd)
+	{
+		for(;;) {
+			// lock scope
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+				if (shouldStop)
+					break;
+			}
+
+			pollfd pfd;
+			pfd.fd = laneFd;
+			pfd.events = POLLIN;
+			int rc = poll(&pfd, 1, CONTROL_LANE_POLL_MS);
+
+			if (rc == 0 or (rc < 0 and errno == EINTR))
+				continue;
+			if (rc < 0)
+				break;
+
+			descriptor_pair ownerDesc;
+			// lock scope
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(controlLanesMutex);
+				auto it = controlLaneOwners.find(laneFd);
+				if (it == controlLaneOwners.end())
+					break;
+				ownerDesc = it->second;
+			}
+			peer_id id = knownPeers.descriptorToId(ownerDesc);
+			if (id == INVALID_PEER_ID)
+				break;		// (its peer left)
+
+			msg_type type = NONE;
+			result_type res = recv_type_(laneFd, 0, type);
+
+			if (res == SUCCESS and isUrgentType(type)) {
+				char * bytes = NULL;
+				size_type size = 0;
+				res = recv_new_(laneFd, 0, bytes, size);
+				if (res == SUCCESS) {
+					res = deliverMessage(ownerDesc, id, type, bytes, size);	// same queue as the peer's other messages
+				} else {
+					free(bytes);
 				}
+			} else if (res == SUCCESS) {
+				res = FAILURE;		// (lanes only carry urgent messages)
+			}
 
-				buf += nNewBytes;
-				len -= nNewBytes;
+			if (res != SUCCESS)
+				break;
+		}
+
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(controlLanesMutex);
+			auto it = controlLaneOwners.find(laneFd);
+			if (it != controlLaneOwners.end()) {
+				controlLanes.erase(it->second);
+				controlLaneOwners.erase(it);
 			}
 		}
+		close(laneFd);		// only here, so that the descriptor is not reused while this thread reads it
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(stopMutex);
+		nLaneThreads--;
+		stopCondVar.notify_all();
 	}
-#endif
 
 
+	// handles the next message of a socket
 	result_type Node::processMessage(const descriptor_pair & sourceDesc)
 	{
 		dbg_f();
 		result_type res;
 
 		msg_type type = NONE;
-		if (sourceDesc.type == DESCRIPTOR_SOCK) {
-			res = recv_type_(sourceDesc.desc, 0, type);	// receive msg type (present in all messages)
-			LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
-		}
-#ifndef DISABLE_LIBNICE
-		else {
-			type = instance->receivedData[sourceDesc.desc].type;
-			res = SUCCESS;
-		}
-		if (res == FAILURE)
-			return res;
-#endif
+		res = recv_type_(sourceDesc.desc, 0, type);	// receive msg type (present in all messages)
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 
+		return processMessageOfType(sourceDesc, type);
+	}
+
+
+	// handles a message whose type was already read from its source (along with its payload, for udp and libnice)
+	result_type Node::processMessageOfType(const descriptor_pair & sourceDesc, msg_type type, char * payload, size_type payloadSize)
+	{
+		result_type res;
 		peer_id id = knownPeers.descriptorToId(sourceDesc);
 
+		// only registrations come from descriptors of no known peer. anything else is dropped with its connection
+		// (as a failure of that connection alone, not of a peer)
+		if (id == INVALID_PEER_ID and type != REGISTER and type != REGISTER_CONTROL_LANE) {
+			std::cout << "message of type " << (int) type << " from an unknown descriptor" << std::endl;
+			free(payload);
+			if (sourceDesc.type == DESCRIPTOR_SOCK) {
+				fds.unsetFd(sourceDesc.desc);
+				close(sourceDesc.desc);
+			}
+			return FAILURE;
+		}
+
 		res = handleMessage(sourceDesc, id, type);		// virtual call
 
 		if (res == NOTHING) {
-			char * bytes = NULL;
-			size_type size = 0;
+			char * bytes = payload;
+			size_type size = payloadSize;
 
 			if (sourceDesc.type == DESCRIPTOR_SOCK) {
 				res = recv_new_(sourceDesc.desc, 0, bytes, size);
 				LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 			}
-#ifndef DISABLE_LIBNICE
-			else {
-				NiceReceivedData & data = instance->receivedData[sourceDesc.desc];
-				bytes = data.bytes;
-				size = data.size;
+#ifndef DISABLE_SHARED_MEMORY
+			else if (sourceDesc.type == DESCRIPTOR_SHM) {
+				res = shm_recv_new_(sourceDesc.desc, bytes, size);
+				LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 			}
 #endif
-			bufferMessage(sourceDesc, id, bytes, size);
-			res = SUCCESS;
+			// (udp and libnice payloads were already received)
+			res = deliverMessage(sourceDesc, id, type, bytes, size);
+		} else if (payload != NULL) {
+			free(payload);
 		}
 
 		return res;
@@ -331,6 +616,40 @@ namespace igcl
 	// Queue messages
 	//--------------------------------------------------
 
+	// gives a received payload to whoever is waiting for it. the buffer becomes owned by the receiver
+	result_type Node::deliverMessage(const descriptor_pair & sourceDesc, peer_id id, msg_type type, char * data, size_type size)
+	{
+		switch (type)
+		{
+			case STREAM_CHUNK:
+				return whenReceivedStreamChunk(id, data, size);
+			case STREAM_CREDIT:
+				return whenReceivedStreamCredit(data, size);
+			case WORK_STEAL:
+			case WORK_GIVEN:
+			case WORK_DONE:
+			case WORK_FINISHED:
+				return whenReceivedWorkMessage(id, type, data, size);
+			case BOUND_UPDATE:
+				return whenReceivedBoundMessage(id, data, size);
+			case MIGRANTS:
+				return whenReceivedMigrants(id, data, size);
+			case SEND_TO_PEER_COMPRESSED:
+			case STREAM_CHUNK_COMPRESSED:
+			{
+				char * bytes;
+				size_type nBytes;
+				bool ok = compression.unpack(data, size, bytes, nBytes);
+				free(data);
+				return (ok ? deliverMessage(sourceDesc, id, uncompressedTypeOf(type), bytes, nBytes) : FAILURE);
+			}
+			default:
+				bufferMessage(sourceDesc, id, data, size);
+				return SUCCESS;
+		}
+	}
+
+
 	void Node::bufferMessage(const descriptor_pair & sourceDesc, peer_id id, char * data, size_type size)
 	{
 		auto * q = queues[sourceDesc];
@@ -342,6 +661,69 @@ namespace igcl
 	}
 
 
+	// called by another node of this process. the buffer becomes owned by this node
+	result_type Node::deliverLocal(peer_id sourceId, char * data, size_type size, msg_type type)
+	{
+		if (!knownPeers.idExists(sourceId)) {
+			free(data);
+			return FAILURE;
+		}
+		return deliverMessage(knownPeers.idToDescriptor(sourceId), sourceId, type, data, size);
+	}
+
+
+	// (same, for control messages without payload. see "sendControlType")
+	result_type Node::deliverLocalControl(peer_id sourceId, msg_type type)
+	{
+		if (!knownPeers.idExists(sourceId))
+			return FAILURE;
+		return handleMessage(knownPeers.idToDescriptor(sourceId), sourceId, type);
+	}
+
+
+	// gives a buffer to a node of this process, unless it is being deleted. the buffer becomes owned by it
+	result_type Node::deliverThrough(LocalLink & link, char * data, size_type size, msg_type type)
+	{
+		Node * target = enterLocalLink(link);
+		if (target == NULL) {
+			free(data);
+			return FAILURE;
+		}
+		result_type res = target->deliverLocal(ownId, data, size, type);
+		leaveLocalLink(link);
+		return res;
+	}
+
+
+	result_type Node::deliverControlThrough(LocalLink & link, msg_type type)
+	{
+		Node * target = enterLocalLink(link);
+		if (target == NULL)
+			return FAILURE;
+		result_type res = target->deliverLocalControl(ownId, type);
+		leaveLocalLink(link);
+		return res;
+	}
+
+
+	// the node of a link, which is not deleted before "leaveLocalLink" is called (NULL if it is being deleted)
+	Node * Node::enterLocalLink(LocalLink & link)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(link.mutex);
+		if (link.node != NULL)
+			link.nDeliveries++;
+		return link.node;
+	}
+
+
+	void Node::leaveLocalLink(LocalLink & link)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(link.mutex);
+		if (--link.nDeliveries == 0)
+			link.condVar.notify_all();
+	}
+
+
 	bool Node::existsInQueues(const descriptor_pair & desc)
 	{
 		return queues.count(desc) > 0;
@@ -386,6 +768,496 @@ namespace igcl
 		//std::cout << "qs size " << queues.size() << std::endl;
 	}
 
+	//--------------------------------------------------
+	// In-process nodes
+	//--------------------------------------------------
+
+	// identifies the machine (and boot) this process is running on
+	const std::string & Node::getHostKey()
+	{
+		if (hostKey.empty()) {
+			char hostname[128];
+			gethostname(hostname, sizeof hostname);
+
+			std::string bootId;
+			std::ifstream file("/proc/sys/kernel/random/boot_id");
+			std::getline(file, bootId);
+
+			hostKey = std::string(hostname) + "/" + bootId;
+		}
+		return hostKey;
+	}
+
+
+	std::shared_ptr<Node::LocalLink> Node::findLocalNode(int port)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(localNodesMutex);
+		auto it = localNodes.find(port);
+		return (it == localNodes.end() ? NULL : it->second);
+	}
+
+
+	void Node::setInProcessPeer(const descriptor_pair & desc, const std::shared_ptr<LocalLink> & link)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(inProcessPeersMutex);
+		inProcessPeers[desc] = link;
+	}
+
+
+	std::shared_ptr<Node::LocalLink> Node::getInProcessPeer(const descriptor_pair & desc)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(inProcessPeersMutex);
+		if (inProcessPeers.empty())
+			return NULL;
+		auto it = inProcessPeers.find(desc);
+		return (it == inProcessPeers.end() ? NULL : it->second);
+	}
+
+	//--------------------------------------------------
+	// Control lanes
+	//--------------------------------------------------
+
+	void Node::registerControlLane(const descriptor_pair & desc, int laneFd)
+	{
+		closeControlLane(desc);		// a peer has at most one lane
+
+		int flag = 1;		// (its messages are small and urgent, so they must not wait to be coalesced)
+		setsockopt(laneFd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(controlLanesMutex);
+			controlLanes[desc] = laneFd;
+			controlLaneOwners[laneFd] = desc;
+		}
+		startControlLaneReceiver(laneFd);
+	}
+
+
+	// a new connection is the control lane of a known peer. it is read by its own thread from now on
+	result_type Node::whenControlLaneRegisters(const descriptor_pair & sourceDesc)
+	{
+		int laneFd = sourceDesc.desc;
+		fds.unsetFd(laneFd);
+
+		peer_id id;
+		result_type res = recv_(laneFd, 0, id);
+
+		if (res != SUCCESS or !knownPeers.idExists(id)) {
+			close(laneFd);
+			return SUCCESS;		// lanes are optional, so this is not a failure of the peer
+		}
+
+		TEST() std::cout << "control lane registered (from " << id << ")" << std::endl;
+		registerControlLane(knownPeers.idToDescriptor(id), laneFd);
+		return SUCCESS;
+	}
+
+
+	// returns the lane socket of a peer, or -1 if it has none
+	int Node::getControlLane(const descriptor_pair & desc)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(controlLanesMutex);
+		if (controlLanes.empty())
+			return -1;
+		auto it = controlLanes.find(desc);
+		return (it == controlLanes.end() ? -1 : it->second);
+	}
+
+
+	// the lane's thread notices the shutdown, forgets the lane and closes its socket
+	void Node::closeControlLane(const descriptor_pair & desc)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(controlLanesMutex);
+		auto it = controlLanes.find(desc);
+		if (it != controlLanes.end()) {
+			shutdown(it->second, SHUT_RDWR);
+			controlLaneOwners.erase(it->second);
+			controlLanes.erase(it);
+		}
+	}
+
+
+	void Node::closeControlLanes()
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(controlLanesMutex);
+		for (auto & lane : controlLanes) {
+			shutdown(lane.second, SHUT_RDWR);
+		}
+		controlLanes.clear();
+		controlLaneOwners.clear();
+	}
+
+
+	// sends a message without payload (e.g. a barrier) through the peer's main socket, never through its lane,
+	// so that it cannot overtake the data sent before it. peers of this process get it in-process, like their data
+	result_type Node::sendControlType(const descriptor_pair & desc, msg_type type)
+	{
+		std::shared_ptr<LocalLink> localNode = getInProcessPeer(desc);
+		if (localNode != NULL)
+			return deliverControlThrough(*localNode, type);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(desc));
+		return send_type_(desc.desc, type);
+	}
+
+	//--------------------------------------------------
+	// Send mutexes
+	//--------------------------------------------------
+
+	// the mutex to hold while writing a message to a link. mutexes are never erased, so the reference stays valid.
+	// (sockets that are still being set up are only written by the thread setting them up, and need none)
+	std::mutex & Node::sendMutexOf(const descriptor_pair & desc)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexesMutex);
+		return sendMutexes[desc];
+	}
+
+
+	std::mutex & Node::sendMutexOf(int fd)
+	{
+		return sendMutexOf(descriptor_pair(fd, DESCRIPTOR_SOCK));
+	}
+
+	//--------------------------------------------------
+	// Streams (large messages read while they arrive)
+	//--------------------------------------------------
+
+	result_type Node::waitRecvStreamFrom(peer_id id, StreamHandle * & stream)
+	{
+		if (!knownPeers.idExists(id))
+			return FAILURE;
+
+		BlockingQueue<StreamHandle *> * q;
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+			q = getStreamQueue(id);
+		}
+		result_type res = q->blockingDequeue(stream);
+		if (res == SUCCESS and stream == NULL) {		// (the peer left, and the streams it sent were all read)
+			q->enqueue(NULL);		// (for the next reader)
+			res = FAILURE;
+		}
+		return res;
+	}
+
+
+	// splits "nBytes" into chunks of (at most) "chunkBytes". each chunk is sent once the target read one of the previous ones
+	result_type Node::sendStream(peer_id id, const char * data, uint64_t nBytes, size_type chunkBytes)
+	{
+		if (!knownPeers.idExists(id) or chunkBytes == 0)
+			return FAILURE;
+
+		const descriptor_pair desc = knownPeers.idToDescriptor(id);
+		const uint32_t streamId = nextStreamId++;
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamCreditsMutex);
+			streamCredits[streamId] = STREAM_WINDOW;
+		}
+
+		StreamChunkHeader header;
+		header.streamId = streamId;
+		header.chunkIndex = 0;
+		header.totalBytes = nBytes;
+
+		std::vector<char> chunk(sizeof(header) + std::min((uint64_t) chunkBytes, nBytes));
+		uint64_t offset = 0;
+		result_type res = SUCCESS;
+
+		do {
+			// lock scope
+			{
+				std::unique_lock<std::mutex> uniqueLock(streamCreditsMutex);
+				while (streamCredits[streamId] == 0 and res == SUCCESS) {
+					streamCreditsCondVar.wait_for(uniqueLock, std::chrono::milliseconds(CONTROL_LANE_POLL_MS));
+					if (!knownPeers.idExists(id))
+						res = FAILURE;
+				}
+				if (res == SUCCESS)
+					streamCredits[streamId]--;
+			}
+			if (res != SUCCESS)
+				break;		// (the credits are erased below, as on every other way out)
+
+			size_type n = std::min((uint64_t) chunkBytes, nBytes - offset);
+			memcpy(chunk.data(), &header, sizeof(header));
+			memcpy(chunk.data() + sizeof(header), data + offset, n);
+
+			res = auxiliarySendOfType(desc, STREAM_CHUNK, chunk.data(), (uint) (sizeof(header) + n));
+			offset += n;
+			header.chunkIndex++;
+		} while (offset < nBytes and res == SUCCESS);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(streamCreditsMutex);
+		streamCredits.erase(streamId);
+		return res;
+	}
+
+
+	result_type Node::whenReceivedStreamChunk(peer_id sourceId, char * data, size_type size)
+	{
+		if (size < sizeof(StreamChunkHeader)) {
+			free(data);
+			return FAILURE;
+		}
+
+		StreamChunkHeader header;
+		memcpy(&header, data, sizeof(header));
+		const std::pair<peer_id, uint32_t> key(sourceId, header.streamId);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+		StreamHandle * stream;
+
+		if (header.chunkIndex == 0) {
+			// (handles may be deleted by the application after this node, so they reach it through "streamLink")
+			std::shared_ptr<StreamLink> link = streamLink;
+			uint32_t streamId = header.streamId;
+			stream = new StreamHandle(header.totalBytes,
+				[link, sourceId, streamId]() {
+					std::lock_guard<std::mutex> lockWhileInsideScope(link->mutex);
+					if (link->node != NULL)
+						link->node->sendStreamCredit(sourceId, streamId);
+				},
+				[link, key]() {
+					std::lock_guard<std::mutex> lockWhileInsideScope(link->mutex);
+					if (link->node != NULL)
+						link->node->forgetStream(key);
+				});
+			incomingStreams[key] = stream;
+			getStreamQueue(sourceId)->enqueue(stream);
+		} else {
+			auto it = incomingStreams.find(key);
+			if (it == incomingStreams.end()) {		// (stream was aborted)
+				free(data);
+				return SUCCESS;
+			}
+			stream = it->second;
+		}
+
+		if (stream->push(data, sizeof(header), size - sizeof(header))) {
+			incomingStreams.erase(key);
+		}
+		return SUCCESS;
+	}
+
+
+	result_type Node::whenReceivedStreamCredit(char * data, size_type size)
+	{
+		uint32_t streamId;
+		bool valid = (size == sizeof(streamId));
+		if (valid) {
+			memcpy(&streamId, data, sizeof(streamId));
+		}
+		free(data);
+
+		if (valid) {
+			std::lock_guard<std::mutex> lockWhileInsideScope(streamCreditsMutex);
+			auto it = streamCredits.find(streamId);
+			if (it != streamCredits.end()) {
+				it->second++;
+				streamCreditsCondVar.notify_all();
+			}
+		}
+		return (valid ? SUCCESS : FAILURE);
+	}
+
+
+	// credits are urgent, so that the sender does not wait behind the very chunks it is sending
+	void Node::sendStreamCredit(peer_id id, uint32_t streamId)
+	{
+		if (knownPeers.idExists(id)) {
+			auxiliarySendUrgentOfType(knownPeers.idToDescriptor(id), STREAM_CREDIT, streamId);
+		}
+	}
+
+
+	// a handle was deleted, maybe before its last chunks arrived (which are then dropped). stream ids are never
+	// reused by their sender, so the key is the handle's own
+	void Node::forgetStream(const std::pair<peer_id, uint32_t> & key)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+		incomingStreams.erase(key);
+	}
+
+
+	// (must be called with "streamsMutex" locked)
+	BlockingQueue<StreamHandle *> * Node::getStreamQueue(peer_id id)
+	{
+		auto * & q = streamQueues[id];
+		if (q == NULL) {
+			q = new BlockingQueue<StreamHandle *>();
+		}
+		return q;
+	}
+
+
+	// readers of unfinished streams from a peer that left get FAILURE. streams that had fully arrived can still be
+	// read, and only then do waiting readers get FAILURE too
+	void Node::abortStreamsFrom(peer_id id)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+		for (auto it = incomingStreams.begin(); it != incomingStreams.end(); ) {
+			if (it->first.first == id) {
+				it->second->abort();
+				it = incomingStreams.erase(it);
+			} else {
+				++it;
+			}
+		}
+		getStreamQueue(id)->enqueue(NULL);
+	}
+
+	//--------------------------------------------------
+	// Compression
+	//--------------------------------------------------
+
+	// links inside the host (shared memory, in-process) and relayed ones are never compressed
+	size_type Node::getCompressionThreshold(const descriptor_pair & desc)
+	{
+		if (desc.type != DESCRIPTOR_SOCK and desc.type != DESCRIPTOR_NICE and desc.type != DESCRIPTOR_UDP)
+			return 0;
+		if (getInProcessPeer(desc) != NULL)
+			return 0;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(compressionMutex);
+		if (peerCompressionThresholds.empty())
+			return compressionThreshold;
+		auto it = peerCompressionThresholds.find(desc);
+		return (it == peerCompressionThresholds.end() ? compressionThreshold : it->second);
+	}
+
+
+	// type of the compressed form of a message (NONE for messages that are never compressed)
+	msg_type Node::compressedTypeOf(msg_type type)
+	{
+		switch (type) {
+			case SEND_TO_PEER:	return SEND_TO_PEER_COMPRESSED;
+			case STREAM_CHUNK:	return STREAM_CHUNK_COMPRESSED;
+			default:			return NONE;
+		}
+	}
+
+
+	msg_type Node::uncompressedTypeOf(msg_type type)
+	{
+		switch (type) {
+			case SEND_TO_PEER_COMPRESSED:	return SEND_TO_PEER;
+			case STREAM_CHUNK_COMPRESSED:	return STREAM_CHUNK;
+			default:						return NONE;
+		}
+	}
+
+
+	// the types that may be sent through a control lane (see auxiliarySendUrgentOfType)
+	bool Node::isUrgentType(msg_type type)
+	{
+		switch (type) {
+			case SEND_TO_PEER:
+			case STREAM_CREDIT:
+			case WORK_STEAL:
+			case WORK_GIVEN:
+			case WORK_DONE:
+			case WORK_FINISHED:
+			case BOUND_UPDATE:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	//--------------------------------------------------
+	// Work stealing
+	//--------------------------------------------------
+
+	// work stealing messages are urgent, so that idle nodes do not wait behind bulk data
+	result_type Node::sendWorkMessage(peer_id id, msg_type type, const WorkMessage & msg)
+	{
+		if (!knownPeers.idExists(id))
+			return FAILURE;
+		return auxiliarySendUrgentOfType(knownPeers.idToDescriptor(id), type, msg);
+	}
+
+
+	result_type Node::whenReceivedWorkMessage(peer_id sourceId, msg_type type, char * data, size_type size)
+	{
+		WorkMessage msg;
+		bool valid = (size == sizeof(msg));
+		if (valid) {
+			memcpy(&msg, data, sizeof(msg));
+		}
+		free(data);
+		if (!valid)
+			return FAILURE;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(workStealingMutex);
+		if (workStealing != NULL)
+			return workStealing->whenReceived(sourceId, type, msg);
+		return SUCCESS;		// (this node has no jobs to give. thieves stop waiting for an answer after a while)
+	}
+
+	//--------------------------------------------------
+	// Shared bound
+	//--------------------------------------------------
+
+	// bound updates are urgent too, since every moment a search runs with an old bound is wasted
+	result_type Node::sendBoundMessage(peer_id id, const BoundMessage & msg)
+	{
+		if (!knownPeers.idExists(id))
+			return FAILURE;
+		return auxiliarySendUrgentOfType(knownPeers.idToDescriptor(id), BOUND_UPDATE, msg);
+	}
+
+
+	result_type Node::whenReceivedBoundMessage(peer_id sourceId, char * data, size_type size)
+	{
+		BoundMessage msg;
+		bool valid = (size == sizeof(msg));
+		if (valid) {
+			memcpy(&msg, data, sizeof(msg));
+		}
+		free(data);
+		if (!valid)
+			return FAILURE;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(sharedBoundMutex);
+		if (sharedBound != NULL)
+			return sharedBound->whenReceived(sourceId, msg);
+		return SUCCESS;		// (ignored if this node does not share a bound)
+	}
+
+	//--------------------------------------------------
+	// Migrants
+	//--------------------------------------------------
+
+	result_type Node::sendMigrantsTo(peer_id id, const char * data, uint size)
+	{
+		if (!knownPeers.idExists(id))
+			return FAILURE;
+		return auxiliarySendOfType(knownPeers.idToDescriptor(id), MIGRANTS, data, size);
+	}
+
+
+	// (does not block. the buffer becomes owned by the caller)
+	result_type Node::tryRecvMigrants(peer_id & id, char * & data, uint & size)
+	{
+		std::pair<peer_id, QUEUED_TYPE> elem;
+		result_type res = migrantsQueue.dequeue(elem);
+		if (res == SUCCESS) {
+			id = elem.first;
+			data = (char *) elem.second.first;
+			size = elem.second.second;
+		}
+		return res;
+	}
+
+
+	result_type Node::whenReceivedMigrants(peer_id sourceId, char * data, size_type size)
+	{
+		QUEUED_TYPE elem(data, size);
+		migrantsQueue.enqueue(std::make_pair(sourceId, elem));
+		return SUCCESS;
+	}
+
 	//--------------------------------------------------
 	// Termination methods
 	//--------------------------------------------------
@@ -417,6 +1289,15 @@ namespace igcl
 		for (auto & q : queues) {
 			q.second->forceQuit();
 		}
+		migrantsQueue.forceQuit();
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(streamsMutex);
+		for (auto & stream : incomingStreams) {
+			stream.second->abort();
+		}
+		for (auto & q : streamQueues) {
+			q.second->forceQuit();
+		}
 	}
 
 	//--------------------------------------------------
@@ -428,6 +1309,13 @@ namespace igcl
 		if (knownPeers.idExists(id)) {
 			std::cout << "Node::deregisterPeer" << std::endl;
 			removePeerQueues(sourceDesc);
+			closeControlLane(sourceDesc);
+			abortStreamsFrom(id);
+
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(inProcessPeersMutex);
+				inProcessPeers.erase(sourceDesc);
+			}
 
 			auto it = std::find(prevPeers.begin(), prevPeers.end(), id);
 			if (it != prevPeers.end()) {
@@ -444,6 +1332,28 @@ namespace igcl
 	}
 
 
+	void Node::markFailed(const descriptor_pair & desc)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(failedPeersMutex);
+		failedPeers.insert(desc);
+	}
+
+
+	// acts on the failures marked until now (by any thread), each once
+	void Node::actOnFailedPeers()
+	{
+		std::set<descriptor_pair> failed;
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(failedPeersMutex);
+			failed.swap(failedPeers);
+		}
+		for (const descriptor_pair & desc : failed) {
+			actOnFailure(desc);	// virtual call
+		}
+	}
+
+
 	void Node::actOnFailure(const descriptor_pair & sourceDesc)
 	{
 		std::cout << "Node::actOnFailure" << std::endl;
@@ -452,12 +1362,26 @@ namespace igcl
 			close(sourceDesc.desc);
 			fds.unsetFd(sourceDesc.desc);
 		}
-		else if (sourceDesc.type == DESCRIPTOR_SOCK)
+#ifndef DISABLE_SHARED_MEMORY
+		else if (sourceDesc.type == DESCRIPTOR_SHM)
 		{
-#ifndef DISABLE_LIBNICE
-			instance->receivedData.erase(sourceDesc.desc);
+			shm.close(sourceDesc.desc);
+		}
 #endif
+#ifndef DISABLE_UDP
+		else if (sourceDesc.type == DESCRIPTOR_UDP)
+		{
+			udp.close(sourceDesc.desc);
 		}
+#endif
+#ifndef DISABLE_LIBNICE
+		else if (sourceDesc.type == DESCRIPTOR_NICE)
+		{
+			NiceReceivedData & data = getReceivedData(sourceDesc.desc);		// (a new stream may reuse its id)
+			free(data.bytes);
+			data = NiceReceivedData();
+		}
+#endif
 	}
 
 	//--------------------------------------------------
@@ -2,6 +2,10 @@
 #define NODE_HPP_
 
 #include "BlockingQueue.hpp"
+#include "StreamHandle.hpp"
+#include "CompressionHelper.hpp"
+#include "WorkStealing.hpp"
+#include "SharedBound.hpp"
 #include "Communication.hpp"
 #include "Common.hpp"
 #include "Debug.hpp"
@@ -15,17 +19,28 @@
 #include <set>
 #include <algorithm>
 #include <functional>
+#include <atomic>
+#include <memory>
 
 
 namespace igcl
 {
 	class Node : public Communication
 	{
+		friend class WorkStealing;
+		friend class SharedBound;
+
 		// ======================================================
 		// ==================== DEFINITIONS =====================
 		// ======================================================
 
-#define LOG_AND_QUIT_IF_UNSUCCESSFUL(res,desc) if ((res) != igcl::SUCCESS) { failedPeers.insert(desc); return (res); }
+#define LOG_AND_QUIT_IF_UNSUCCESSFUL(res,desc) if ((res) != igcl::SUCCESS) { markFailed(desc); return (res); }
+
+		static const int CONTROL_LANE_POLL_MS = 200;		// lane threads check "shouldStop" this often
+	public:
+		static const size_type STREAM_CHUNK_BYTES = 1 << 20;
+		static const uint STREAM_WINDOW = 8;				// chunks of a stream that may be unread by the receiver
+	private:
 
 #ifndef DISABLE_LIBNICE
 		struct NiceReceivedData
@@ -43,6 +58,27 @@ namespace igcl
 		};
 #endif
 
+		// what the stream handles of a node know of it. "node" is cleared when the node is deleted, so that
+		// handles that outlive it neither give credits through it nor tell it that they were deleted
+		struct StreamLink
+		{
+			std::mutex mutex;
+			Node * node;
+		};
+
+	protected:
+		// how the other nodes of this process reach a node. "node" is cleared when the node is deleted, which then
+		// waits until no delivery into it is running
+		struct LocalLink
+		{
+			std::mutex mutex;
+			std::condition_variable condVar;
+			Node * node;
+			uint nDeliveries;
+		};
+
+	private:
+
 		typedef std::pair<void *, int> QUEUED_TYPE;
 		typedef std::pair<peer_id, BlockingQueue<QUEUED_TYPE> *> MAIN_QUEUED_TYPE;
 
@@ -59,15 +95,54 @@ namespace igcl
 		PeerTable knownPeers;
 		std::vector<peer_id> prevPeers, nextPeers;
 		std::set<descriptor_pair> failedPeers;
+		std::mutex failedPeersMutex;		// (receiver threads of every transport add to it)
+
+		std::string hostKey;
+		std::map<descriptor_pair, std::shared_ptr<LocalLink> > inProcessPeers;		// peers that live in this same process
+		std::mutex inProcessPeersMutex;
+		std::shared_ptr<LocalLink> localLink;
+		static std::map<int, std::shared_ptr<LocalLink> > localNodes;			// every node of this process, by listening port
+		static std::mutex localNodesMutex;
+
+		std::map<descriptor_pair, int> controlLanes;			// second socket of a peer, for small urgent messages
+		std::map<int, descriptor_pair> controlLaneOwners;		// (lane socket -> peer's main descriptor)
+		std::mutex controlLanesMutex;
+
+		std::map<descriptor_pair, std::mutex> sendMutexes;		// held while a whole message is written to a link
+		std::mutex sendMutexesMutex;
+
+		std::map<peer_id, BlockingQueue<StreamHandle *> *> streamQueues;			// streams started by each peer
+		std::map<std::pair<peer_id, uint32_t>, StreamHandle *> incomingStreams;		// (while chunks are still arriving)
+		std::mutex streamsMutex;
+		std::map<uint32_t, uint> streamCredits;		// chunks that each outgoing stream may still send
+		std::mutex streamCreditsMutex;
+		std::condition_variable streamCreditsCondVar;
+		std::atomic<uint32_t> nextStreamId;
+		std::shared_ptr<StreamLink> streamLink;
+
+		BlockingQueue<std::pair<peer_id, QUEUED_TYPE> > migrantsQueue;
+
+		CompressionHelper compression;
+		size_type compressionThreshold;								// (0 if disabled)
+		std::map<descriptor_pair, size_type> peerCompressionThresholds;
+		std::mutex compressionMutex;
+
+		WorkStealing * workStealing;		// (NULL unless the application created one for this node)
+		std::mutex workStealingMutex;
+		SharedBound * sharedBound;			// (same)
+		std::mutex sharedBoundMutex;
 
 		std::thread * receiverThread;
 		bool shouldStop;
+		bool loopRunning;		// the receiver thread is detached, so its end is signalled through stopCondVar
+		uint nLaneThreads;		// (as are the ends of control lane threads)
+		uint nChannelThreads;	// (and of shared memory and udp receiver threads)
 		std::mutex stopMutex;
 		std::condition_variable stopCondVar;
 
 #ifndef DISABLE_LIBNICE
-		static std::map<uint, NiceReceivedData> receivedData;
-		static Node * instance;
+		std::vector<NiceReceivedData *> receivedData;		// indexed by stream id (streams are received by several threads)
+		std::mutex receivedDataMutex;
 #endif
 
 	private:
@@ -84,7 +159,16 @@ namespace igcl
 
 		void hang();
 		peer_id getId();
+		int getPort();
+		std::vector<peer_id> getPeerIds();
 		virtual uint getNPeers() = 0;
+#ifndef DISABLE_UDP
+		void setUdpEmulation(double lossRate, uint delayMs, uint jitterMs = 0);
+		std::string getUdpStats();
+#endif
+		void setCompression(size_type minBytes);
+		void setCompressionFor(peer_id id, size_type minBytes);
+		std::string getCompressionStats();
 
 		virtual void start() = 0;
 		virtual void terminate() = 0;
@@ -95,11 +179,31 @@ namespace igcl
 		void loop();
 		result_type doSelect(const timespec & timeout);
 		result_type processMessage(const descriptor_pair & sourceDesc);
+		result_type processMessageOfType(const descriptor_pair & sourceDesc, msg_type type, char * payload = NULL, size_type payloadSize = 0);
+#ifndef DISABLE_SHARED_MEMORY
+		void startSharedMemoryReceiver(int channelId);
+		void sharedMemoryLoop(int channelId);
+#endif
+#ifndef DISABLE_UDP
+		void startUdpReceiver(int channelId);
+		void udpLoop(int channelId);
+#endif
 #ifndef DISABLE_LIBNICE
 		static void libniceRecv(NiceAgent * agent, guint stream_id, guint component_id, guint len, gchar * buf, gpointer user_data);
+		NiceReceivedData & getReceivedData(uint streamId);
 #endif
 
+		void startControlLaneReceiver(int laneFd);
+		void controlLaneLoop(int laneFd);
+
+		result_type deliverMessage(const descriptor_pair & sourceDesc, peer_id id, msg_type type, char * data, size_type size);
 		void bufferMessage(const descriptor_pair & sourceDesc, peer_id id, char * data, size_type size);
+		result_type deliverLocal(peer_id sourceId, char * data, size_type size, msg_type type = SEND_TO_PEER);
+		result_type deliverLocalControl(peer_id sourceId, msg_type type);
+		result_type deliverThrough(LocalLink & link, char * data, size_type size, msg_type type = SEND_TO_PEER);
+		result_type deliverControlThrough(LocalLink & link, msg_type type);
+		static Node * enterLocalLink(LocalLink & link);
+		static void leaveLocalLink(LocalLink & link);
 		bool existsInQueues(const descriptor_pair & desc);
 		void preparePeerQueues(const descriptor_pair & desc);
 		void removePeerQueues(const descriptor_pair & desc);
@@ -111,8 +215,46 @@ namespace igcl
 		virtual result_type handleMessage(const descriptor_pair & sourceDesc, peer_id id, msg_type type) = 0;
 		virtual void deregisterPeer(const descriptor_pair & sourceDesc, peer_id id);
 		virtual void actOnFailure(const descriptor_pair & sourceDesc);
+		void markFailed(const descriptor_pair & desc);
+		void actOnFailedPeers();
 		virtual int getCoordinatorFd() = 0;
 
+		const std::string & getHostKey();
+		static std::shared_ptr<LocalLink> findLocalNode(int port);
+		void setInProcessPeer(const descriptor_pair & desc, const std::shared_ptr<LocalLink> & link);
+		std::shared_ptr<LocalLink> getInProcessPeer(const descriptor_pair & desc);
+
+		void registerControlLane(const descriptor_pair & desc, int laneFd);
+		result_type whenControlLaneRegisters(const descriptor_pair & sourceDesc);
+		int getControlLane(const descriptor_pair & desc);
+		void closeControlLane(const descriptor_pair & desc);
+		void closeControlLanes();
+		result_type sendControlType(const descriptor_pair & desc, msg_type type);
+
+		std::mutex & sendMutexOf(const descriptor_pair & desc);
+		std::mutex & sendMutexOf(int fd);
+
+		result_type sendStream(peer_id id, const char * data, uint64_t nBytes, size_type chunkBytes);
+		result_type whenReceivedStreamChunk(peer_id sourceId, char * data, size_type size);
+		result_type whenReceivedStreamCredit(char * data, size_type size);
+		void sendStreamCredit(peer_id id, uint32_t streamId);
+		void forgetStream(const std::pair<peer_id, uint32_t> & key);
+		BlockingQueue<StreamHandle *> * getStreamQueue(peer_id id);
+		void abortStreamsFrom(peer_id id);
+
+		size_type getCompressionThreshold(const descriptor_pair & desc);
+		static msg_type compressedTypeOf(msg_type type);
+		static msg_type uncompressedTypeOf(msg_type type);
+		static bool isUrgentType(msg_type type);
+
+		result_type sendWorkMessage(peer_id id, msg_type type, const WorkMessage & msg);
+		result_type whenReceivedWorkMessage(peer_id sourceId, msg_type type, char * data, size_type size);
+
+		result_type sendBoundMessage(peer_id id, const BoundMessage & msg);
+		result_type whenReceivedBoundMessage(peer_id sourceId, char * data, size_type size);
+
+		result_type whenReceivedMigrants(peer_id sourceId, char * data, size_type size);
+
 		//--------------------------------------------------
 		// Helpers
 		//--------------------------------------------------
@@ -138,17 +280,12 @@ namespace igcl
 		result_type waitRecvFromAny(peer_id & id, T & value)
 		{
 			static_assert(!std::is_pointer<T>::value, "T must be non-pointer");
-			T * data = NULL; uint size = 0;
+			char * data = NULL; uint size = 0;
 			result_type res = waitRecvFromMainQueue(id, data, size);
 
-			if (size != sizeof(value)) {
-				free(data);
-				return FAILURE;
-			}
-
-			value = *data;
+			bool ok = (res == SUCCESS and Encoded<T>::decode(data, size, value));
 			free(data);
-			return res;
+			return (ok ? res : FAILURE);
 		}
 
 
@@ -180,20 +317,15 @@ namespace igcl
 			const descriptor_pair desc = knownPeers.idToDescriptor(id);
 			BlockingQueue<QUEUED_TYPE> * q = queues[desc];
 
-			T * data = NULL; uint size = 0;
+			char * data = NULL; uint size = 0;
 			result_type res = waitRecvFromQueue(q, data, size);
 
-			if (size != sizeof(value)) {
-				free(data);
-				return FAILURE;
-			}
-
-			value = *data;
+			bool ok = (res == SUCCESS and Encoded<T>::decode(data, size, value));
 			free(data);
 
 			invalidateFrontMainQueueReferencesTo(q, invalidReferences[q]);
 
-			return res;
+			return (ok ? res : FAILURE);
 		}
 
 
@@ -231,18 +363,13 @@ namespace igcl
 		template<typename T>
 		result_type tryRecvFromAny(peer_id & id, T & value)
 		{
-			T * data = NULL; uint size = 0;
+			char * data = NULL; uint size = 0;
 			result_type res = tryRecvFromMainQueue(id, data, size);
 			QUIT_IF_UNSUCCESSFUL(res);
 
-			if (size != sizeof(value)) {
-				free(data);
-				return FAILURE;
-			}
-
-			value = *data;
+			bool ok = Encoded<T>::decode(data, size, value);
 			free(data);
-			return res;
+			return (ok ? res : FAILURE);
 		}
 
 
@@ -272,17 +399,14 @@ namespace igcl
 			descriptor_pair desc = knownPeers.idToDescriptor(id);
 			BlockingQueue<QUEUED_TYPE> * q = queues[desc];
 
-			T * data; uint size;
+			char * data; uint size;
 			result_type res = tryRecvFromQueue(q, data, size);
 			QUIT_IF_UNSUCCESSFUL(res);
 
-			if (size != sizeof(value)) {
-				free(data);
-				return FAILURE;
-			}
-
-			value = *data;
+			bool ok = Encoded<T>::decode(data, size, value);
 			free(data);
+			if (!ok)
+				return FAILURE;
 
 			invalidateFrontMainQueueReferencesTo(q, invalidReferences[q]);
 
@@ -356,6 +480,28 @@ namespace igcl
 		}
 
 
+		// sends an array allocated with malloc, whose ownership passes to the library.
+		// for peers in the same process the array is handed over without being copied
+		template <typename T>
+		result_type sendNewTo(peer_id id, T * data, uint size)
+		{
+			if (!knownPeers.idExists(id)) {
+				free(data);
+				return FAILURE;
+			}
+
+			const descriptor_pair desc = knownPeers.idToDescriptor(id);
+			std::shared_ptr<LocalLink> localNode = getInProcessPeer(desc);
+			if (localNode != NULL) {
+				return deliverThrough(*localNode, (char *) data, size*sizeof(T));
+			}
+
+			result_type res = auxiliarySendTo(desc, data, size);
+			free(data);
+			return res;
+		}
+
+
 		template <typename ...T>
 		result_type sendToAll(T && ...data)
 		{
@@ -407,29 +553,170 @@ namespace igcl
 		}
 
 
+		// like sendTo, but the message does not wait behind bulk data that is still being sent to the
+		// same peer (it may overtake messages sent before it). meant for small, latency-sensitive messages
+		template <typename ...T>
+		result_type sendUrgentTo(peer_id id, T && ...data)
+		{
+			if (!knownPeers.idExists(id))
+				return FAILURE;
+
+			return auxiliarySendUrgentTo(knownPeers.idToDescriptor(id), std::forward<T>(data)...);
+		}
+
+
+		template <typename ...T>
+		result_type sendUrgentToAll(T && ...data)
+		{
+			result_type res, final = SUCCESS;
+
+			for (const descriptor_pair & desc : knownPeers.getAllDescriptors()) {
+				res = auxiliarySendUrgentTo(desc, std::forward<T>(data)...);
+				if (res != SUCCESS) {
+					final = res;
+				}
+			}
+
+			return final;
+		}
+
+
+		// sends "count" elements as a stream of chunks, which the target reads while they arrive (see StreamHandle).
+		// the total size may exceed SIZE_TYPE_MAX. blocks while the target has STREAM_WINDOW unread chunks.
+		// streams cannot be relayed by the coordinator
+		template <typename T>
+		result_type sendStreamTo(peer_id id, const T * data, uint64_t count, size_type chunkBytes = STREAM_CHUNK_BYTES)
+		{
+			static_assert(!std::is_pointer<T>::value, "T must be non-pointer");
+			chunkBytes -= chunkBytes % sizeof(T);		// chunks hold whole elements
+			return sendStream(id, (const char *) data, count * sizeof(T), chunkBytes);
+		}
+
+
+		result_type waitRecvStreamFrom(peer_id id, StreamHandle * & stream);
+
+
+		// migrants of a genetic algorithm (see tsp/Migration) have a queue of their own, so that they are never
+		// mixed with the messages of the application. like streams, they cannot be relayed by the coordinator
+		result_type sendMigrantsTo(peer_id id, const char * data, uint size);
+		result_type tryRecvMigrants(peer_id & id, char * & data, uint & size);
+
+
 	private:
+		template <typename ...T>
+		result_type auxiliarySendUrgentTo(const descriptor_pair & desc, T && ...data)
+		{
+			return auxiliarySendUrgentOfType(desc, SEND_TO_PEER, std::forward<T>(data)...);
+		}
+
+
+		template <typename ...T>
+		result_type auxiliarySendUrgentOfType(const descriptor_pair & desc, msg_type type, T && ...data)
+		{
+			int laneFd = getControlLane(desc);
+
+			if (laneFd >= 0 and getInProcessPeer(desc) == NULL)
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(laneFd));
+				result_type res;
+				res = send_type_(laneFd, type);
+				res = send_(laneFd, std::forward<T>(data)...);
+				return res;
+			}
+#ifndef DISABLE_UDP
+			else if (desc.type == DESCRIPTOR_UDP)
+			{
+				return udp_send_(desc.desc, CONTROL_LANE, type, std::forward<T>(data)...);
+			}
+#endif
+			// in-process peers have no lanes to wait in. shared memory, libnice and relayed peers have a single one
+			return auxiliarySendOfType(desc, type, std::forward<T>(data)...);
+		}
+
+
 		template <typename ...T>
 		result_type auxiliarySendTo(const descriptor_pair & desc, T && ...data)
+		{
+			return auxiliarySendOfType(desc, SEND_TO_PEER, std::forward<T>(data)...);
+		}
+
+
+		template <typename ...T>
+		result_type auxiliarySendOfType(const descriptor_pair & desc, msg_type type, T && ...data)
+		{
+			result_type res;
+
+			const void * bytes;
+			size_type nBytes;
+			msg_type packedType = compressedTypeOf(type);
+
+			if (packedType != NONE and payloadBytes(bytes, nBytes, data...))
+			{
+				size_type threshold = getCompressionThreshold(desc);
+				char * packed;
+				size_type packedBytes;
+
+				if (threshold > 0 and nBytes >= threshold and compression.pack(bytes, nBytes, packed, packedBytes)) {
+					res = sendMessage(desc, packedType, packed, packedBytes);
+					free(packed);
+					return res;
+				}
+			}
+
+			return sendMessage(desc, type, std::forward<T>(data)...);
+		}
+
+
+		// writes the type and payload of a message to the link of a peer. links are written by several threads
+		// (user, receiver, stream readers, library services), so a whole message is written under the link's
+		// send mutex, or its pieces would interleave with those of other messages
+		template <typename ...T>
+		result_type sendMessage(const descriptor_pair & desc, msg_type type, T && ...data)
 		{
 			result_type res;
 
-			if (desc.type == DESCRIPTOR_SOCK)
+			std::shared_ptr<LocalLink> localNode = getInProcessPeer(desc);
+			if (localNode != NULL)
+			{
+				res = local_send_(*localNode, type, std::forward<T>(data)...);
+			}
+			else if (desc.type == DESCRIPTOR_SOCK)
 			{
 				int fd = desc.desc;
-				res = send_type_(fd, SEND_TO_PEER);
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(desc));
+				res = send_type_(fd, type);
 				res = send_(fd, std::forward<T>(data)...);
 			}
 #ifndef DISABLE_LIBNICE
 			else if (desc.type == DESCRIPTOR_NICE)
 			{
 				uint streamId = desc.desc;
-				res = nice_send_type_(streamId, SEND_TO_PEER);
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(desc));
+				res = nice_send_type_(streamId, type);
 				res = nice_send_(streamId, data...);
 			}
 #endif
+#ifndef DISABLE_SHARED_MEMORY
+			else if (desc.type == DESCRIPTOR_SHM)
+			{
+				res = shm_send_(desc.desc, type, std::forward<T>(data)...);		// (one call per message)
+			}
+#endif
+#ifndef DISABLE_UDP
+			else if (desc.type == DESCRIPTOR_UDP)
+			{
+				// (one call per message. every message goes in the stream of its lane, since those of a lane
+				// must arrive in the order they were sent)
+				res = udp_send_(desc.desc, DATA_LANE, type, std::forward<T>(data)...);
+			}
+#endif
+			else if (type != SEND_TO_PEER) {
+				res = FAILURE;		// the coordinator only relays user messages
+			}
 			else {
 				const int & coordinatorFd = getCoordinatorFd();
 				peer_id id = knownPeers.descriptorToId(desc);
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 				res = send_type_(coordinatorFd, SEND_TO_PEER_RELAYED);
 				res = send_(coordinatorFd, id);
 				res = send_(coordinatorFd, std::forward<T>(data)...);
@@ -438,6 +725,54 @@ namespace igcl
 			return res;
 		}
 
+		// gets the bytes of an array payload (the only kind worth compressing)
+		template <typename P, typename S>
+		static bool payloadBytes(const void * & bytes, size_type & nBytes, P * data, S size)
+		{
+			bytes = data;
+			nBytes = size * sizeof(P);
+			return true;
+		}
+
+
+		template <typename ...T>
+		static bool payloadBytes(const void * &, size_type &, T && ...)
+		{
+			return false;
+		}
+
+		//--------------------------------------------------
+		// In-process send methods
+		//--------------------------------------------------
+
+	protected:
+		// copies an array of data of size "size" to a new buffer, which is given to the target node
+		template<typename T>
+		result_type local_send_(LocalLink & target, msg_type type, const T * const data, uint size)
+		{
+			static_assert(!std::is_pointer<T>::value, "T must be non-pointer");
+			size_type nBytes = size*sizeof(T);
+			char * bytes = (char *) malloc(nBytes);
+			memcpy(bytes, data, nBytes);
+			return deliverThrough(target, bytes, nBytes, type);
+		}
+
+
+		// sends a (non-pointer) value (serialized if it is not trivially copyable)
+		template<typename T>
+		result_type local_send_(LocalLink & target, msg_type type, const T & value)
+		{
+			Encoded<T> encoded(value);
+			return local_send_(target, type, encoded.data(), encoded.size());
+		}
+
+
+		// sends a std::string
+		result_type local_send_(LocalLink & target, msg_type type, const std::string & value)
+		{
+			return local_send_(target, type, value.c_str(), value.length());
+		}
+
 		//--------------------------------------------------
 		// Main-queue message receive methods
 		//--------------------------------------------------
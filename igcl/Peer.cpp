@@ -49,7 +49,7 @@ namespace igcl
 		result_type res;
 		canExitBarrier = false;
 
-		res = send_type_(coordinatorFd, BARRIER);
+		res = sendControlType(descriptor_pair(coordinatorFd, DESCRIPTOR_SOCK), BARRIER);
 		QUIT_IF_UNSUCCESSFUL(res);
 
 		std::unique_lock<std::mutex> lock(barrierMutex);
@@ -82,6 +82,7 @@ namespace igcl
 #ifndef DISABLE_LIBNICE
 		nice.quit();
 #endif
+		closeControlLanes();
 
 		for (descriptor_pair desc : knownPeers.getAllDescriptors()) {
 			if (desc.type == DESCRIPTOR_SOCK) {
@@ -89,6 +90,16 @@ namespace igcl
 			} else if (desc.type == DESCRIPTOR_NICE) {
 				// terminating the NiceAgent object is enough
 			}
+#ifndef DISABLE_SHARED_MEMORY
+			else if (desc.type == DESCRIPTOR_SHM) {
+				shm.close(desc.desc);
+			}
+#endif
+#ifndef DISABLE_UDP
+			else if (desc.type == DESCRIPTOR_UDP) {
+				udp.close(desc.desc);
+			}
+#endif
 		}
 		if (coordinatorFd >= 0) {
 			close(coordinatorFd);
@@ -140,6 +151,16 @@ namespace igcl
 		if (descType == DESCRIPTOR_SOCK) {
 			fds.setFd(descriptor);
 		}
+#ifndef DISABLE_SHARED_MEMORY
+		else if (descType == DESCRIPTOR_SHM) {
+			startSharedMemoryReceiver(descriptor);
+		}
+#endif
+#ifndef DISABLE_UDP
+		else if (descType == DESCRIPTOR_UDP) {
+			startUdpReceiver(descriptor);
+		}
+#endif
 	}
 
 
@@ -162,7 +183,14 @@ namespace igcl
 
 		coordinatorFd = connectToPeer(coordinatorAddr, true);
 
-		res = send_type_(coordinatorFd, REGISTER);
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
+			res = send_type_(coordinatorFd, REGISTER);
+			res = send_(coordinatorFd, ownAddr.port);		// identifies this peer in the coordinator's connection cache
+			res = send_(coordinatorFd, getHostKey());		// host and process are used to detect an in-process coordinator
+			res = send_(coordinatorFd, (int) getpid());
+		}
 		QUIT_IF_UNSUCCESSFUL(res);
 
 		res = recv_(coordinatorFd, 0, ownId);			// receive registration ID
@@ -210,7 +238,30 @@ namespace igcl
 			this->nextPeers.assign(connectable.begin(), connectable.end());		// when there's no layout, all connectable peers are considered to be "next"
 		}
 
+		// receive how each connectable peer was last reached (if known), in the same order
+		connection_type * hints_array;
+		uint hintsSize = 0;
+
+		res = recv_new_(coordinatorFd, 0, hints_array, hintsSize);
+		QUIT_IF_UNSUCCESSFUL(res);
+		for (uint i=0; i<hintsSize and i<connectableSize; ++i) {
+			if (hints_array[i] != CONNECTION_UNKNOWN) {
+				connectionHints[connectable_array[i]] = hints_array[i];
+			}
+		}
+
 		free(connectable_array);
+		free(hints_array);
+
+		bool coordinatorInProcess = false;
+		res = recv_(coordinatorFd, 0, coordinatorInProcess);
+		QUIT_IF_UNSUCCESSFUL(res);
+
+		std::shared_ptr<LocalLink> coordinatorNode = (coordinatorInProcess ? findLocalNode(coordinatorAddr.port) : NULL);
+		if (coordinatorNode != NULL) {
+			TEST() std::cout << "coordinator is in the same process. using in-process transport" << std::endl;
+			setInProcessPeer(descriptor_pair(coordinatorFd, DESCRIPTOR_SOCK), coordinatorNode);
+		}
 
 		TEST() {
 			std::cout << "connectable peers:" << std::endl;
@@ -219,16 +270,44 @@ namespace igcl
 			std::cout << "---------------------" << std::endl;
 		}
 
+		openControlLane(descriptor_pair(coordinatorFd, DESCRIPTOR_SOCK), coordinatorAddr);	// for barriers
+
 		return res;
 	}
 
 
+	// opens a second connection to a peer (or the coordinator), through which urgent messages
+	// overtake the bulk data of the main one. everything still works without it
+	void Peer::openControlLane(const descriptor_pair & desc, const address & addr)
+	{
+		int laneFd = connectToPeer(addr, false);
+		if (laneFd < 0)
+			return;
+
+		result_type res;
+		res = send_type_(laneFd, REGISTER_CONTROL_LANE);
+		res = send_(laneFd, ownId);
+		if (res != SUCCESS) {
+			close(laneFd);
+			return;
+		}
+
+		registerControlLane(desc, laneFd);
+	}
+
+
 	result_type Peer::establishNextConnectionIfAvailable()
 	{
 		if (connectable.size() > 0) {
 			auto it = connectable.begin();
 			peer_id next = *it;
 			connectable.erase(it);
+#ifndef FORCE_RELAYED
+			auto hint = connectionHints.find(next);
+			if (hint != connectionHints.end()) {
+				return requestHintedConnectionTo(next, hint->second);
+			}
+#endif
 #ifdef FORCE_LIBNICE
 	#ifndef DISABLE_LIBNICE
 			return requestNiceConnectionTo(next);	// this forces libnice for tests
@@ -262,6 +341,7 @@ namespace igcl
 #endif
 
 		this->ready = true;
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 		res = send_type_(coordinatorFd, READY);
 		std::cout << "ready" << std::endl;
 
@@ -275,6 +355,7 @@ namespace igcl
 
 		// try to connect with normal sockets
 		TEST() std::cout << "requestNormalConnectionTo " << id << std::endl;
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 		res = send_type_(coordinatorFd, REQUEST_PEER_CREDENTIALS);
 		res = send_(coordinatorFd, id);
 		TEST() std::cout << "sent request for creds" << std::endl;
@@ -290,13 +371,17 @@ namespace igcl
 
 		// try to connect with libnice
 		TEST() std::cout << "requestNiceConnectionTo " << id << std::endl;
-		res = send_type_(coordinatorFd, REQUEST_NICE_PEER_CREDENTIALS);
-		res = send_(coordinatorFd, id);
-
 		uint streamId;
 		std::string localInfo;
 		nice.startNewStream(streamId, localInfo);
-		res = send_(coordinatorFd, localInfo);
+
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
+			res = send_type_(coordinatorFd, REQUEST_NICE_PEER_CREDENTIALS);
+			res = send_(coordinatorFd, id);
+			res = send_(coordinatorFd, localInfo);
+		}
 		TEST() std::cout << "sent request for creds" << std::endl;
 
 		streamsForConnections[id] = streamId;
@@ -317,9 +402,15 @@ namespace igcl
 			knownPeers.registerPeer(desc, id);
 			preparePeerQueues(desc);
 
-			res = send_type_(coordinatorFd, SET_RELAYED_CONNECTION);
-			res = send_(coordinatorFd, id);
+			// lock scope
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
+				res = send_type_(coordinatorFd, SET_RELAYED_CONNECTION);
+				res = send_(coordinatorFd, id);
+			}
+			res = reportConnectionType(id, CONNECTION_RELAYED);
 		} else if (!this->usingFreeformLayout) {
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 			res = send_type_(coordinatorFd, DEREGISTER);
 			res = FAILURE;
 		}
@@ -329,6 +420,195 @@ namespace igcl
 		return res;
 	}
 
+	// tries first the connection type that previously succeeded with this peer
+	result_type Peer::requestHintedConnectionTo(peer_id id, connection_type hint)
+	{
+		TEST() std::cout << "using cached connection type " << (int) hint << " for " << id << std::endl;
+
+		switch (hint)
+		{
+#ifndef DISABLE_LIBNICE
+			case CONNECTION_NICE:
+				return requestNiceConnectionTo(id);
+#endif
+			case CONNECTION_RELAYED:
+				return requestRelayedConnectionTo(id);
+			default:
+#if defined(FORCE_LIBNICE) and !defined(DISABLE_LIBNICE)
+				return requestNiceConnectionTo(id);		// sockets stay off while libnice is forced
+#else
+				return requestNormalConnectionTo(id);	// local/public choice is made when credentials arrive
+#endif
+		}
+	}
+
+
+	result_type Peer::reportConnectionType(peer_id id, connection_type type)
+	{
+		result_type res;
+		connectionHints[id] = type;
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
+		res = send_type_(coordinatorFd, REPORT_CONNECTION_TYPE);
+		res = send_(coordinatorFd, id);
+		res = send_(coordinatorFd, type);
+		return res;
+	}
+
+	// called by the target of a new socket connection. if the requester runs in the same process or machine,
+	// offers it a faster transport (or udp to remote peers, if preferred). registers the requester with
+	// whatever transport is to be used
+	result_type Peer::offerTransport(int fd, peer_id requesterId)
+	{
+		result_type res;
+		std::string remoteHostKey;
+		int remotePid, remotePort;
+
+		res = recv_(fd, 0, remoteHostKey);
+		res = recv_(fd, 0, remotePid);
+		res = recv_(fd, 0, remotePort);
+		QUIT_IF_UNSUCCESSFUL(res);
+
+		bool sameHost = (remoteHostKey == getHostKey());
+		std::shared_ptr<LocalLink> localNode = (sameHost and remotePid == getpid() ? findLocalNode(remotePort) : NULL);
+
+		if (localNode != NULL) {
+			TEST() std::cout << "peer " << requesterId << " is in the same process. using in-process transport" << std::endl;
+			setNewPeerStructures(fd, requesterId, DESCRIPTOR_SOCK);		// socket is kept to detect failures
+			setInProcessPeer(descriptor_pair(fd, DESCRIPTOR_SOCK), localNode);
+			return send_(fd, std::string(IN_PROCESS_OFFER));
+		}
+
+#if !defined(DISABLE_UDP) and defined(PREFER_UDP)
+	#ifndef DISABLE_SHARED_MEMORY
+		bool offerUdp = !sameHost;		// shared memory is preferred on the same machine
+	#else
+		bool offerUdp = true;
+	#endif
+		// (the requester's udp packets come from the address of its socket connection)
+		sockaddr_in requesterAddr;
+		socklen_t addrLen = sizeof(requesterAddr);
+		if (getpeername(fd, (sockaddr *) &requesterAddr, &addrLen) < 0) {
+			offerUdp = false;
+		}
+		int udpChannelId, udpPort;
+		if (offerUdp and udp.listen(udpChannelId, udpPort, inet_ntoa(requesterAddr.sin_addr))) {
+			res = send_(fd, std::string(UDP_OFFER));
+			res = send_(fd, udpPort);
+
+			result_type accepted = FAILURE;
+			res = recv_(fd, 0, accepted);		// sent once the requester's udp handshake ends
+
+			if (res == SUCCESS and accepted == SUCCESS and udp.isConnected(udpChannelId)) {
+				TEST() std::cout << "peer " << requesterId << " accepted udp transport" << std::endl;
+				fds.unsetFd(fd);
+				close(fd);
+				setNewPeerStructures(udpChannelId, requesterId, DESCRIPTOR_UDP);
+				return SUCCESS;
+			}
+			udp.close(udpChannelId);
+			setNewPeerStructures(fd, requesterId, DESCRIPTOR_SOCK);
+			return res;
+		}
+#endif
+
+		std::string name;		// empty name -> keep using the socket
+		int channelId = -1;
+
+#ifndef DISABLE_SHARED_MEMORY
+		if (sameHost and !shm.create(channelId, name)) {
+			channelId = -1;
+			name.clear();
+		}
+#endif
+
+		res = send_(fd, name);
+		QUIT_IF_UNSUCCESSFUL(res);
+
+#ifndef DISABLE_SHARED_MEMORY
+		if (channelId >= 0) {
+			result_type accepted = FAILURE;
+			res = recv_(fd, 0, accepted);
+			shm.unlink(channelId);		// either both sides mapped it or it will not be used
+
+			if (res == SUCCESS and accepted == SUCCESS) {
+				TEST() std::cout << "peer " << requesterId << " is in the same machine. using shared memory" << std::endl;
+				fds.unsetFd(fd);
+				close(fd);
+				setNewPeerStructures(channelId, requesterId, DESCRIPTOR_SHM);
+				return SUCCESS;
+			}
+			shm.release(channelId);		// (no receiver was started for it)
+		}
+#endif
+
+		setNewPeerStructures(fd, requesterId, DESCRIPTOR_SOCK);
+		return res;
+	}
+
+
+	// called by the requester of a new socket connection. registers the target with whatever transport was offered
+	// and returns the type of connection (CONNECTION_UNKNOWN if it is a plain socket)
+	connection_type Peer::acceptTransport(int fd, peer_id targetId, const address & targetAddr)
+	{
+		result_type res;
+		std::string offer;
+
+		res = send_(fd, getHostKey());
+		res = send_(fd, (int) getpid());
+		res = send_(fd, ownAddr.port);
+		res = recv_(fd, 0, offer);
+
+		if (res == SUCCESS and offer == IN_PROCESS_OFFER) {
+			std::shared_ptr<LocalLink> localNode = findLocalNode(targetAddr.port);
+			if (localNode != NULL) {
+				TEST() std::cout << "peer is in the same process. using in-process transport" << std::endl;
+				setNewPeerStructures(fd, targetId, DESCRIPTOR_SOCK);
+				setInProcessPeer(descriptor_pair(fd, DESCRIPTOR_SOCK), localNode);
+				return CONNECTION_IN_PROCESS;
+			}
+		}
+
+#ifndef DISABLE_UDP
+		if (res == SUCCESS and offer == UDP_OFFER) {
+			int udpPort, udpChannelId;
+			res = recv_(fd, 0, udpPort);
+			bool connected = (res == SUCCESS and udp.connect(udpChannelId, targetAddr.ip, udpPort));
+			res = send_(fd, (connected ? SUCCESS : FAILURE));
+
+			if (connected and res == SUCCESS) {
+				TEST() std::cout << "using udp transport" << std::endl;
+				close(fd);
+				setNewPeerStructures(udpChannelId, targetId, DESCRIPTOR_UDP);
+				return CONNECTION_UDP;
+			}
+			if (connected) {
+				udp.close(udpChannelId);
+			}
+		}
+#endif
+
+#ifndef DISABLE_SHARED_MEMORY
+		if (res == SUCCESS and !offer.empty() and offer != IN_PROCESS_OFFER and offer != UDP_OFFER) {
+			int channelId = -1;
+			bool opened = shm.open(channelId, offer);
+			res = send_(fd, (opened ? SUCCESS : FAILURE));
+
+			if (opened and res == SUCCESS) {
+				TEST() std::cout << "peer is in the same machine. using shared memory" << std::endl;
+				close(fd);
+				setNewPeerStructures(channelId, targetId, DESCRIPTOR_SHM);
+				return CONNECTION_SHARED_MEMORY;
+			}
+			if (opened) {
+				shm.release(channelId);
+			}
+		}
+#endif
+
+		setNewPeerStructures(fd, targetId, DESCRIPTOR_SOCK);
+		return CONNECTION_UNKNOWN;
+	}
+
 	//--------------------------------------------------
 	// Message handling methods
 	//--------------------------------------------------
@@ -343,7 +623,9 @@ namespace igcl
 		TEST() std::cout << "peer " << actualId << " registering with this node " << std::endl;
 		res = send_(sourceFd, this->ownId);
 		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
-		setNewPeerStructures(sourceFd, actualId, DESCRIPTOR_SOCK);
+
+		res = offerTransport(sourceFd, actualId);
+		LOG_AND_QUIT_IF_UNSUCCESSFUL(res, sourceDesc);
 
 		if (this->usingFreeformLayout) {
 			this->nextPeers.push_back(actualId);
@@ -364,6 +646,7 @@ namespace igcl
 		QUIT_IF_UNSUCCESSFUL(res);
 		TEST() std::cout << "peer " << requesterId << " requested credentials" << std::endl;
 
+		std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 		res = send_type_(coordinatorFd, PROVIDE_PEER_CREDENTIALS);
 		res = send_(coordinatorFd, ownAddr.port);
 		res = send_(coordinatorFd, requesterId);
@@ -387,26 +670,32 @@ namespace igcl
 			return NOTHING;
 		}
 
-		if (targetIp == "local") {
+		bool isLocal = (targetIp == "local");
+		if (isLocal) {
 			TEST() std::cout << "peer is in the local network" << std::endl;
 			res = recv_(coordinatorFd, 0, targetIp);	// get public IP, in case local connection fails and its needed
-			otherAddr.ip = this->localIp;
-		} else {
-			otherAddr.ip = targetIp;
 		}
 
 		res = recv_(coordinatorFd, 0, otherAddr.port);
 		res = recv_(coordinatorFd, 0, targetId);
 		QUIT_IF_UNSUCCESSFUL(res);
 
+		auto hint = connectionHints.find(targetId);
+		if (isLocal and hint != connectionHints.end() and hint->second == CONNECTION_PUBLIC_IP) {
+			TEST() std::cout << "local connection failed before. skipping it" << std::endl;
+			isLocal = false;
+		}
+		otherAddr.ip = (isLocal ? this->localIp : targetIp);
+
 		TEST() std::cout << "received creds " << targetId << " " << otherAddr << " (public IP: " << targetIp << ")"<<  std::endl;
 		TEST() std::cout << "connecting using sockets" << std::endl;
 
 		int fd = connectToPeer(otherAddr, false);	// connect (here, otherAddr can be a local or public IP)
 
-		if (fd == -1 and otherAddr.ip == localIp) {		// failed when connecting locally
+		if (fd == -1 and isLocal) {		// failed when connecting locally
 			TEST() std::cout << "local connection failed. trying public IP" << std::endl;
-			otherAddr.ip == targetIp;
+			otherAddr.ip = targetIp;
+			isLocal = false;
 			fd = connectToPeer(otherAddr, false);
 		}
 
@@ -432,10 +721,16 @@ namespace igcl
 		}
 		TEST() std::cout << "registered with peer" << std::endl;
 
-		setNewPeerStructures(fd, targetId, DESCRIPTOR_SOCK);
+		connection_type type = acceptTransport(fd, targetId, otherAddr);
+		if (type == CONNECTION_UNKNOWN) {
+			type = (isLocal ? CONNECTION_LOCAL_IP : CONNECTION_PUBLIC_IP);
+			openControlLane(descriptor_pair(fd, DESCRIPTOR_SOCK), otherAddr);
+		}
 		std::cout << knownPeers.toString() << std::endl;
 		TEST() std::cout << "end establishConnection" << std::endl;
 
+		res = reportConnectionType(targetId, type);
+
 		establishNextConnectionIfAvailable();
 
 		return res;
@@ -456,9 +751,13 @@ namespace igcl
 		std::string localInfo;
 		nice.startNewStream(streamId, localInfo);
 
-		res = send_type_(coordinatorFd, PROVIDE_NICE_PEER_CREDENTIALS);
-		res = send_(coordinatorFd, localInfo);
-		res = send_(coordinatorFd, requesterId);
+		// lock scope
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
+			res = send_type_(coordinatorFd, PROVIDE_NICE_PEER_CREDENTIALS);
+			res = send_(coordinatorFd, localInfo);
+			res = send_(coordinatorFd, requesterId);
+		}
 		TEST() std::cout << "sent creds, as requested" << std::endl;
 
 		streamsForConnections[requesterId] = streamId;
@@ -488,6 +787,7 @@ namespace igcl
 		if (nice.connect(streamId, remoteInfo)) {
 			setNewPeerStructures(streamId, targetId, DESCRIPTOR_NICE);
 			std::cout << knownPeers.toString() << std::endl;
+			res = reportConnectionType(targetId, CONNECTION_NICE);
 		} else {
 			res = requestRelayedConnectionTo(targetId);
 		}
@@ -582,6 +882,12 @@ namespace igcl
 				return whenPeerRegisters(sourceDesc, id);
 			}
 
+			case REGISTER_CONTROL_LANE:
+			{
+				dbg("msg type -> REGISTER_CONTROL_LANE");
+				return whenControlLaneRegisters(sourceDesc);
+			}
+
 			case GET_PEER_CREDENTIALS:
 			{
 				dbg("msg type -> GET_PEER_CREDENTIALS");
@@ -655,6 +961,7 @@ namespace igcl
 		std::cout << "Peer::deregisterPeer" << std::endl;
 		Node::deregisterPeer(sourceDesc, id);
 		streamsForConnections.erase(id);
+		connectionHints.erase(id);
 	}
 
 
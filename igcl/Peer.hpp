@@ -39,6 +39,7 @@ namespace igcl
 		bool usingFreeformLayout;
 		std::set<peer_id> connectable;
 		std::map<peer_id, int> streamsForConnections;
+		std::map<peer_id, connection_type> connectionHints;		// previously successful connection types (from coordinator)
 		uint nPeers;
 
 		std::mutex barrierMutex;
@@ -71,6 +72,12 @@ namespace igcl
 		result_type requestNormalConnectionTo(peer_id id);
 		result_type requestNiceConnectionTo(peer_id id);
 		result_type requestRelayedConnectionTo(peer_id id);
+		result_type requestHintedConnectionTo(peer_id id, connection_type hint);
+		result_type reportConnectionType(peer_id id, connection_type type);
+		void openControlLane(const descriptor_pair & desc, const address & addr);
+
+		result_type offerTransport(int fd, peer_id requesterId);
+		connection_type acceptTransport(int fd, peer_id targetId, const address & targetAddr);
 
 		result_type whenPeerRegisters(const descriptor_pair & sourceDesc, peer_id sourceId);
 		result_type whenCredentialsAreRequested(const descriptor_pair & sourceDesc, peer_id sourceId);
@@ -97,6 +104,7 @@ namespace igcl
 		result_type sendToPeerThroughCoordinator(peer_id id, T && ...data)
 		{
 			result_type res;
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 
 			res = send_type_(coordinatorFd, SEND_TO_PEER_RELAYED);
 			QUIT_IF_UNSUCCESSFUL(res);
@@ -113,6 +121,7 @@ namespace igcl
 		result_type sendToAllPeersThroughCoordinator(T && ...data)
 		{
 			result_type res;
+			std::lock_guard<std::mutex> lockWhileInsideScope(sendMutexOf(coordinatorFd));
 
 			res = send_type_(coordinatorFd, SEND_TO_ALL_RELAYED);
 			QUIT_IF_UNSUCCESSFUL(res);
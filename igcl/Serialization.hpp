@@ -0,0 +1,508 @@
+#ifndef SERIALIZATION_HPP_
+#define SERIALIZATION_HPP_
+
+#include "CommonTypes.hpp"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+#ifdef GMP
+#include <gmpxx.h>
+#endif
+
+
+namespace igcl
+{
+	/*
+	 * Serializer<T> turns values of type T into bytes and back. Trivially-copyable types are copied as they
+	 * are (chosen at compile time, so sending them costs nothing more than before). Other types need an
+	 * encoder, which exists for std::string, std::vector, std::array, std::pair, mpz_class (with GMP) and for
+	 * any struct with a "serialize" method that lists its members, which may themselves be of any of these:
+	 *
+	 *     struct Individual {
+	 *         std::vector<short> order;
+	 *         double fitness;
+	 *         template <typename S> void serialize(S & s) { s(order, fitness); }
+	 *     };
+	 *
+	 * Values inside others are prefixed by their length when needed. Whole messages are framed by their size,
+	 * so a message with a std::string or a std::vector of trivially-copyable elements carries just their bytes
+	 * (the same as sending the array itself). See Encoded.
+	 */
+	template <typename T, typename Enable = void>
+	struct Serializer;		// (no serializer for this type: give it a "serialize" method)
+
+
+	// a value of type T is copied as it is
+	template <typename T>
+	struct IsTriviallySerializable : std::integral_constant<bool, std::is_trivially_copyable<T>::value> {};
+
+
+	// visitors given to the "serialize" method of structs
+	class SizeVisitor;
+	class WriteVisitor;
+	class ReadVisitor;
+
+
+	template <typename T>
+	class HasSerializeMethod
+	{
+		template <typename U>
+		static auto test(int) -> decltype(std::declval<U &>().serialize(std::declval<SizeVisitor &>()), std::true_type());
+
+		template <typename>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<T>(0))::value;
+	};
+
+	// ------------------------------------------------------
+	// Trivially-copyable types
+	// ------------------------------------------------------
+
+	template <typename T>
+	struct Serializer<T, typename std::enable_if<IsTriviallySerializable<T>::value>::type>
+	{
+		static size_type size(const T &)
+		{
+			return sizeof(T);
+		}
+
+
+		static void write(char * & out, const T & value)
+		{
+			memcpy(out, &value, sizeof(T));
+			out += sizeof(T);
+		}
+
+
+		static bool read(const char * & in, const char * end, T & value)
+		{
+			if ((size_t) (end - in) < sizeof(T))
+				return false;
+			memcpy(&value, in, sizeof(T));
+			in += sizeof(T);
+			return true;
+		}
+	};
+
+	// ------------------------------------------------------
+	// Element arrays (shared by containers)
+	// ------------------------------------------------------
+
+	// bytes of "n" elements, copied at once if they are trivially copyable
+	template <typename T>
+	inline size_type elementsSize(const T * elems, size_type n, std::true_type)
+	{
+		return n * sizeof(T);
+	}
+
+
+	template <typename T>
+	inline size_type elementsSize(const T * elems, size_type n, std::false_type)
+	{
+		size_type nBytes = 0;
+		for (size_type i=0; i<n; ++i) {
+			nBytes += Serializer<T>::size(elems[i]);
+		}
+		return nBytes;
+	}
+
+
+	template <typename T>
+	inline void writeElements(char * & out, const T * elems, size_type n, std::true_type)
+	{
+		if (n == 0)
+			return;		// (elems may be NULL then)
+		memcpy(out, elems, n * sizeof(T));
+		out += n * sizeof(T);
+	}
+
+
+	template <typename T>
+	inline void writeElements(char * & out, const T * elems, size_type n, std::false_type)
+	{
+		for (size_type i=0; i<n; ++i) {
+			Serializer<T>::write(out, elems[i]);
+		}
+	}
+
+
+	template <typename T>
+	inline bool readElements(const char * & in, const char * end, T * elems, size_type n, std::true_type)
+	{
+		if ((size_t) (end - in) / sizeof(T) < n)
+			return false;
+		if (n == 0)
+			return true;
+		memcpy(elems, in, n * sizeof(T));
+		in += n * sizeof(T);
+		return true;
+	}
+
+
+	template <typename T>
+	inline bool readElements(const char * & in, const char * end, T * elems, size_type n, std::false_type)
+	{
+		for (size_type i=0; i<n; ++i) {
+			if (!Serializer<T>::read(in, end, elems[i]))
+				return false;
+		}
+		return true;
+	}
+
+	// ------------------------------------------------------
+	// Standard containers
+	// ------------------------------------------------------
+
+	// strings and vectors are prefixed by their number of elements
+	template <>
+	struct Serializer<std::string>
+	{
+		static size_type size(const std::string & value)
+		{
+			return sizeof(size_type) + value.size();
+		}
+
+
+		static void write(char * & out, const std::string & value)
+		{
+			Serializer<size_type>::write(out, value.size());
+			writeElements(out, value.data(), value.size(), std::true_type());
+		}
+
+
+		static bool read(const char * & in, const char * end, std::string & value)
+		{
+			size_type n;
+			if (!Serializer<size_type>::read(in, end, n) or (size_type) (end - in) < n)
+				return false;
+			value.assign(in, n);
+			in += n;
+			return true;
+		}
+	};
+
+
+	template <typename T>
+	struct Serializer< std::vector<T> >
+	{
+		typedef IsTriviallySerializable<T> trivial;
+
+		static size_type size(const std::vector<T> & value)
+		{
+			return sizeof(size_type) + elementsSize(value.data(), value.size(), trivial());
+		}
+
+
+		static void write(char * & out, const std::vector<T> & value)
+		{
+			Serializer<size_type>::write(out, value.size());
+			writeElements(out, value.data(), value.size(), trivial());
+		}
+
+
+		static bool read(const char * & in, const char * end, std::vector<T> & value)
+		{
+			size_type n;
+			if (!Serializer<size_type>::read(in, end, n))
+				return false;
+			if (trivial::value and (size_t) (end - in) / sizeof(T) < n)		// (a corrupt size must not allocate)
+				return false;
+			value.resize(n);
+			return readElements(in, end, value.data(), n, trivial());
+		}
+	};
+
+
+	// arrays of trivially-copyable elements are trivially copyable themselves
+	template <typename T, size_t N>
+	struct Serializer< std::array<T, N>, typename std::enable_if<!IsTriviallySerializable< std::array<T, N> >::value>::type >
+	{
+		static size_type size(const std::array<T, N> & value)
+		{
+			return elementsSize(value.data(), N, std::false_type());
+		}
+
+
+		static void write(char * & out, const std::array<T, N> & value)
+		{
+			writeElements(out, value.data(), N, std::false_type());
+		}
+
+
+		static bool read(const char * & in, const char * end, std::array<T, N> & value)
+		{
+			return readElements(in, end, value.data(), N, std::false_type());
+		}
+	};
+
+
+	template <typename A, typename B>
+	struct Serializer< std::pair<A, B>, typename std::enable_if<!IsTriviallySerializable< std::pair<A, B> >::value>::type >
+	{
+		static size_type size(const std::pair<A, B> & value)
+		{
+			return Serializer<A>::size(value.first) + Serializer<B>::size(value.second);
+		}
+
+
+		static void write(char * & out, const std::pair<A, B> & value)
+		{
+			Serializer<A>::write(out, value.first);
+			Serializer<B>::write(out, value.second);
+		}
+
+
+		static bool read(const char * & in, const char * end, std::pair<A, B> & value)
+		{
+			return Serializer<A>::read(in, end, value.first) and Serializer<B>::read(in, end, value.second);
+		}
+	};
+
+	// ------------------------------------------------------
+	// Structs with a "serialize" method
+	// ------------------------------------------------------
+
+	class SizeVisitor
+	{
+	public:
+		size_type nBytes = 0;
+
+		void operator()() {}
+
+		template <typename T, typename ...R>
+		void operator()(const T & value, const R & ...rest)
+		{
+			nBytes += Serializer<T>::size(value);
+			(*this)(rest...);
+		}
+	};
+
+
+	class WriteVisitor
+	{
+	public:
+		char * out;
+
+		WriteVisitor(char * out) : out(out) {}
+
+		void operator()() {}
+
+		template <typename T, typename ...R>
+		void operator()(const T & value, const R & ...rest)
+		{
+			Serializer<T>::write(out, value);
+			(*this)(rest...);
+		}
+	};
+
+
+	class ReadVisitor
+	{
+	public:
+		const char * in;
+		const char * end;
+		bool ok;
+
+		ReadVisitor(const char * in, const char * end) : in(in), end(end), ok(true) {}
+
+		void operator()() {}
+
+		template <typename T, typename ...R>
+		void operator()(T & value, R & ...rest)
+		{
+			ok = ok and Serializer<T>::read(in, end, value);
+			(*this)(rest...);
+		}
+	};
+
+
+	// (the "serialize" method is not const, since it also reads. writing does not change the value)
+	template <typename T>
+	struct Serializer<T, typename std::enable_if<!IsTriviallySerializable<T>::value and HasSerializeMethod<T>::value>::type>
+	{
+		static size_type size(const T & value)
+		{
+			SizeVisitor visitor;
+			const_cast<T &>(value).serialize(visitor);
+			return visitor.nBytes;
+		}
+
+
+		static void write(char * & out, const T & value)
+		{
+			WriteVisitor visitor(out);
+			const_cast<T &>(value).serialize(visitor);
+			out = visitor.out;
+		}
+
+
+		static bool read(const char * & in, const char * end, T & value)
+		{
+			ReadVisitor visitor(in, end);
+			value.serialize(visitor);
+			in = visitor.in;
+			return visitor.ok;
+		}
+	};
+
+#ifdef GMP
+	// ------------------------------------------------------
+	// GMP integers
+	// ------------------------------------------------------
+
+	// binary magnitude (64-bit little-endian words, least significant first) after its sign and number of words
+	template <>
+	struct Serializer<mpz_class>
+	{
+		static const size_t WORD_BYTES = 8;
+
+		static size_type size(const mpz_class & value)
+		{
+			return sizeof(int8_t) + sizeof(uint32_t) + nWords(value) * WORD_BYTES;
+		}
+
+
+		static void write(char * & out, const mpz_class & value)
+		{
+			int8_t sign = sgn(value);
+			uint32_t n = nWords(value);
+			Serializer<int8_t>::write(out, sign);
+			Serializer<uint32_t>::write(out, n);
+
+			size_t count = 0;
+			mpz_export(out, &count, -1, WORD_BYTES, -1, 0, value.get_mpz_t());
+			out += n * WORD_BYTES;
+		}
+
+
+		static bool read(const char * & in, const char * end, mpz_class & value)
+		{
+			int8_t sign;
+			uint32_t n;
+			if (!Serializer<int8_t>::read(in, end, sign) or !Serializer<uint32_t>::read(in, end, n))
+				return false;
+			if ((size_t) (end - in) / WORD_BYTES < n)
+				return false;
+
+			mpz_import(value.get_mpz_t(), n, -1, WORD_BYTES, -1, 0, in);
+			if (sign < 0) {
+				mpz_neg(value.get_mpz_t(), value.get_mpz_t());
+			}
+			in += n * WORD_BYTES;
+			return true;
+		}
+
+	private:
+		static inline size_t nWords(const mpz_class & value)
+		{
+			return (sgn(value) == 0 ? 0 : (mpz_sizeinbase(value.get_mpz_t(), 2) + 8*WORD_BYTES-1) / (8*WORD_BYTES));
+		}
+	};
+#endif
+
+	// ------------------------------------------------------
+	// Whole messages
+	// ------------------------------------------------------
+
+	/*
+	 * Bytes of a value sent as a whole message. Trivially-copyable values, strings and vectors of trivially-
+	 * copyable elements are not copied: their own bytes are sent. Other values are serialized to a buffer.
+	 */
+	template <typename T, typename Enable = void>
+	class Encoded
+	{
+		std::vector<char> buffer;
+
+	public:
+		Encoded(const T & value)
+			: buffer(Serializer<T>::size(value))
+		{
+			char * out = buffer.data();
+			Serializer<T>::write(out, value);
+		}
+
+		const char * data() const	{ return buffer.data(); }
+		size_type size() const		{ return buffer.size(); }
+
+		// fills "value" from a message. fails unless the message holds exactly one value of type T
+		static bool decode(const char * bytes, size_type nBytes, T & value)
+		{
+			const char * end = bytes + nBytes;
+			return Serializer<T>::read(bytes, end, value) and bytes == end;
+		}
+	};
+
+
+	template <typename T>
+	class Encoded<T, typename std::enable_if<IsTriviallySerializable<T>::value>::type>
+	{
+		const T & value;
+
+	public:
+		Encoded(const T & value) : value(value) {}
+
+		const char * data() const	{ return (const char *) &value; }
+		size_type size() const		{ return sizeof(T); }
+
+		static bool decode(const char * bytes, size_type nBytes, T & value)
+		{
+			if (nBytes != sizeof(T))
+				return false;
+			memcpy(&value, bytes, sizeof(T));
+			return true;
+		}
+	};
+
+
+	template <>
+	class Encoded<std::string>
+	{
+		const std::string & value;
+
+	public:
+		Encoded(const std::string & value) : value(value) {}
+
+		const char * data() const	{ return value.data(); }
+		size_type size() const		{ return value.size(); }
+
+		static bool decode(const char * bytes, size_type nBytes, std::string & value)
+		{
+			value.assign(bytes, nBytes);
+			return true;
+		}
+	};
+
+
+	template <typename T>
+	class Encoded<std::vector<T>, typename std::enable_if<IsTriviallySerializable<T>::value>::type>
+	{
+		const std::vector<T> & value;
+
+	public:
+		Encoded(const std::vector<T> & value) : value(value) {}
+
+		const char * data() const	{ return (const char *) value.data(); }
+		size_type size() const		{ return value.size() * sizeof(T); }
+
+		static bool decode(const char * bytes, size_type nBytes, std::vector<T> & value)
+		{
+			if (nBytes % sizeof(T) != 0)
+				return false;
+			value.resize(nBytes / sizeof(T));
+			if (nBytes > 0) {
+				memcpy(value.data(), bytes, nBytes);
+			}
+			return true;
+		}
+	};
+}
+
+#endif /* SERIALIZATION_HPP_ */
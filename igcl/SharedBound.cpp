@@ -0,0 +1,156 @@
+#include "SharedBound.hpp"
+#include "Node.hpp"
+
+#include <sstream>
+#include <limits>
+
+
+namespace igcl		// Internet Group-Communication Library
+{
+	// ------------------------------------------------------
+	// Constructor/destructor
+	// ------------------------------------------------------
+
+	SharedBound::SharedBound(Node * node)
+		: node(node), value(std::numeric_limits<double>::infinity()), round(0), lastSent(std::numeric_limits<double>::infinity()),
+		  hasNews(false), stopping(false), nImprovements(0), nSent(0), nReceived(0), nReceivedImprovements(0)
+	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(node->sharedBoundMutex);
+			node->sharedBound = this;
+		}
+		senderThread = new std::thread(&SharedBound::sendLoop, this);
+	}
+
+
+	SharedBound::~SharedBound()
+	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(node->sharedBoundMutex);
+			node->sharedBound = NULL;
+		}
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+			stopping = true;
+			condVar.notify_all();
+		}
+		senderThread->join();
+		delete senderThread;
+	}
+
+	// ------------------------------------------------------
+	// Bound
+	// ------------------------------------------------------
+
+	// starts a new round (e.g. a new search), with a new bound. every node of the group must start the same rounds
+	void SharedBound::reset(double initial)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		round++;
+		value.store(initial, std::memory_order_relaxed);
+		lastSent = initial;
+		hasNews = false;
+		nImprovements = nSent = nReceived = nReceivedImprovements = 0;
+
+		// (peers that started this round earlier may have sent their bounds already)
+		auto it = earlyValues.find(round);
+		if (it != earlyValues.end() and it->second < initial) {
+			value.store(it->second, std::memory_order_relaxed);
+			hasNews = true;		// (forwarded like any other received improvement)
+			condVar.notify_one();
+		}
+		earlyValues.erase(earlyValues.begin(), earlyValues.upper_bound(round));
+	}
+
+
+	// lowers the bound to "candidate", if it is lower, and tells the peers. returns true if it was lower
+	bool SharedBound::offer(double candidate)
+	{
+		if (!lower(candidate))
+			return false;
+
+		nImprovements++;
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		hasNews = true;
+		condVar.notify_one();
+		return true;
+	}
+
+
+	std::string SharedBound::statsToString()
+	{
+		std::stringstream ss;
+		ss << "bound: " << get() << ", own improvements: " << nImprovements << " (sent " << nSent << " times)";
+		ss << ", received: " << nReceived << " (" << nReceivedImprovements << " improved it)";
+		return ss.str();
+	}
+
+
+	bool SharedBound::lower(double candidate)
+	{
+		double current = value.load(std::memory_order_relaxed);
+		while (candidate < current) {
+			if (value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	// ------------------------------------------------------
+	// Messages
+	// ------------------------------------------------------
+
+	// sends the latest bound to every directly linked peer whenever it improves, be it found here or received.
+	// relayed peers cannot be sent bounds, so they are reached through the peers that forward them. improvements
+	// made while a value is being sent are sent together, as one
+	void SharedBound::sendLoop()
+	{
+		std::unique_lock<std::mutex> uniqueLock(mutex);
+
+		while (1)
+		{
+			while (!hasNews and !stopping) {
+				condVar.wait(uniqueLock);
+			}
+			if (stopping)
+				return;
+			hasNews = false;
+
+			BoundMessage msg = { round, get() };
+			if (!(msg.value < lastSent))
+				continue;
+			lastSent = msg.value;
+
+			uniqueLock.unlock();		// (nodes of the same process handle messages in the sender's thread)
+			for (peer_id id : node->knownPeers.getAllIds()) {
+				if (id != node->getId() and node->knownPeers.idToDescriptor(id).type != DESCRIPTOR_NONE) {
+					node->sendBoundMessage(id, msg);
+				}
+			}
+			nSent++;
+			uniqueLock.lock();
+		}
+	}
+
+
+	// called by the receiver thread of the node (with the node's "sharedBoundMutex" locked)
+	result_type SharedBound::whenReceived(peer_id, const BoundMessage & msg)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+
+		if (msg.round == round) {
+			nReceived++;
+			if (lower(msg.value)) {
+				nReceivedImprovements++;
+				hasNews = true;		// (its sender may not be linked to every peer)
+				condVar.notify_one();
+			}
+		} else if (msg.round > round) {
+			auto it = earlyValues.find(msg.round);
+			if (it == earlyValues.end() or msg.value < it->second) {
+				earlyValues[msg.round] = msg.value;
+			}
+		}
+		return SUCCESS;
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef SHAREDBOUND_HPP_
+#define SHAREDBOUND_HPP_
+
+#include "CommonTypes.hpp"
+
+#include <string>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+
+namespace igcl
+{
+	class Node;
+
+	// payload of a bound update
+	struct BoundMessage
+	{
+		uint32_t round;
+		double value;
+	};
+
+	/*
+	 * Upper bound of a minimization (e.g. the best solution of a branch and bound search) shared by a group.
+	 * The search reads and lowers it without locks. Each improvement is pushed at once to every linked peer by a
+	 * sender thread, which only sends the latest value, so a burst of improvements costs a single message.
+	 * Received values are applied by the receiver thread as they arrive. Updates travel in the control lanes, so
+	 * they do not wait behind bulk data. Relayed peers do not get them.
+	 */
+	class SharedBound
+	{
+		friend class Node;
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
+	private:
+		Node * node;
+
+		std::atomic<double> value;
+		uint32_t round;
+		double lastSent;
+		std::map<uint32_t, double> earlyValues;			// received for rounds not yet started here
+		bool hasNews, stopping;
+		std::mutex mutex;
+		std::condition_variable condVar;
+		std::thread * senderThread;
+
+		// stats of the current round
+		std::atomic<ulong> nImprovements, nSent, nReceived, nReceivedImprovements;
+
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
+	public:
+		SharedBound(Node * node);
+		~SharedBound();
+
+		void reset(double initial);
+		bool offer(double candidate);
+
+		inline double get() {
+			return value.load(std::memory_order_relaxed);
+		}
+
+		std::string statsToString();
+
+	private:
+		bool lower(double candidate);
+		void sendLoop();
+
+		result_type whenReceived(peer_id id, const BoundMessage & msg);
+	};
+}
+
+#endif /* SHAREDBOUND_HPP_ */
@@ -0,0 +1,345 @@
+#include "CommonDefines.hpp"
+
+#ifndef DISABLE_SHARED_MEMORY
+
+#include "SharedMemoryHelper.hpp"
+
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+namespace igcl		// Internet Group-Communication Library
+{
+	// ------------------------------------------------------
+	// Constructor/destructor
+	// ------------------------------------------------------
+
+	SharedMemoryHelper::SharedMemoryHelper() : nCreated(0)
+	{
+	}
+
+
+	// (the node waited for its receiver threads, so nothing reads the segments anymore)
+	SharedMemoryHelper::~SharedMemoryHelper()
+	{
+		for (uint i=0; i<channels.size(); ++i) {
+			release(i);
+			delete channels[i];
+		}
+	}
+
+	// ------------------------------------------------------
+	// Public methods
+	// ------------------------------------------------------
+
+	bool SharedMemoryHelper::create(int & channelId, std::string & name)
+	{
+		std::stringstream ss;
+		ss << "/igcl_" << getpid() << "_" << nCreated++;
+		name = ss.str();
+
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0)
+			return false;
+
+		if (ftruncate(fd, sizeof(Segment)) != 0) {		// new pages are zero-filled, which initializes every field
+			::close(fd);
+			shm_unlink(name.c_str());
+			return false;
+		}
+
+		Segment * segment = mapSegment(fd);
+		if (segment == NULL) {
+			shm_unlink(name.c_str());
+			return false;
+		}
+
+		segment->pids[0] = getpid();
+		channelId = addChannel(segment, name, 0);
+		return true;
+	}
+
+
+	bool SharedMemoryHelper::open(int & channelId, const std::string & name)
+	{
+		int fd = shm_open(name.c_str(), O_RDWR, 0600);
+		if (fd < 0)
+			return false;
+
+		Segment * segment = mapSegment(fd);
+		if (segment == NULL)
+			return false;
+
+		segment->pids[1] = getpid();
+		channelId = addChannel(segment, name, 1);
+		return true;
+	}
+
+
+	// removes the name of the segment (done once both sides mapped it, so that nothing is left behind on crashes)
+	void SharedMemoryHelper::unlink(int channelId)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(channel->segmentMutex);
+		if (channel->linked) {
+			shm_unlink(channel->name.c_str());
+			channel->linked = false;
+		}
+	}
+
+
+	void SharedMemoryHelper::close(int channelId)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(channel->segmentMutex);
+		Segment * segment = channel->segment;
+		if (segment == NULL)
+			return;
+
+		segment->closed = 1;
+		for (Ring & ring : segment->rings) {		// wake anyone that is sleeping on this channel
+			wake(ring.dataSeq, ring.dataWaiters);
+			wake(ring.spaceSeq, ring.spaceWaiters);
+		}
+	}
+
+
+	// closes a channel and unmaps its segment. to be called once nothing receives from it anymore (senders
+	// see that it was closed and leave)
+	void SharedMemoryHelper::release(int channelId)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return;
+
+		close(channelId);
+		unlink(channelId);
+
+		std::lock_guard<std::mutex> sendLock(channel->sendMutex);
+		std::lock_guard<std::mutex> segmentLock(channel->segmentMutex);
+		if (channel->segment != NULL) {
+			munmap(channel->segment, sizeof(Segment));
+			channel->segment = NULL;
+		}
+	}
+
+
+	// writes a whole message (type, size and data) to the outgoing ring, so that the message of another
+	// thread cannot come between its pieces
+	result_type SharedMemoryHelper::send(int channelId, msg_type type, const void * data, size_type nBytes)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return FAILURE;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(channel->sendMutex);
+		if (channel->segment == NULL)
+			return FAILURE;
+
+		result_type res;
+		res = write(channel, &type, sizeof(type));
+		QUIT_IF_UNSUCCESSFUL(res);
+		res = write(channel, &nBytes, sizeof(nBytes));
+		QUIT_IF_UNSUCCESSFUL(res);
+		return write(channel, data, nBytes);
+	}
+
+
+	// copies "nBytes" from the incoming ring, sleeping whenever it is empty.
+	// if "returnIfEmpty" is set and nothing arrives before a timeout, returns NOTHING
+	result_type SharedMemoryHelper::recv(int channelId, void * data, size_type nBytes, bool returnIfEmpty)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL or channel->segment == NULL)
+			return FAILURE;
+
+		Ring & ring = channel->segment->rings[1 - channel->side];
+		char * dst = (char *) data;
+		bool readAny = false;
+		uint spins = 0;
+
+		while (nBytes > 0)
+		{
+			uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+			uint64_t head = ring.head.load(std::memory_order_acquire);
+			uint64_t available = head - tail;
+
+			if (available == 0) {
+				if (channel->segment->closed)
+					return FAILURE;
+				if (++spins < SPIN_ITERATIONS) {
+					backOff(spins);
+					continue;
+				}
+
+				uint32_t seq = ring.dataSeq.load();
+				ring.dataWaiters++;
+				bool woken = (ring.head.load() != head or wait(ring.dataSeq, seq));
+				ring.dataWaiters--;
+
+				if (!woken) {
+					if (!isOtherSideAlive(channel))
+						return FAILURE;
+					if (returnIfEmpty and !readAny)
+						return NOTHING;
+				}
+				spins = 0;
+				continue;
+			}
+
+			uint n = std::min((uint64_t) nBytes, available);
+			uint offset = tail & (RING_CAPACITY-1);
+			uint first = std::min(n, RING_CAPACITY - offset);
+			memcpy(dst, ring.bytes + offset, first);
+			memcpy(dst + first, ring.bytes, n - first);
+			ring.tail.store(tail + n);
+			wake(ring.spaceSeq, ring.spaceWaiters);
+
+			dst += n;
+			nBytes -= n;
+			readAny = true;
+			spins = 0;
+		}
+
+		return SUCCESS;
+	}
+
+	// ------------------------------------------------------
+	// Auxiliary methods
+	// ------------------------------------------------------
+
+	// copies "nBytes" into the outgoing ring, sleeping whenever it is full. (must be called with "sendMutex" locked)
+	result_type SharedMemoryHelper::write(Channel * channel, const void * data, size_type nBytes)
+	{
+		Ring & ring = channel->segment->rings[channel->side];
+		const char * src = (const char *) data;
+		uint spins = 0;
+
+		while (nBytes > 0)
+		{
+			if (channel->segment->closed)
+				return FAILURE;
+
+			uint64_t head = ring.head.load(std::memory_order_relaxed);
+			uint64_t tail = ring.tail.load(std::memory_order_acquire);
+			uint64_t space = RING_CAPACITY - (head - tail);
+
+			if (space == 0) {
+				if (++spins < SPIN_ITERATIONS) {
+					backOff(spins);
+					continue;
+				}
+
+				uint32_t seq = ring.spaceSeq.load();
+				ring.spaceWaiters++;
+				bool woken = (ring.tail.load() != tail or wait(ring.spaceSeq, seq));
+				ring.spaceWaiters--;
+
+				if (!woken and !isOtherSideAlive(channel))
+					return FAILURE;
+				spins = 0;
+				continue;
+			}
+
+			uint n = std::min((uint64_t) nBytes, space);
+			uint offset = head & (RING_CAPACITY-1);
+			uint first = std::min(n, RING_CAPACITY - offset);
+			memcpy(ring.bytes + offset, src, first);
+			memcpy(ring.bytes, src + first, n - first);
+			ring.head.store(head + n);
+			wake(ring.dataSeq, ring.dataWaiters);
+
+			src += n;
+			nBytes -= n;
+			spins = 0;
+		}
+
+		return SUCCESS;
+	}
+
+
+	SharedMemoryHelper::Channel * SharedMemoryHelper::getChannel(int channelId)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(channelsMutex);
+		if (channelId < 0 or channelId >= (int) channels.size())
+			return NULL;
+		return channels[channelId];
+	}
+
+
+	int SharedMemoryHelper::addChannel(Segment * segment, const std::string & name, int side)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(channelsMutex);
+		channels.push_back(new Channel(segment, name, side));
+		return channels.size()-1;
+	}
+
+
+	SharedMemoryHelper::Segment * SharedMemoryHelper::mapSegment(int fd)
+	{
+		void * addr = mmap(NULL, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);	// the mapping keeps the segment alive
+		return (addr == MAP_FAILED ? NULL : (Segment *) addr);
+	}
+
+
+	bool SharedMemoryHelper::isOtherSideAlive(const Channel * channel)
+	{
+		if (channel->segment->closed)
+			return false;
+		int pid = channel->segment->pids[1 - channel->side];
+		return (pid == 0 or kill(pid, 0) == 0 or errno == EPERM);
+	}
+
+
+	// waits a little between polls of a ring: pausing the cpu at first, then letting other threads run
+	void SharedMemoryHelper::backOff(uint spins)
+	{
+		if (spins < PAUSE_ITERATIONS) {
+#if defined(__x86_64__) or defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+		} else {
+			std::this_thread::yield();
+		}
+	}
+
+
+	// sleeps while "seq" still holds "oldValue". returns false on timeout
+	bool SharedMemoryHelper::wait(std::atomic<uint32_t> & seq, uint32_t oldValue)
+	{
+		timespec timeout;
+		timeout.tv_sec = WAIT_TIMEOUT_MS / 1000;
+		timeout.tv_nsec = (WAIT_TIMEOUT_MS % 1000) * 1000000;
+
+		long rc = syscall(SYS_futex, (uint32_t *) &seq, FUTEX_WAIT, oldValue, &timeout, NULL, 0);
+		return !(rc < 0 and errno == ETIMEDOUT);
+	}
+
+
+	void SharedMemoryHelper::wake(std::atomic<uint32_t> & seq, std::atomic<uint32_t> & waiters)
+	{
+		seq++;
+		if (waiters.load() > 0) {
+			syscall(SYS_futex, (uint32_t *) &seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef SHAREDMEMORYHELPER_HPP_
+#define SHAREDMEMORYHELPER_HPP_
+
+#include "CommonDefines.hpp"
+
+#ifndef DISABLE_SHARED_MEMORY
+
+#include "CommonTypes.hpp"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+
+namespace igcl
+{
+	/*
+	 * Transport for peers that run on the same host. Each channel is a shared memory segment holding two
+	 * single-producer/single-consumer ring buffers (one per direction). Sleeping readers and writers wait
+	 * on futex words placed inside the segment, so a transfer costs two memcpys instead of socket syscalls.
+	 */
+	class SharedMemoryHelper
+	{
+		// ======================================================
+		// ==================== DEFINITIONS =====================
+		// ======================================================
+
+		static const uint RING_CAPACITY = 1 << 22;		// bytes per direction (must be a power of 2)
+		static const uint SPIN_ITERATIONS = 2000;		// polls before going to sleep on the futex
+		static const uint PAUSE_ITERATIONS = 200;		// of those, polls that only pause the cpu (the others yield it)
+		static const long WAIT_TIMEOUT_MS = 200;		// sleeping sides periodically check if the other side is alive
+
+		struct Ring
+		{
+			std::atomic<uint64_t> head;					// total bytes written (only changed by the writer)
+			std::atomic<uint64_t> tail;					// total bytes read (only changed by the reader)
+			std::atomic<uint32_t> dataSeq, spaceSeq;		// futex words, incremented when head/tail move
+			std::atomic<uint32_t> dataWaiters, spaceWaiters;
+			char bytes[RING_CAPACITY];
+		};
+
+		struct Segment
+		{
+			std::atomic<uint32_t> closed;
+			int pids[2];
+			Ring rings[2];		// rings[0] carries data from creator to opener, rings[1] the opposite
+		};
+
+		struct Channel
+		{
+			Segment * segment;		// (NULL once released. only changed with both mutexes locked)
+			std::string name;
+			int side;			// 0 in the process that created the segment, 1 in the one that opened it
+			bool linked;		// the name of the segment was not removed yet
+			std::mutex sendMutex;
+			std::mutex segmentMutex;
+
+			Channel(Segment * segment, const std::string & name, int side)
+				: segment(segment), name(name), side(side), linked(side == 0) {}
+		};
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
+	private:
+		std::vector<Channel *> channels;		// indexed by channel ID (the descriptor of DESCRIPTOR_SHM peers)
+		std::mutex channelsMutex;
+		uint nCreated;
+
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
+	public:
+		SharedMemoryHelper();
+		~SharedMemoryHelper();
+
+		bool create(int & channelId, std::string & name);
+		bool open(int & channelId, const std::string & name);
+		void unlink(int channelId);
+		void close(int channelId);
+		void release(int channelId);
+
+		result_type send(int channelId, msg_type type, const void * data, size_type nBytes);
+		result_type recv(int channelId, void * data, size_type nBytes, bool returnIfEmpty);
+
+	private:
+		result_type write(Channel * channel, const void * data, size_type nBytes);
+		Channel * getChannel(int channelId);
+		int addChannel(Segment * segment, const std::string & name, int side);
+		static Segment * mapSegment(int fd);
+		static bool isOtherSideAlive(const Channel * channel);
+		static void backOff(uint spins);
+		static bool wait(std::atomic<uint32_t> & seq, uint32_t oldValue);
+		static void wake(std::atomic<uint32_t> & seq, std::atomic<uint32_t> & waiters);
+	};
+}
+
+#endif
+
+#endif /* SHAREDMEMORYHELPER_HPP_ */
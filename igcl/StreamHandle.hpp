@@ -0,0 +1,176 @@
+#ifndef STREAMHANDLE_HPP_
+#define STREAMHANDLE_HPP_
+
+#include "BlockingQueue.hpp"
+#include "CommonTypes.hpp"
+
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+
+namespace igcl
+{
+	// prefix of every chunk of a stream (see Node::sendStreamTo)
+	struct StreamChunkHeader
+	{
+		uint32_t streamId;			// unique among the streams sent by the same node
+		uint32_t chunkIndex;
+		uint64_t totalBytes;		// of the whole stream (so it may exceed SIZE_TYPE_MAX)
+	};
+
+	/*
+	 * Receiving end of a large message that arrives in chunks. The application reads each chunk as soon as
+	 * it arrives, instead of waiting for the whole message. Consuming a chunk lets the sender send another,
+	 * so only a few chunks of the stream are ever buffered. Handles are given by Node::waitRecvStreamFrom
+	 * and must be deleted by the application.
+	 */
+	class StreamHandle
+	{
+		// ======================================================
+		// ==================== DEFINITIONS =====================
+		// ======================================================
+
+		struct Chunk
+		{
+			char * buffer;			// allocated with malloc. data starts after the chunk header
+			size_type offset, size;
+		};
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
+	private:
+		uint64_t totalBytes, pushedBytes, consumedBytes;
+		BlockingQueue<Chunk> chunks;
+		Chunk current;
+		size_type currentRead;
+		std::function<void ()> onConsumed;		// gives the sender a credit for one more chunk
+		std::function<void ()> onDeleted;		// tells the receiving node to stop pushing chunks to it
+
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
+	public:
+		StreamHandle(uint64_t totalBytes, const std::function<void ()> & onConsumed, const std::function<void ()> & onDeleted)
+			: totalBytes(totalBytes), pushedBytes(0), consumedBytes(0), currentRead(0), onConsumed(onConsumed), onDeleted(onDeleted)
+		{
+			current.buffer = NULL;
+			current.offset = current.size = 0;
+		}
+
+
+		~StreamHandle()
+		{
+			onDeleted();		// (first, so that no chunk is pushed while the others are freed)
+			free(current.buffer);
+			Chunk chunk;
+			while (chunks.dequeue(chunk) == SUCCESS) {
+				free(chunk.buffer);
+			}
+		}
+
+
+		inline uint64_t size() const
+		{
+			return totalBytes;
+		}
+
+
+		inline uint64_t remaining() const
+		{
+			return totalBytes - consumedBytes;
+		}
+
+
+		// waits for the next chunk. its data stays valid until the next call (or until the handle is deleted).
+		// returns NOTHING once the whole stream was read, and FAILURE if the sender left before finishing it
+		result_type nextChunk(const char * & data, size_type & nBytes)
+		{
+			if (remaining() == 0)
+				return NOTHING;
+
+			result_type res = nextBuffer();
+			QUIT_IF_UNSUCCESSFUL(res);
+
+			data = current.buffer + current.offset + currentRead;
+			nBytes = current.size - currentRead;
+			currentRead = current.size;
+			consumedBytes += nBytes;
+			return SUCCESS;
+		}
+
+
+		// copies the next "nBytes" bytes of the stream to "dest", waiting for chunks as needed
+		result_type read(void * dest, uint64_t nBytes)
+		{
+			if (nBytes > remaining())
+				return FAILURE;
+
+			char * out = (char *) dest;
+			while (nBytes > 0)
+			{
+				result_type res = nextBuffer();
+				QUIT_IF_UNSUCCESSFUL(res);
+
+				size_type n = std::min((uint64_t) (current.size - currentRead), nBytes);
+				memcpy(out, current.buffer + current.offset + currentRead, n);
+				currentRead += n;
+				consumedBytes += n;
+				out += n;
+				nBytes -= n;
+			}
+			return SUCCESS;
+		}
+
+		// ------------------------------------------------------
+		// Called by the node that receives the stream
+		// ------------------------------------------------------
+
+		// takes ownership of "buffer". returns true if the chunk completed the stream
+		bool push(char * buffer, size_type offset, size_type size)
+		{
+			Chunk chunk;
+			chunk.buffer = buffer;
+			chunk.offset = offset;
+			chunk.size = size;
+			chunks.enqueue(chunk);
+
+			pushedBytes += size;
+			return pushedBytes >= totalBytes;
+		}
+
+
+		void abort()
+		{
+			chunks.forceQuit();
+		}
+
+	private:
+		// makes "current" a chunk with unread data (the previous one is given back to the sender)
+		result_type nextBuffer()
+		{
+			if (current.buffer != NULL and currentRead < current.size)
+				return SUCCESS;
+
+			if (current.buffer != NULL) {
+				free(current.buffer);
+				current.buffer = NULL;
+				onConsumed();
+			}
+
+			result_type res = chunks.blockingDequeue(current);		// (only empty streams have empty chunks, and those are never read)
+			if (res != SUCCESS) {
+				current.buffer = NULL;
+				return FAILURE;
+			}
+			currentRead = 0;
+
+			return SUCCESS;
+		}
+	};
+}
+
+#endif /* STREAMHANDLE_HPP_ */
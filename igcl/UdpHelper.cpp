@@ -0,0 +1,749 @@
+#include "CommonDefines.hpp"
+
+#ifndef DISABLE_UDP
+
+#include "UdpHelper.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+
+namespace igcl		// Internet Group-Communication Library
+{
+	const uint UdpHelper::MAX_PAYLOAD;
+	const uint UdpHelper::MAX_MESSAGE_SIZE;
+	const long UdpHelper::MIN_RTO_MS;
+	const long UdpHelper::MAX_RTO_MS;
+	const long UdpHelper::ACK_DELAY_MS;
+	const long UdpHelper::KEEPALIVE_MS;
+	const long UdpHelper::DEAD_TIMEOUT_MS;
+	const long UdpHelper::HELLO_INTERVAL_MS;
+	const long UdpHelper::HANDSHAKE_TIMEOUT_MS;
+	const long UdpHelper::RECV_TIMEOUT_MS;
+	const uint UdpHelper::MAX_REORDER_THRESHOLD;
+	constexpr double UdpHelper::MAX_REORDER_TIME;
+
+	// ------------------------------------------------------
+	// Constructor/destructor
+	// ------------------------------------------------------
+
+	UdpHelper::Channel::Channel(int fd, bool connected, in_addr_t allowedAddr)
+		: fd(fd), connected(connected), closed(false), allowedAddr(allowedAddr), nextPacketNumber(1), largestAcked(0), recoveryPoint(0),
+		  bufferedBytes(0), cwnd(INITIAL_WINDOW), ssthresh(1e9), srtt(0), rttvar(0), rtoMs(MIN_RTO_MS*2),
+		  reorderThreshold(REORDER_THRESHOLD), reorderTime(REORDER_TIME),
+		  reductionCause(0), cwndBeforeReduction(0), ssthreshBeforeReduction(0), lastSend(clock::now()), nNotAcked(0), ackDeadline(time_point::max()), lastReceive(clock::now()),
+		  rng(std::random_device()())
+	{
+	}
+
+
+	UdpHelper::UdpHelper()
+		: serviceThread(NULL), shouldStop(false), emulatedLossRate(0), emulatedDelayMs(0), emulatedJitterMs(0),
+		  nPacketsSent(0), nPacketsLost(0), nPacketsDropped(0), nTimeouts(0)
+	{
+	}
+
+
+	UdpHelper::~UdpHelper()
+	{
+		for (uint i=0; i<channels.size(); ++i) {
+			close(i);
+		}
+
+		shouldStop = true;
+		if (serviceThread != NULL) {
+			serviceThread->join();
+			delete serviceThread;
+		}
+
+		// (the node waits for its receiver threads before this, so nothing uses the channels now)
+		for (Channel * channel : channels) {
+			if (channel->fd >= 0) {
+				::close(channel->fd);
+			}
+			for (auto & incomplete : channel->incomplete) {
+				free(incomplete.second.bytes);
+			}
+			for (auto & delivery : channel->outOfOrder) {
+				free(delivery.second.bytes);
+			}
+			for (Delivery & delivery : channel->delivered) {
+				free(delivery.bytes);
+			}
+			delete channel;
+		}
+	}
+
+	// ------------------------------------------------------
+	// Public methods
+	// ------------------------------------------------------
+
+	// makes outgoing packets go through an emulated link that loses a fraction "lossRate" of them
+	// and delays the rest by "delayMs" +- "jitterMs" (applies to channels of both sides, like netem on both hosts)
+	void UdpHelper::setEmulation(double lossRate, uint delayMs, uint jitterMs)
+	{
+		emulatedLossRate = lossRate;
+		emulatedDelayMs = delayMs;
+		emulatedJitterMs = std::min(jitterMs, delayMs);
+	}
+
+
+	// opens a channel on a new port and waits for the HELLO of the other side (see "connect"), which must come
+	// from "peerIp". packets from any other address are ignored
+	bool UdpHelper::listen(int & channelId, int & port, const std::string & peerIp)
+	{
+		in_addr peerAddr;
+		if (inet_pton(AF_INET, peerIp.c_str(), &peerAddr) <= 0)
+			return false;
+
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0)
+			return false;
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = 0;
+		socklen_t addrLen = sizeof(addr);
+
+		if (bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0 or getsockname(fd, (sockaddr *) &addr, &addrLen) < 0) {
+			::close(fd);
+			return false;
+		}
+
+		port = ntohs(addr.sin_port);
+		channelId = addChannel(fd, false, peerAddr.s_addr);
+		return true;
+	}
+
+
+	// opens a channel to a listening channel of another node. returns false if it does not answer in time
+	bool UdpHelper::connect(int & channelId, const std::string & ip, int port)
+	{
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) <= 0)
+			return false;
+
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0)
+			return false;
+
+		if (::connect(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+			::close(fd);
+			return false;
+		}
+
+		channelId = addChannel(fd, false);
+		Channel * channel = getChannel(channelId);
+		std::unique_lock<std::mutex> uniqueLock(channel->mutex);
+		time_point deadline = clock::now() + std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS);
+
+		while (!channel->connected and clock::now() < deadline) {
+			sendControl(channel, HELLO);
+			channel->condVar.wait_for(uniqueLock, std::chrono::milliseconds(HELLO_INTERVAL_MS));
+		}
+
+		if (!channel->connected) {
+			channel->closed = true;
+			return false;
+		}
+		return true;
+	}
+
+
+	bool UdpHelper::isConnected(int channelId)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return false;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(channel->mutex);
+		return (channel->connected and !channel->closed);
+	}
+
+
+	void UdpHelper::close(int channelId)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return;
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(channel->mutex);
+		if (channel->closed)
+			return;
+
+		if (channel->connected) {		// best effort, bypassing the emulated link. the other side also times out
+			PacketHeader header;
+			memset(&header, 0, sizeof(header));
+			header.kind = CLOSE;
+			for (int i=0; i<3; ++i) {
+				::send(channel->fd, &header, sizeof(header), 0);
+			}
+		}
+
+		channel->closed = true;
+		channel->condVar.notify_all();
+	}
+
+
+	// queues a message and sends as much of it as the congestion window allows. the data is copied,
+	// and the call only blocks while the channel's send buffer is full
+	result_type UdpHelper::send(int channelId, uint8_t stream, msg_type tag, const void * data, size_type nBytes)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL or nBytes > MAX_MESSAGE_SIZE)
+			return FAILURE;
+
+		std::unique_lock<std::mutex> uniqueLock(channel->mutex);
+
+		while (!channel->closed and channel->bufferedBytes > 0 and channel->bufferedBytes + nBytes > SEND_BUFFER_LIMIT) {
+			channel->condVar.wait(uniqueLock);
+		}
+		if (channel->closed or !channel->connected)
+			return FAILURE;
+
+		std::shared_ptr<OutMessage> msg = std::make_shared<OutMessage>();
+		msg->bytes.assign((const char *) data, (const char *) data + nBytes);
+		msg->stream = stream;
+		msg->tag = tag;
+		msg->msgSeq = channel->nextMsgSeq[stream]++;
+		msg->nFrames = std::max(1u, (nBytes + MAX_PAYLOAD - 1) / MAX_PAYLOAD);
+		msg->nAckedFrames = 0;
+
+		for (uint i=0; i<msg->nFrames; ++i) {
+			Frame frame;
+			frame.msg = msg;
+			frame.offset = i * MAX_PAYLOAD;
+			frame.length = std::min(MAX_PAYLOAD, nBytes - frame.offset);
+			channel->pending.push_back(frame);
+		}
+
+		channel->bufferedBytes += nBytes;
+		flush(channel);
+		return SUCCESS;
+	}
+
+
+	// gives the next complete message (allocated with malloc). if "returnIfEmpty" is set
+	// and nothing arrives before a timeout, returns NOTHING
+	result_type UdpHelper::recv(int channelId, msg_type & tag, char * & data, size_type & nBytes, bool returnIfEmpty)
+	{
+		Channel * channel = getChannel(channelId);
+		if (channel == NULL)
+			return FAILURE;
+
+		std::unique_lock<std::mutex> uniqueLock(channel->mutex);
+
+		while (channel->delivered.empty()) {
+			if (channel->closed)
+				return FAILURE;
+
+			std::cv_status status = channel->condVar.wait_for(uniqueLock, std::chrono::milliseconds(RECV_TIMEOUT_MS));
+			if (status == std::cv_status::timeout and channel->delivered.empty() and returnIfEmpty)
+				return NOTHING;
+		}
+
+		const Delivery & delivery = channel->delivered.front();
+		tag = delivery.tag;
+		data = delivery.bytes;
+		nBytes = delivery.size;
+		channel->delivered.pop_front();
+		return SUCCESS;
+	}
+
+
+	std::string UdpHelper::statsToString()
+	{
+		std::stringstream ss;
+		ss << "udp packets sent: " << nPacketsSent << ", lost: " << nPacketsLost << ", timeouts: " << nTimeouts
+		   << ", dropped by emulation: " << nPacketsDropped;
+		return ss.str();
+	}
+
+	// ------------------------------------------------------
+	// Auxiliary methods
+	// ------------------------------------------------------
+
+	UdpHelper::Channel * UdpHelper::getChannel(int channelId)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(channelsMutex);
+		if (channelId < 0 or channelId >= (int) channels.size())
+			return NULL;
+		return channels[channelId];
+	}
+
+
+	int UdpHelper::addChannel(int fd, bool connected, in_addr_t allowedAddr)
+	{
+		int size = SOCKET_BUFFER_SIZE;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(channelsMutex);
+		channels.push_back(new Channel(fd, connected, allowedAddr));
+		if (serviceThread == NULL) {
+			serviceThread = new std::thread(&UdpHelper::serviceLoop, this);
+		}
+		return channels.size()-1;
+	}
+
+
+	// receives packets of every channel and runs their timers (acknowledgements, retransmissions, keepalives)
+	void UdpHelper::serviceLoop()
+	{
+		while (!shouldStop)
+		{
+			std::vector<Channel *> all;
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(channelsMutex);
+				all = channels;
+			}
+
+			std::vector<pollfd> pollFds;
+			std::vector<Channel *> polled;
+			for (Channel * channel : all) {
+				std::lock_guard<std::mutex> lockWhileInsideScope(channel->mutex);
+				if (channel->closed and channel->fd >= 0) {		// only this thread closes sockets, so they are never polled after closing
+					::close(channel->fd);
+					channel->fd = -1;
+				}
+				if (!channel->closed) {
+					pollfd pfd;
+					pfd.fd = channel->fd;
+					pfd.events = POLLIN;
+					pfd.revents = 0;
+					pollFds.push_back(pfd);
+					polled.push_back(channel);
+				}
+			}
+
+			poll(pollFds.data(), pollFds.size(), TICK_MS);
+
+			for (uint i=0; i<polled.size(); ++i) {
+				if (pollFds[i].revents & POLLIN) {
+					receivePackets(polled[i]);
+				}
+			}
+
+			time_point now = clock::now();
+			for (Channel * channel : polled) {
+				std::lock_guard<std::mutex> lockWhileInsideScope(channel->mutex);
+				tick(channel, now);
+			}
+		}
+	}
+
+
+	void UdpHelper::receivePackets(Channel * channel)
+	{
+		char buf[1 << 16];
+
+		for(;;) {
+			sockaddr_in src;
+			socklen_t srcLen = sizeof(src);
+			ssize_t length = recvfrom(channel->fd, buf, sizeof(buf), MSG_DONTWAIT, (sockaddr *) &src, &srcLen);
+			if (length < 0)
+				break;
+
+			std::lock_guard<std::mutex> lockWhileInsideScope(channel->mutex);
+			if (!channel->connected) {
+				if (channel->allowedAddr != INADDR_ANY and src.sin_addr.s_addr != channel->allowedAddr)
+					continue;		// (not the peer that the channel was opened for)
+				if (length >= (ssize_t) sizeof(PacketHeader) and ((PacketHeader *) buf)->kind == HELLO) {
+					::connect(channel->fd, (sockaddr *) &src, srcLen);		// from now on only talks to this address
+				}
+			}
+			handlePacket(channel, buf, length);
+		}
+	}
+
+
+	void UdpHelper::handlePacket(Channel * channel, const char * packet, size_t length)
+	{
+		if (length < sizeof(PacketHeader) or channel->closed)
+			return;
+
+		PacketHeader header;
+		memcpy(&header, packet, sizeof(header));
+		channel->lastReceive = clock::now();
+
+		switch (header.kind)
+		{
+			case HELLO:
+				channel->connected = true;
+				sendControl(channel, HELLO_ACK);		// also answers repeated HELLOs, whose answer may have been lost
+				channel->condVar.notify_all();
+				break;
+			case HELLO_ACK:
+				channel->connected = true;
+				channel->condVar.notify_all();
+				break;
+			case DATA:
+				handleData(channel, header, packet + sizeof(header), length - sizeof(header));
+				break;
+			case ACK:
+				handleAck(channel, packet, length);
+				break;
+			case CLOSE:
+				channel->closed = true;
+				channel->condVar.notify_all();
+				break;
+			default:		// PING only refreshes "lastReceive"
+				break;
+		}
+	}
+
+
+	void UdpHelper::handleData(Channel * channel, const PacketHeader & header, const char * payload, uint length)
+	{
+		// add the packet number to the received ranges
+		const uint64_t number = header.number;
+		auto next = channel->receivedRanges.upper_bound(number);
+		auto prev = (next == channel->receivedRanges.begin() ? channel->receivedRanges.end() : std::prev(next));
+		bool duplicate = (prev != channel->receivedRanges.end() and prev->second >= number);
+		bool inOrder = (next == channel->receivedRanges.end() and prev != channel->receivedRanges.end() and prev->second+1 == number);
+
+		if (!duplicate) {
+			uint64_t first = number, last = number;
+			if (prev != channel->receivedRanges.end() and prev->second+1 == number) {
+				first = prev->first;
+				channel->receivedRanges.erase(prev);
+			}
+			if (next != channel->receivedRanges.end() and next->first == number+1) {
+				last = next->second;
+				channel->receivedRanges.erase(next);
+			}
+			channel->receivedRanges[first] = last;
+
+			while (channel->receivedRanges.size() > 4*MAX_ACK_RANGES) {	// very old ranges will not be reported anymore
+				channel->receivedRanges.erase(channel->receivedRanges.begin());
+			}
+		}
+
+		// acknowledge at once when something seems to be missing, otherwise every second packet
+		if (!inOrder or ++channel->nNotAcked >= 2) {
+			sendAck(channel);
+		} else if (channel->ackDeadline == time_point::max()) {
+			channel->ackDeadline = clock::now() + std::chrono::milliseconds(ACK_DELAY_MS);
+		}
+
+		if (duplicate)
+			return;
+
+		// place the data in its message
+		const std::pair<uint8_t, uint64_t> key(header.stream, header.msgSeq);
+		uint64_t & expected = channel->expectedMsgSeq[header.stream];
+		if (header.msgSeq < expected or channel->outOfOrder.count(key) > 0)
+			return;		// resent data of a message that was already complete
+
+		auto it = channel->incomplete.find(key);
+		if (it == channel->incomplete.end()) {
+			if (header.msgSize > MAX_MESSAGE_SIZE)
+				return;
+			InMessage msg;
+			uint nFrames = std::max(1u, (header.msgSize + MAX_PAYLOAD - 1) / MAX_PAYLOAD);
+			msg.bytes = (char *) malloc(std::max(1u, header.msgSize));
+			msg.size = header.msgSize;
+			msg.tag = header.tag;
+			msg.receivedFrames.assign(nFrames, false);
+			msg.nMissingFrames = nFrames;
+			it = channel->incomplete.insert(std::make_pair(key, msg)).first;
+		}
+
+		// (the data must be a whole frame of the message announced by its first packet)
+		InMessage & msg = it->second;
+		uint frame = header.offset / MAX_PAYLOAD;
+		if (header.msgSize != msg.size or header.offset % MAX_PAYLOAD != 0 or frame >= msg.receivedFrames.size()
+				or header.offset > msg.size or length > msg.size - header.offset
+				or length != std::min(MAX_PAYLOAD, msg.size - header.offset) or msg.receivedFrames[frame])
+			return;
+
+		memcpy(msg.bytes + header.offset, payload, length);
+		msg.receivedFrames[frame] = true;
+		if (--msg.nMissingFrames > 0)
+			return;
+
+		Delivery delivery;
+		delivery.bytes = msg.bytes;
+		delivery.size = msg.size;
+		delivery.tag = msg.tag;
+		channel->incomplete.erase(it);
+		channel->outOfOrder[key] = delivery;
+
+		// deliver every message of the stream that is now in order
+		auto ready = channel->outOfOrder.find(std::make_pair(header.stream, expected));
+		bool deliveredAny = false;
+		while (ready != channel->outOfOrder.end()) {
+			channel->delivered.push_back(ready->second);
+			channel->outOfOrder.erase(ready);
+			++expected;
+			deliveredAny = true;
+			ready = channel->outOfOrder.find(std::make_pair(header.stream, expected));
+		}
+
+		if (deliveredAny) {
+			channel->condVar.notify_all();
+		}
+	}
+
+
+	void UdpHelper::handleAck(Channel * channel, const char * packet, size_t length)
+	{
+		const char * ptr = packet + sizeof(PacketHeader);
+		const char * end = packet + length;
+		uint32_t nRanges;
+		if (ptr + sizeof(nRanges) > end)
+			return;
+		memcpy(&nRanges, ptr, sizeof(nRanges));
+		ptr += sizeof(nRanges);
+
+		uint64_t largestNew = 0;
+		time_point largestSentAt;
+		bool freedBuffer = false;
+
+		for (uint r=0; r<nRanges and ptr + 2*sizeof(uint64_t) <= end; ++r)
+		{
+			uint64_t first, last;
+			memcpy(&first, ptr, sizeof(first));
+			memcpy(&last, ptr + sizeof(first), sizeof(last));
+			ptr += 2*sizeof(uint64_t);
+
+			auto lost = channel->lostNumbers.lower_bound(first);
+			if (lost != channel->lostNumbers.end() and *lost <= last) {		// it arrived after all: the link reorders packets
+				channel->reorderThreshold = std::min(MAX_REORDER_THRESHOLD, channel->reorderThreshold*2);
+				channel->reorderTime = std::min(MAX_REORDER_TIME, channel->reorderTime + 0.25);
+				if (channel->reductionCause >= first and channel->reductionCause <= last) {		// undo the reduction it caused
+					channel->cwnd = std::max(channel->cwnd, channel->cwndBeforeReduction);
+					channel->ssthresh = std::max(channel->ssthresh, channel->ssthreshBeforeReduction);
+					channel->reductionCause = 0;
+				}
+				while (lost != channel->lostNumbers.end() and *lost <= last) {
+					lost = channel->lostNumbers.erase(lost);
+				}
+			}
+
+			auto it = channel->unacked.lower_bound(first);
+			while (it != channel->unacked.end() and it->first <= last)
+			{
+				if (it->first > largestNew) {
+					largestNew = it->first;
+					largestSentAt = it->second.sentAt;
+				}
+
+				OutMessage & msg = *it->second.frame.msg;
+				if (++msg.nAckedFrames == msg.nFrames) {
+					channel->bufferedBytes -= msg.bytes.size();
+					freedBuffer = true;
+				}
+
+				if (it->first > channel->recoveryPoint) {		// the window does not grow while recovering from a loss
+					channel->cwnd += (channel->cwnd < channel->ssthresh ? 1 : 1/channel->cwnd);
+				}
+				it = channel->unacked.erase(it);
+			}
+		}
+
+		if (largestNew > channel->largestAcked) {
+			channel->largestAcked = largestNew;
+
+			double sample = std::chrono::duration<double, std::milli>(clock::now() - largestSentAt).count();
+			if (channel->srtt == 0) {
+				channel->srtt = sample;
+				channel->rttvar = sample/2;
+			} else {
+				channel->rttvar = 0.75*channel->rttvar + 0.25*std::abs(channel->srtt - sample);
+				channel->srtt = 0.875*channel->srtt + 0.125*sample;
+			}
+			channel->rtoMs = std::min(MAX_RTO_MS, std::max(MIN_RTO_MS, (long) (channel->srtt + 4*channel->rttvar)));
+		}
+
+		// packets sent well before the largest acknowledged one are lost (queued from the last, so that they are resent in order)
+		if (channel->largestAcked >= channel->reorderThreshold) {
+			auto lostEnd = channel->unacked.upper_bound(channel->largestAcked - channel->reorderThreshold);
+			while (channel->unacked.begin() != lostEnd) {
+				declareLost(channel, std::prev(lostEnd));
+			}
+		}
+
+		if (freedBuffer) {
+			channel->condVar.notify_all();
+		}
+		flush(channel);
+	}
+
+
+	void UdpHelper::tick(Channel * channel, const time_point & now)
+	{
+		while (!channel->delayed.empty() and channel->delayed.begin()->first <= now) {
+			const std::vector<char> & packet = channel->delayed.begin()->second;
+			::send(channel->fd, packet.data(), packet.size(), 0);
+			channel->delayed.erase(channel->delayed.begin());
+		}
+
+		if (!channel->connected)
+			return;
+
+		if (channel->ackDeadline <= now) {
+			sendAck(channel);
+		}
+
+		// packets older than a later acknowledged one are lost when they take much longer than an RTT
+		if (channel->srtt > 0) {
+			time_point limit = now - std::chrono::microseconds((long) (channel->reorderTime * channel->srtt * 1000));
+			auto lostEnd = channel->unacked.begin();
+			while (lostEnd != channel->unacked.end() and lostEnd->first < channel->largestAcked and lostEnd->second.sentAt <= limit) {
+				++lostEnd;
+			}
+			if (lostEnd != channel->unacked.begin()) {
+				while (channel->unacked.begin() != lostEnd) {
+					declareLost(channel, std::prev(lostEnd));
+				}
+				flush(channel);
+			}
+		}
+
+		// nothing was acknowledged for too long. resend everything with a minimal window
+		if (!channel->unacked.empty() and channel->unacked.begin()->second.sentAt + std::chrono::milliseconds(channel->rtoMs) <= now) {
+			++nTimeouts;
+			while (!channel->unacked.empty()) {
+				declareLost(channel, std::prev(channel->unacked.end()));	// from the end, so that the data is queued in order
+			}
+			channel->cwnd = 2;
+			channel->rtoMs = std::min(MAX_RTO_MS, channel->rtoMs*2);
+			flush(channel);
+		}
+
+		if (now - channel->lastSend >= std::chrono::milliseconds(KEEPALIVE_MS)) {
+			sendControl(channel, PING);
+		}
+
+		if (now - channel->lastReceive >= std::chrono::milliseconds(DEAD_TIMEOUT_MS)) {
+			channel->closed = true;
+			channel->condVar.notify_all();
+		}
+	}
+
+
+	// sends pending data while the congestion window has room
+	void UdpHelper::flush(Channel * channel)
+	{
+		if (channel->closed or !channel->connected)
+			return;
+
+		char packet[sizeof(PacketHeader) + MAX_PAYLOAD];
+		time_point now = clock::now();
+
+		while (!channel->pending.empty() and channel->unacked.size() < (size_t) channel->cwnd)
+		{
+			const Frame & frame = channel->pending.front();
+			const OutMessage & msg = *frame.msg;
+
+			PacketHeader header;
+			memset(&header, 0, sizeof(header));
+			header.number = channel->nextPacketNumber++;
+			header.msgSeq = msg.msgSeq;
+			header.msgSize = msg.bytes.size();
+			header.offset = frame.offset;
+			header.kind = DATA;
+			header.stream = msg.stream;
+			header.tag = msg.tag;
+
+			memcpy(packet, &header, sizeof(header));
+			memcpy(packet + sizeof(header), msg.bytes.data() + frame.offset, frame.length);
+			transmit(channel, packet, sizeof(header) + frame.length);
+
+			SentPacket & sent = channel->unacked[header.number];
+			sent.frame = frame;
+			sent.sentAt = now;
+			channel->pending.pop_front();
+		}
+	}
+
+
+	// reports the most recent ranges of received packet numbers
+	void UdpHelper::sendAck(Channel * channel)
+	{
+		std::vector<char> packet(sizeof(PacketHeader) + sizeof(uint32_t));
+		PacketHeader header;
+		memset(&header, 0, sizeof(header));
+		header.kind = ACK;
+
+		uint32_t nRanges = 0;
+		for (auto it = channel->receivedRanges.rbegin(); it != channel->receivedRanges.rend() and nRanges < MAX_ACK_RANGES; ++it, ++nRanges) {
+			packet.insert(packet.end(), (const char *) &it->first, (const char *) &it->first + sizeof(uint64_t));
+			packet.insert(packet.end(), (const char *) &it->second, (const char *) &it->second + sizeof(uint64_t));
+		}
+
+		memcpy(packet.data(), &header, sizeof(header));
+		memcpy(packet.data() + sizeof(header), &nRanges, sizeof(nRanges));
+		transmit(channel, packet.data(), packet.size());
+
+		channel->nNotAcked = 0;
+		channel->ackDeadline = time_point::max();
+	}
+
+
+	void UdpHelper::sendControl(Channel * channel, packet_kind kind)
+	{
+		PacketHeader header;
+		memset(&header, 0, sizeof(header));
+		header.kind = kind;
+		transmit(channel, (const char *) &header, sizeof(header));
+	}
+
+
+	void UdpHelper::transmit(Channel * channel, const char * packet, size_t length)
+	{
+		channel->lastSend = clock::now();
+		++nPacketsSent;
+
+		if (emulatedLossRate > 0 and std::uniform_real_distribution<double>(0, 1)(channel->rng) < emulatedLossRate) {
+			++nPacketsDropped;
+			return;
+		}
+
+		if (emulatedDelayMs > 0) {
+			int jitter = std::uniform_int_distribution<int>(-(int) emulatedJitterMs, emulatedJitterMs)(channel->rng);
+			time_point due = channel->lastSend + std::chrono::milliseconds(emulatedDelayMs + jitter);
+			channel->delayed.insert(std::make_pair(due, std::vector<char>(packet, packet + length)));
+			return;
+		}
+
+		::send(channel->fd, packet, length, 0);		// a failed send is just one more lost packet
+	}
+
+
+	// queues the data of a lost packet to be sent again and shrinks the window (once per window of data)
+	void UdpHelper::declareLost(Channel * channel, std::map<uint64_t, SentPacket>::iterator it)
+	{
+		++nPacketsLost;
+		channel->lostNumbers.insert(it->first);
+		if (channel->lostNumbers.size() > MAX_REMEMBERED_LOSSES) {
+			channel->lostNumbers.erase(channel->lostNumbers.begin());
+		}
+
+		if (it->first > channel->recoveryPoint) {
+			channel->reductionCause = it->first;
+			channel->cwndBeforeReduction = channel->cwnd;
+			channel->ssthreshBeforeReduction = channel->ssthresh;
+			channel->ssthresh = std::max(channel->cwnd * DECREASE_FACTOR, 2.0);
+			channel->cwnd = channel->ssthresh;
+			channel->recoveryPoint = channel->nextPacketNumber-1;
+		}
+
+		channel->pending.push_front(it->second.frame);
+		channel->unacked.erase(it);
+	}
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef UDPHELPER_HPP_
+#define UDPHELPER_HPP_
+
+#include "CommonDefines.hpp"
+
+#ifndef DISABLE_UDP
+
+#include "CommonTypes.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <netinet/in.h>
+
+
+namespace igcl
+{
+	/*
+	 * Reliable message transport over UDP, meant for high-latency links where TCP and libnice's pseudo-TCP
+	 * perform poorly. Messages are split into packets that the receiver acknowledges selectively (ranges of
+	 * received packet numbers). Lost data is resent in new packets, and the amount of data in flight follows
+	 * a NewReno-like congestion window. Each stream is ordered independently, so a loss only delays messages
+	 * of its own stream. Outgoing packets may pass through an emulated lossy and slow link (like netem's).
+	 */
+	class UdpHelper
+	{
+		// ======================================================
+		// ==================== DEFINITIONS =====================
+		// ======================================================
+
+		typedef std::chrono::steady_clock clock;
+		typedef clock::time_point time_point;
+
+		static const uint MAX_PAYLOAD = 1200;				// bytes of message data per packet (fits the usual Internet MTU)
+		static const uint MAX_MESSAGE_SIZE = 1 << 28;		// (the receiver allocates a message once its first packet arrives)
+		static const uint MAX_ACK_RANGES = 64;				// ranges of packet numbers reported in each ACK
+		static const uint SEND_BUFFER_LIMIT = 1 << 23;		// senders block while this many bytes are unacknowledged
+		static const uint SOCKET_BUFFER_SIZE = 1 << 22;
+		static const uint INITIAL_WINDOW = 10;				// packets
+		static const uint REORDER_THRESHOLD = 3;			// a packet is lost once this many later packets were acknowledged
+		static const uint MAX_REORDER_THRESHOLD = 64;		// (grows whenever a packet deemed lost is acknowledged after all)
+		static constexpr double REORDER_TIME = 1.25;		// ... or once a later packet was acknowledged and this many RTTs passed
+		static constexpr double MAX_REORDER_TIME = 2;
+		static const uint MAX_REMEMBERED_LOSSES = 1024;
+		static constexpr double DECREASE_FACTOR = 0.7;		// of the window, on loss (as in CUBIC, milder than Reno's)
+		static const long TICK_MS = 5;
+		static const long ACK_DELAY_MS = 5;
+		static const long MIN_RTO_MS = 200;
+		static const long MAX_RTO_MS = 5000;
+		static const long KEEPALIVE_MS = 1000;
+		static const long DEAD_TIMEOUT_MS = 15000;
+		static const long HELLO_INTERVAL_MS = 200;
+		static const long HANDSHAKE_TIMEOUT_MS = 3000;
+		static const long RECV_TIMEOUT_MS = 200;
+
+		enum packet_kind : uint8_t { HELLO, HELLO_ACK, DATA, ACK, PING, CLOSE };
+
+		struct PacketHeader
+		{
+			uint64_t number;			// packet number (never reused, not even to resend data)
+			uint64_t msgSeq;			// message number inside its stream
+			uint32_t msgSize;			// total bytes of the message
+			uint32_t offset;			// of this packet's data inside the message
+			uint8_t kind;
+			uint8_t stream;
+			msg_type tag;				// opaque to the helper (IGCL message type)
+		};
+
+		struct OutMessage
+		{
+			std::vector<char> bytes;
+			uint8_t stream;
+			msg_type tag;
+			uint64_t msgSeq;
+			uint nFrames, nAckedFrames;
+		};
+
+		struct Frame			// piece of a message that travels in one packet
+		{
+			std::shared_ptr<OutMessage> msg;
+			uint offset, length;
+		};
+
+		struct SentPacket
+		{
+			Frame frame;
+			time_point sentAt;
+		};
+
+		struct InMessage
+		{
+			char * bytes;
+			size_type size;
+			msg_type tag;
+			std::vector<bool> receivedFrames;
+			uint nMissingFrames;
+		};
+
+		struct Delivery
+		{
+			char * bytes;
+			size_type size;
+			msg_type tag;
+		};
+
+		struct Channel
+		{
+			int fd;
+			bool connected, closed;
+			in_addr_t allowedAddr;					// (listening channels) the only address that may connect to them
+			std::mutex mutex;
+			std::condition_variable condVar;		// signals deliveries, freed send buffer and handshake changes
+
+			// sending side
+			uint64_t nextPacketNumber;
+			std::map<uint8_t, uint64_t> nextMsgSeq;
+			std::deque<Frame> pending;				// waiting for room in the window (resent data goes first)
+			std::map<uint64_t, SentPacket> unacked;
+			uint64_t largestAcked, recoveryPoint;
+			uint bufferedBytes;
+			double cwnd, ssthresh;
+			double srtt, rttvar;
+			long rtoMs;
+			uint reorderThreshold;
+			double reorderTime;
+			std::set<uint64_t> lostNumbers;			// to detect reordering mistaken for loss
+			uint64_t reductionCause;				// lost packet that made the window shrink last time
+			double cwndBeforeReduction, ssthreshBeforeReduction;
+			time_point lastSend;
+
+			// receiving side
+			std::map<uint64_t, uint64_t> receivedRanges;		// first -> last packet number of each run
+			uint nNotAcked;
+			time_point ackDeadline;
+			std::map<uint8_t, uint64_t> expectedMsgSeq;
+			std::map<std::pair<uint8_t, uint64_t>, InMessage> incomplete;
+			std::map<std::pair<uint8_t, uint64_t>, Delivery> outOfOrder;
+			std::deque<Delivery> delivered;
+			time_point lastReceive;
+
+			// link emulation
+			std::multimap<time_point, std::vector<char> > delayed;
+			std::mt19937 rng;
+
+			Channel(int fd, bool connected, in_addr_t allowedAddr);
+		};
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
+	private:
+		std::vector<Channel *> channels;		// indexed by channel ID (the descriptor of DESCRIPTOR_UDP peers)
+		std::mutex channelsMutex;
+		std::thread * serviceThread;
+		std::atomic<bool> shouldStop;
+
+		double emulatedLossRate;
+		uint emulatedDelayMs, emulatedJitterMs;
+
+		std::atomic<ulong> nPacketsSent, nPacketsLost, nPacketsDropped, nTimeouts;
+
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
+	public:
+		UdpHelper();
+		~UdpHelper();
+
+		void setEmulation(double lossRate, uint delayMs, uint jitterMs);
+
+		bool listen(int & channelId, int & port, const std::string & peerIp);
+		bool connect(int & channelId, const std::string & ip, int port);
+		bool isConnected(int channelId);
+		void close(int channelId);
+
+		result_type send(int channelId, uint8_t stream, msg_type tag, const void * data, size_type nBytes);
+		result_type recv(int channelId, msg_type & tag, char * & data, size_type & nBytes, bool returnIfEmpty);
+
+		std::string statsToString();
+
+	private:
+		Channel * getChannel(int channelId);
+		int addChannel(int fd, bool connected, in_addr_t allowedAddr = INADDR_ANY);
+		void serviceLoop();
+
+		void receivePackets(Channel * channel);
+		void handlePacket(Channel * channel, const char * packet, size_t length);
+		void handleData(Channel * channel, const PacketHeader & header, const char * payload, uint length);
+		void handleAck(Channel * channel, const char * packet, size_t length);
+		void tick(Channel * channel, const time_point & now);
+
+		void flush(Channel * channel);
+		void sendAck(Channel * channel);
+		void sendControl(Channel * channel, packet_kind kind);
+		void transmit(Channel * channel, const char * packet, size_t length);
+		void declareLost(Channel * channel, std::map<uint64_t, SentPacket>::iterator it);
+	};
+}
+
+#endif
+
+#endif /* UDPHELPER_HPP_ */
@@ -0,0 +1,340 @@
+#include "WorkStealing.hpp"
+#include "Node.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+
+namespace igcl		// Internet Group-Communication Library
+{
+	const uint WorkStealing::STEAL_TIMEOUT_MS;
+	const uint WorkStealing::MAX_BACKOFF_MS;
+
+	// ------------------------------------------------------
+	// Constructor/destructor
+	// ------------------------------------------------------
+
+	// the node must have started (its id and the size of the group must be known)
+	WorkStealing::WorkStealing(Node * node)
+		: node(node), round(0), finishedRound(0), hasCurrentJob(false), waitingReply(false), nUnreportedJobs(0), nJobs(0),
+		  random(clock::now().time_since_epoch().count() + node->getId()), stopping(false),
+		  nDoneJobs(0), nStolenJobs(0), nGivenJobs(0), nSteals(0), nFailedSteals(0), idleTime(0)
+	{
+		senderThread = new std::thread(&WorkStealing::sendLoop, this);
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(node->workStealingMutex);
+		node->workStealing = this;
+	}
+
+
+	// (messages still in the outbox, like the end of the last round, are sent first)
+	WorkStealing::~WorkStealing()
+	{
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(node->workStealingMutex);
+			node->workStealing = NULL;
+		}
+		{
+			std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+			stopping = true;
+			outboxCondVar.notify_all();
+		}
+		senderThread->join();
+		delete senderThread;
+	}
+
+	// ------------------------------------------------------
+	// Jobs
+	// ------------------------------------------------------
+
+	// starts a new round of jobs. every node of the group must start the same rounds, with the same "nJobs"
+	void WorkStealing::start(uint64_t nJobs)
+	{
+		std::unique_lock<std::mutex> uniqueLock(mutex);
+
+		round++;
+		this->nJobs = nJobs;
+		ranges.clear();
+		hasCurrentJob = waitingReply = false;
+		nUnreportedJobs = nDoneJobs = nStolenJobs = nGivenJobs = 0;
+		nSteals = nFailedSteals = 0;
+		idleTime = clock::duration(0);
+		roundStart = roundEnd = clock::now();
+
+		uint64_t nNodes = node->getNPeers();
+		uint64_t id = node->getId();
+		uint64_t nPerNode = nJobs / nNodes;
+		uint64_t remainder = nJobs % nNodes;
+		Range own;
+		own.begin = nPerNode * id + std::min(id, remainder);
+		own.end = own.begin + nPerNode + (id < remainder ? 1 : 0);
+		if (own.begin < own.end) {
+			ranges.push_back(own);
+		}
+
+		// (node 0 may have been told of jobs done in this round before it started it)
+		doneJobs.erase(doneJobs.begin(), doneJobs.lower_bound(round));
+		bool isOver = (id == 0 and doneJobs[round] >= nJobs);
+		uniqueLock.unlock();
+
+		if (isOver) {
+			finish(round);
+		}
+	}
+
+
+	// gets the next job to do (which means the previous one was done). steals jobs from other nodes when out of
+	// its own. returns false once every job of the round was done, by any node
+	bool WorkStealing::next(uint64_t & job)
+	{
+		std::unique_lock<std::mutex> uniqueLock(mutex);
+
+		if (hasCurrentJob) {
+			hasCurrentJob = false;
+			nDoneJobs++;
+			nUnreportedJobs++;
+		}
+
+		clock::time_point idleStart = clock::now();
+		uint backoffMs = 1;
+
+		while (1)
+		{
+			if (!ranges.empty()) {
+				Range & range = ranges.front();
+				job = range.begin++;
+				if (range.begin == range.end) {
+					ranges.pop_front();
+				}
+				hasCurrentJob = true;
+				idleTime += clock::now() - idleStart;
+				return true;
+			}
+
+			if (finishedRound >= round) {
+				roundEnd = clock::now();
+				idleTime += roundEnd - idleStart;
+				return false;
+			}
+
+			if (nUnreportedJobs > 0) {
+				reportDoneJobs(uniqueLock);
+				continue;
+			}
+
+			if (!steal(uniqueLock)) {
+				condVar.wait_for(uniqueLock, std::chrono::milliseconds(backoffMs));
+				backoffMs = std::min(backoffMs * 2, MAX_BACKOFF_MS);
+			}
+		}
+	}
+
+	// ------------------------------------------------------
+	// Stats
+	// ------------------------------------------------------
+
+	// time spent (in the current round) waiting for jobs from other nodes
+	double WorkStealing::getIdleMs()
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		return std::chrono::duration<double, std::milli>(idleTime).count();
+	}
+
+
+	// time spent (in the current round) with jobs to do
+	double WorkStealing::getBusyMs()
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		clock::time_point end = (finishedRound >= round ? roundEnd : clock::now());
+		return std::chrono::duration<double, std::milli>(end - roundStart - idleTime).count();
+	}
+
+
+	std::string WorkStealing::statsToString()
+	{
+		double busyMs = getBusyMs();
+		double idleMs = getIdleMs();
+
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1);
+		ss << "jobs done: " << nDoneJobs << ", stolen: " << nStolenJobs << " in " << nSteals << " steals (" << nFailedSteals
+		   << " failed), given: " << nGivenJobs << ", busy: " << busyMs << " ms, idle: " << idleMs << " ms";
+		return ss.str();
+	}
+
+	// ------------------------------------------------------
+	// Messages
+	// ------------------------------------------------------
+
+	// asks a random peer for jobs and waits for its answer. returns false if nothing was received.
+	// (messages are sent with "mutex" unlocked, since nodes of the same process handle them in the sender's thread)
+	bool WorkStealing::steal(std::unique_lock<std::mutex> & uniqueLock)
+	{
+		std::vector<peer_id> victims;
+		for (peer_id id : node->knownPeers.getAllIds()) {
+			if (id != node->getId() and node->knownPeers.idToDescriptor(id).type != DESCRIPTOR_NONE) {
+				victims.push_back(id);
+			}
+		}
+		if (victims.empty())
+			return false;
+
+		peer_id victim = victims[random() % victims.size()];
+		WorkMessage msg = { round, 0, 0 };
+		waitingReply = true;
+		nSteals++;
+
+		uniqueLock.unlock();
+		result_type res = node->sendWorkMessage(victim, WORK_STEAL, msg);
+		uniqueLock.lock();
+
+		if (res == SUCCESS) {
+			condVar.wait_for(uniqueLock, std::chrono::milliseconds(STEAL_TIMEOUT_MS),
+					[this] { return !waitingReply or finishedRound >= round; });
+		}
+		waitingReply = false;
+
+		if (ranges.empty()) {
+			nFailedSteals++;
+			return false;
+		}
+		return true;
+	}
+
+
+	// tells node 0 how many jobs were done since the last report (with "mutex" locked)
+	void WorkStealing::reportDoneJobs(std::unique_lock<std::mutex> & uniqueLock)
+	{
+		WorkMessage msg = { round, nUnreportedJobs, 0 };
+		nUnreportedJobs = 0;
+
+		uniqueLock.unlock();
+		if (node->getId() == 0) {
+			whenDone(msg.round, msg.begin);
+		} else {
+			node->sendWorkMessage(0, WORK_DONE, msg);
+		}
+		uniqueLock.lock();
+	}
+
+
+	// (node 0)
+	void WorkStealing::whenDone(uint32_t round, uint64_t count)
+	{
+		std::unique_lock<std::mutex> uniqueLock(mutex);
+		uint64_t & done = doneJobs[round];
+		done += count;
+		bool isOver = (round == this->round and done >= nJobs and finishedRound < round);
+		uniqueLock.unlock();
+
+		if (isOver) {
+			finish(round);
+		}
+	}
+
+
+	// (node 0) every job of the round was done
+	void WorkStealing::finish(uint32_t round)
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		finishedRound = std::max(finishedRound, round);
+		condVar.notify_all();
+
+		WorkMessage msg = { round, 0, 0 };
+		for (peer_id id : node->knownPeers.getAllIds()) {
+			if (id != node->getId()) {
+				post(id, WORK_FINISHED, msg);
+			}
+		}
+	}
+
+
+	// queues a message for the sender thread (with "mutex" locked)
+	void WorkStealing::post(peer_id id, msg_type type, const WorkMessage & msg)
+	{
+		OutgoingMessage outgoing = { id, type, msg };
+		outbox.push_back(outgoing);
+		outboxCondVar.notify_one();
+	}
+
+
+	// sends the queued messages, in order
+	void WorkStealing::sendLoop()
+	{
+		std::unique_lock<std::mutex> uniqueLock(mutex);
+
+		while (1)
+		{
+			outboxCondVar.wait(uniqueLock, [this] { return stopping or !outbox.empty(); });
+			if (outbox.empty())
+				return;		// (stopping)
+
+			OutgoingMessage outgoing = outbox.front();
+			outbox.pop_front();
+
+			uniqueLock.unlock();
+			node->sendWorkMessage(outgoing.id, outgoing.type, outgoing.msg);
+			uniqueLock.lock();
+		}
+	}
+
+
+	// called by the receiver thread of the node (with the node's "workStealingMutex" locked)
+	result_type WorkStealing::whenReceived(peer_id id, msg_type type, const WorkMessage & msg)
+	{
+		switch (type)
+		{
+			case WORK_STEAL:
+			{
+				// gives the second half of the last range (the jobs this node would only get to last)
+				std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+				WorkMessage reply = { msg.round, 0, 0 };
+				if (msg.round == round and !ranges.empty()) {
+					Range & last = ranges.back();
+					reply.begin = last.begin + (last.end - last.begin) / 2;
+					reply.end = last.end;
+					last.end = reply.begin;
+					if (last.begin == last.end) {
+						ranges.pop_back();
+					}
+					nGivenJobs += reply.end - reply.begin;
+				}
+				post(id, WORK_GIVEN, reply);
+				return SUCCESS;
+			}
+
+			case WORK_GIVEN:
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+				if (msg.round == round) {
+					if (msg.begin < msg.end) {
+						Range range = { msg.begin, msg.end };
+						ranges.push_back(range);
+						nStolenJobs += msg.end - msg.begin;
+					}
+					waitingReply = false;
+					condVar.notify_all();
+				}
+				return SUCCESS;
+			}
+
+			case WORK_DONE:
+				whenDone(msg.round, msg.begin);
+				return SUCCESS;
+
+			case WORK_FINISHED:
+			{
+				std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+				finishedRound = std::max(finishedRound, msg.round);
+				condVar.notify_all();
+				return SUCCESS;
+			}
+
+			default:
+				return FAILURE;
+		}
+	}
+}
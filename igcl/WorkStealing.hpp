@@ -0,0 +1,116 @@
+#ifndef WORKSTEALING_HPP_
+#define WORKSTEALING_HPP_
+
+#include "CommonTypes.hpp"
+
+#include <string>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <random>
+#include <chrono>
+#include <cstdint>
+
+
+namespace igcl
+{
+	class Node;
+
+	// payload of every work stealing message
+	struct WorkMessage
+	{
+		uint32_t round;
+		uint64_t begin, end;		// jobs [begin, end) given by a victim, or "begin" jobs done (reported to node 0)
+	};
+
+	/*
+	 * Decentralized scheduling of jobs 0..nJobs-1 among all the nodes of a group. Each node starts with its part of
+	 * an even split and takes its jobs in order. A node that runs out of jobs asks a random peer, which gives it the
+	 * second half of its last range of jobs. Steal messages travel in the control lanes, so they do not wait behind
+	 * bulk data, and are answered without the help of the user's thread, so nodes keep working on their own jobs.
+	 * Answers are sent by a thread of this service, since the receiver thread must never wait for a link.
+	 * Node 0 counts the jobs done by everyone and tells all the nodes when every job was done.
+	 * Stealing needs direct links, so relayed peers are never asked.
+	 */
+	class WorkStealing
+	{
+		friend class Node;
+
+		// ======================================================
+		// ==================== DEFINITIONS =====================
+		// ======================================================
+
+		typedef std::chrono::steady_clock clock;
+
+		struct Range
+		{
+			uint64_t begin, end;
+		};
+
+		struct OutgoingMessage
+		{
+			peer_id id;
+			msg_type type;
+			WorkMessage msg;
+		};
+
+		static const uint STEAL_TIMEOUT_MS = 500;		// a thief stops waiting for an answer after this long
+		static const uint MAX_BACKOFF_MS = 20;			// (and waits up to this long after every failed attempt)
+
+		// ======================================================
+		// ==================== ATTRIBUTES ======================
+		// ======================================================
+	private:
+		Node * node;
+
+		std::deque<Range> ranges;
+		uint32_t round;
+		uint32_t finishedRound;							// last round known to be over
+		bool hasCurrentJob, waitingReply;
+		uint64_t nUnreportedJobs;
+		std::map<uint32_t, uint64_t> doneJobs;			// (node 0) jobs done in each round, as reported
+		uint64_t nJobs;
+		std::mutex mutex;
+		std::condition_variable condVar;
+		std::mt19937 random;
+
+		std::deque<OutgoingMessage> outbox;			// answers and announcements, sent by "senderThread"
+		std::condition_variable outboxCondVar;
+		bool stopping;
+		std::thread * senderThread;
+
+		// stats of the current round
+		uint64_t nDoneJobs, nStolenJobs, nGivenJobs;
+		uint nSteals, nFailedSteals;
+		clock::time_point roundStart, roundEnd;
+		clock::duration idleTime;
+
+		// ======================================================
+		// ===================== METHODS ========================
+		// ======================================================
+	public:
+		WorkStealing(Node * node);
+		~WorkStealing();
+
+		void start(uint64_t nJobs);
+		bool next(uint64_t & job);
+
+		double getIdleMs();
+		double getBusyMs();
+		std::string statsToString();
+
+	private:
+		bool steal(std::unique_lock<std::mutex> & lock);
+		void reportDoneJobs(std::unique_lock<std::mutex> & uniqueLock);
+		void whenDone(uint32_t round, uint64_t count);
+		void finish(uint32_t round);
+		void post(peer_id id, msg_type type, const WorkMessage & msg);
+		void sendLoop();
+
+		result_type whenReceived(peer_id id, msg_type type, const WorkMessage & msg);
+	};
+}
+
+#endif /* WORKSTEALING_HPP_ */
@@ -8,6 +8,8 @@
 #include "Common.hpp"
 #include "Peer.hpp"
 #include "Coordinator.hpp"
+#include "WorkStealing.hpp"
+#include "SharedBound.hpp"
 #include "Utils.hpp"
 
 #endif /* IGCL_HPP_ */
@@ -6,54 +6,56 @@
 
 GeneticAlgorithm::GeneticAlgorithm(int seed)
 {
-	if (seed == 0) {
-		rng.seed(time(NULL));
-		srand(time(NULL));
-	} else {
-		rng.seed(seed);
-		srand(seed);
-	}
+	this->seed = (seed == 0 ? time(NULL) : seed);
+	nThreads = 1;
+	island = 0;
+	threadPool = NULL;
+	startThreads();
 
 	doneGenerations = 0;
 	doneMutations = 0;
 	doneRecombinations = 0;
 	doneEvaluations = 0;
+	doneDeltaEvaluations = 0;
 }
 
 GeneticAlgorithm::~GeneticAlgorithm()
 {
 	for (Individual * indiv : population)
 		delete indiv;
+	for (Individual * indiv : offspring)
+		delete indiv;
+	for (Individual * indiv : newPopulation)
+		delete indiv;
+	delete threadPool;
 }
 
 void GeneticAlgorithm::start()
 {
+	startThreads();
+	seedThreads();
+	prepareThreads(threadStates.size());
 	generate(population);
 	evaluate(population);
 	std::sort(population.begin(), population.end(), *sortingFunctor);
+	allocateBuffers();
 
 	++doneGenerations;
 }
 
+// (no individual is allocated or deleted: the new population is written into a second buffer, which then
+// takes the place of the old one)
 void GeneticAlgorithm::loop()
 {
-	population_type offspring;
-	select(population, offspring);	// clones selected population to offspring
+	select(population, offspring);	// copies selected population to offspring
 
 	mutate(offspring);
 	recombine(offspring); // includes population shuffling
 	evaluate(offspring);
 
-	population_type newPopulation;
 	unite(population, offspring, newPopulation); // includes population sorting
 
-	// delete every old Individual
-	for (Individual * indiv : population)
-		delete indiv;
-	for (Individual * indiv : offspring)
-		delete indiv;
-
-	population = newPopulation;
+	population.swap(newPopulation);
 
 	++doneGenerations;
 }
@@ -63,7 +65,7 @@ void GeneticAlgorithm::generate(population_type & population)
 	population.resize(populationSize);
 
 	for (unsigned i = 0; i < population.size(); i++) {
-		population[i] = generateIndividual();
+		population[i] = generateIndividual(0);
 		population[i]->hasChanged = true;
 	}
 }
@@ -71,49 +73,72 @@ void GeneticAlgorithm::generate(population_type & population)
 // evaluation and in-place fitness setting
 void GeneticAlgorithm::evaluate(const population_type & population)
 {
-	for (unsigned i = 0; i < population.size(); i++) {
-		if (population[i]->hasChanged) {
-			population[i]->fitness = evaluateIndividual(population[i]);
-			population[i]->hasChanged = false;
-			++doneEvaluations;
+	forEachRange(population.size(), [this, &population](unsigned begin, unsigned end, unsigned thread) {
+		for (unsigned i = begin; i < end; i++) {
+			if (population[i]->hasChanged) {
+				population[i]->fitness = evaluateIndividual(population[i]);
+				population[i]->hasChanged = false;
+				++threadStates[thread].doneEvaluations;
+			}
 		}
-	}
+	});
 }
 
-// in-place mutation
+// in-place mutation (individuals whose fitness was known and was updated by the mutation need no evaluation)
 void GeneticAlgorithm::mutate(population_type & population)
 {
-	for (unsigned i = 0; i < population.size(); i++) {
-		if (random() < mutationChance) {
-			mutateIndividual(population[i]);
-			population[i]->hasChanged = true;
-			++doneMutations;
+	forEachRange(population.size(), [this, &population](unsigned begin, unsigned end, unsigned thread) {
+		ThreadState & state = threadStates[thread];
+		for (unsigned i = begin; i < end; i++) {
+			if (random(thread) < mutationChance) {
+				bool wasEvaluated = !population[i]->hasChanged;
+				if (mutateIndividual(population[i], thread) and wasEvaluated) {
+					++state.doneDeltaEvaluations;
+				} else {
+					population[i]->hasChanged = true;
+				}
+				++state.doneMutations;
+			}
 		}
-	}
+	});
 }
 
 // in-place recombination
 void GeneticAlgorithm::recombine(population_type & population)
 {
-	std::random_shuffle(population.begin(), population.end());
-
-	for (unsigned i = 0; i < population.size() / 2 * 2; i += 2) {
-		if (random() < crossoverChance) {
-			recombinePair(population[i], population[i+1]);
-			population[ i ]->hasChanged = true;
-			population[i+1]->hasChanged = true;
-			++doneRecombinations;
+	threadStates[0].rng.shuffle(population.begin(), population.end());
+
+	forEachRange(population.size() / 2, [this, &population](unsigned begin, unsigned end, unsigned thread) {
+		for (unsigned i = begin * 2; i < end * 2; i += 2) {
+			if (random(thread) < crossoverChance) {
+				recombinePair(population[i], population[i+1], thread);
+				population[ i ]->hasChanged = true;
+				population[i+1]->hasChanged = true;
+				++threadStates[thread].doneRecombinations;
+			}
 		}
+	});
+}
+
+// individuals for the offspring and the next population (as many as in the population)
+void GeneticAlgorithm::allocateBuffers()
+{
+	for (population_type * buffer : { &offspring, &newPopulation }) {
+		for (Individual * indiv : *buffer)
+			delete indiv;
+		buffer->resize(population.size());
+		for (unsigned i = 0; i < population.size(); i++)
+			(*buffer)[i] = population[i]->clone();
 	}
 }
 
 // selection of offspring
 void GeneticAlgorithm::select(const population_type & population, population_type & offspring)
 {
-	offspring.resize(population.size());
-
-	for (unsigned i = 0; i < population.size(); i++)
-		offspring[i] = population[i]->clone();
+	forEachRange(population.size(), [&population, &offspring](unsigned begin, unsigned end, unsigned) {
+		for (unsigned i = begin; i < end; i++)
+			offspring[i]->copyFrom(population[i]);
+	});
 }
 
 void GeneticAlgorithm::unite(population_type & population, population_type & offspring, population_type & newPopulation)
@@ -121,9 +146,58 @@ void GeneticAlgorithm::unite(population_type & population, population_type & off
 	unionStrategy->unite(population, offspring, newPopulation);
 }
 
-double GeneticAlgorithm::random()
+// (re)creates the threads, if "nThreads" changed
+void GeneticAlgorithm::startThreads()
 {
-	return ureal_dist(rng);
+	nThreads = std::max(nThreads, 1u);
+	if (threadPool != NULL and threadPool->size() == nThreads)
+		return;
+
+	delete threadPool;
+	threadPool = new ThreadPool(nThreads);
+	threadStates.resize(nThreads);
+
+	for (ThreadState & state : threadStates)
+		state.doneMutations = state.doneRecombinations = state.doneEvaluations = state.doneDeltaEvaluations = 0;
+}
+
+// every thread of every island gets its own stream of the same seed (streams that never overlap)
+void GeneticAlgorithm::seedThreads()
+{
+	rng_type rng = islandStream();
+	for (ThreadState & state : threadStates) {
+		state.rng = rng;
+		rng.jump();
+	}
+}
+
+// the stream that follows those of the threads
+rng_type GeneticAlgorithm::spareStream()
+{
+	rng_type rng = islandStream();
+	for (unsigned i = 0; i < threadStates.size(); i++)
+		rng.jump();
+	return rng;
+}
+
+rng_type GeneticAlgorithm::islandStream()
+{
+	rng_type rng(seed);
+	for (unsigned i = 0; i < island; i++)
+		rng.longJump();
+	return rng;
+}
+
+// adds what the threads counted to the totals
+void GeneticAlgorithm::sumThreadCounters()
+{
+	for (ThreadState & state : threadStates) {
+		doneMutations += state.doneMutations;
+		doneRecombinations += state.doneRecombinations;
+		doneEvaluations += state.doneEvaluations;
+		doneDeltaEvaluations += state.doneDeltaEvaluations;
+		state.doneMutations = state.doneRecombinations = state.doneEvaluations = state.doneDeltaEvaluations = 0;
+	}
 }
 
 // ----------------------------------------------------------------------------
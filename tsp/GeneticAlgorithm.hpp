@@ -10,8 +10,9 @@
 
 #include "Operators.hpp"
 #include "Individual.hpp"
+#include "ThreadPool.hpp"
+#include "Random.hpp"
 
-#include <random>
 #include <vector>
 
 typedef std::vector<Individual *> population_type;
@@ -20,10 +21,14 @@ typedef std::vector<Individual *> population_type;
 
 class GeneticAlgorithm
 {
+	friend class Migration;
+
 public:
 	int populationSize;
 	float mutationChance;
 	float crossoverChance;
+	unsigned nThreads;		// that evaluate, mutate and recombine individuals (set before start())
+	unsigned island;		// (islands with the same seed get different random streams; set before start())
 
 	UnionStrategy * unionStrategy;
 	IndividualSortingFunctor * sortingFunctor;
@@ -33,18 +38,34 @@ public:
 	uint doneMutations;
 	uint doneRecombinations;
 	uint doneEvaluations;
-
-protected:
-	std::mt19937 rng;
+	uint doneDeltaEvaluations;		// fitnesses updated by the operators themselves
 
 private:
-	std::uniform_real_distribution<double> ureal_dist;
+	struct ThreadState
+	{
+		rng_type rng;		// (one stream per thread of this island)
+		uint doneMutations, doneRecombinations, doneEvaluations, doneDeltaEvaluations;
+		char padding[64];		// (so that threads do not share cache lines)
+	};
+
+	unsigned seed;
+	std::vector<ThreadState> threadStates;
+	ThreadPool * threadPool;
+	population_type offspring;			// (allocated once, with the population, and reused in every generation)
+	population_type newPopulation;
 
 public:
 	GeneticAlgorithm(int seed = 0);
 	virtual ~GeneticAlgorithm();
 	void start();
 	void loop();
+	rng_type spareStream();		// a stream of this island that none of its threads uses (after start())
+
+	// (migration) the genome of every individual as the same number of bytes (0 if not supported). readGenome
+	// returns false, leaving the individual as it was, if the bytes are not a valid genome
+	virtual unsigned genomeSize() { return 0; }
+	virtual void writeGenome(const Individual *, char *) {}
+	virtual bool readGenome(Individual *, const char *) { return false; }
 
 protected:
 	void generate(population_type & population);
@@ -52,16 +73,43 @@ protected:
 	void mutate(population_type & population);
 	void recombine(population_type & population);
 
+	void allocateBuffers();
+	void startThreads();
+	void sumThreadCounters();
 	void select(const population_type & population, population_type & offspring);
 	void unite(population_type & population, population_type & offspring, population_type & newPopulation);
 
-	virtual Individual * generateIndividual() = 0;
+	// (the operators below may run in several threads at once, each with its "thread" index)
+	virtual Individual * generateIndividual(unsigned thread) = 0;
 	virtual float evaluateIndividual(const Individual * indiv) = 0;
-	virtual void mutateIndividual(Individual * indiv) = 0;
-	virtual void recombinePair(Individual * indiv1, Individual * indiv2) = 0;
+	virtual bool mutateIndividual(Individual * indiv, unsigned thread) = 0;		// (returns true if it updated the fitness)
+	virtual void recombinePair(Individual * indiv1, Individual * indiv2, unsigned thread) = 0;
+	virtual void prepareThreads(unsigned) {}		// called by start()
+
+	inline rng_type & rngOf(unsigned thread) {
+		return threadStates[thread].rng;
+	}
 
 private:
-	double random();
+	void seedThreads();
+	rng_type islandStream();
+
+	inline double random(unsigned thread) {
+		return threadStates[thread].rng.uniform();
+	}
+
+	// calls f(begin, end, thread) in every thread, with [0, count) split evenly among them (always in the
+	// same way, so that a run depends only on the seed and on the number of threads)
+	template <typename F>
+	void forEachRange(unsigned count, F f)
+	{
+		unsigned nThreads = threadStates.size();
+		auto task = [count, nThreads, &f](unsigned thread) {
+			f((unsigned long) count * thread / nThreads, (unsigned long) count * (thread+1) / nThreads, thread);
+		};
+		threadPool->run(task);
+		sumThreadCounters();
+	}
 };
 
 // ----------------------------------------------------------------------------
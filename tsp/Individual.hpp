@@ -12,6 +12,7 @@ public:
 	Individual();
 	virtual ~Individual();
 	virtual Individual * clone() = 0;
+	virtual void copyFrom(const Individual * other) = 0;		// (reusing this individual's memory)
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,188 @@
+#include "Migration.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+
+Migration::Migration(igcl::Node * node, GeneticAlgorithm * ga, Topology topology, unsigned interval, unsigned nMigrants,
+		Policy emigrantPolicy, Policy replacementPolicy)
+	: node(node), ga(ga), topology(topology), interval(std::max(interval, 1u)), nMigrants(nMigrants),
+	  emigrantPolicy(emigrantPolicy), replacementPolicy(replacementPolicy), coordinatorIsIsland(false),
+	  rng(ga->spareStream()), hasPending(false), stopping(false),
+	  nPacketsSent(0), nPacketsReplaced(0), nMigrantsSent(0), nPacketsReceived(0), nMigrantsReceived(0), nMigrantsRejected(0),
+	  exchangeTime(0), sendTime(0)
+{
+	senderThread = new std::thread(&Migration::sendLoop, this);
+}
+
+Migration::~Migration()
+{
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		stopping = true;
+		condVar.notify_all();
+	}
+	senderThread->join();
+	delete senderThread;
+}
+
+// with topologies ALL and RANDOM, the coordinator (node 0) only gets migrants if it runs a GA too
+void Migration::setCoordinatorIsIsland(bool isIsland)
+{
+	coordinatorIsIsland = isIsland;
+}
+
+// to be called between generations
+void Migration::exchange()
+{
+	clock::time_point start = clock::now();
+
+	immigrate();
+	if (ga->doneGenerations % interval == 0)
+		emigrate();
+
+	std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+	exchangeTime += clock::now() - start;
+}
+
+std::string Migration::statsToString()
+{
+	std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "migrants sent: " << nMigrantsSent << " in " << nPacketsSent << " packets (" << nPacketsReplaced << " replaced before being sent)"
+	   << ", received: " << nMigrantsReceived << " in " << nPacketsReceived << " packets (" << nMigrantsRejected << " rejected)"
+	   << ", time in exchange(): " << std::chrono::duration<double, std::milli>(exchangeTime).count() << " ms"
+	   << ", sending: " << std::chrono::duration<double, std::milli>(sendTime).count() << " ms";
+	return ss.str();
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<igcl::peer_id> Migration::chooseDestinations()
+{
+	if (topology == DOWNSTREAM)
+		return node->downstreamPeers();
+
+	std::vector<igcl::peer_id> ids;
+	for (igcl::peer_id id : node->getPeerIds()) {
+		if (id != 0 or coordinatorIsIsland)
+			ids.push_back(id);
+	}
+	if (topology == RANDOM and !ids.empty()) {
+		igcl::peer_id chosen = ids[rng.below(ids.size())];
+		ids.assign(1, chosen);
+	}
+	return ids;
+}
+
+void Migration::emigrate()
+{
+	const population_type & population = ga->population;
+	unsigned genomeSize = ga->genomeSize();
+	uint32_t count = std::min(nMigrants, (unsigned) population.size());
+	if (genomeSize == 0 or count == 0)
+		return;
+
+	Packet packet;
+	packet.destinations = chooseDestinations();
+	if (packet.destinations.empty())
+		return;
+
+	packet.bytes.resize(sizeof(count) + (size_t) count * genomeSize);
+	memcpy(packet.bytes.data(), &count, sizeof(count));
+	char * genome = packet.bytes.data() + sizeof(count);
+
+	for (unsigned k = 0;  k < count;  k++, genome += genomeSize) {
+		const Individual * indiv = (emigrantPolicy == BEST ? population[k] : population[rng.below(population.size())]);
+		ga->writeGenome(indiv, genome);
+	}
+
+	std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+	if (hasPending)
+		nPacketsReplaced++;
+	pending = std::move(packet);
+	hasPending = true;
+	condVar.notify_one();
+}
+
+// (at most half of the population is replaced in each call)
+void Migration::immigrate()
+{
+	population_type & population = ga->population;
+	unsigned genomeSize = ga->genomeSize();
+	unsigned maxReplaced = population.size() / 2;
+	unsigned nReplaced = 0, nReceived = 0, nRejected = 0, nPackets = 0;
+
+	igcl::peer_id id = 0;
+	char * data = NULL;
+	uint size = 0;
+	while (node->tryRecvMigrants(id, data, size) == igcl::SUCCESS)
+	{
+		nPackets++;
+		uint32_t count = 0;
+		if (size >= sizeof(count))
+			memcpy(&count, data, sizeof(count));
+
+		if (genomeSize == 0 or size != sizeof(count) + (size_t) count * genomeSize) {
+			nRejected += count;
+			free(data);
+			continue;
+		}
+
+		const char * genome = data + sizeof(count);
+		for (unsigned k = 0;  k < count;  k++, genome += genomeSize)
+		{
+			Individual * target = (replacementPolicy == BEST ? population[population.size()-1-nReplaced]
+			                                                 : population[rng.below(population.size())]);
+			if (nReplaced >= maxReplaced or !ga->readGenome(target, genome)) {
+				nRejected++;
+				continue;
+			}
+			target->fitness = ga->evaluateIndividual(target);
+			target->hasChanged = false;
+			++ga->doneEvaluations;
+			nReplaced++;
+			nReceived++;
+		}
+		free(data);
+	}
+
+	std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+	nPacketsReceived += nPackets;
+	nMigrantsReceived += nReceived;
+	nMigrantsRejected += nRejected;
+}
+
+void Migration::sendLoop()
+{
+	std::unique_lock<std::mutex> uniqueLock(mutex);
+
+	while (1)
+	{
+		condVar.wait(uniqueLock, [this] { return hasPending or stopping; });
+		if (stopping)
+			return;
+
+		Packet packet = std::move(pending);
+		hasPending = false;
+		uniqueLock.unlock();
+
+		clock::time_point start = clock::now();
+		for (igcl::peer_id id : packet.destinations)
+			node->sendMigrantsTo(id, packet.bytes.data(), (uint) packet.bytes.size());
+		clock::duration elapsed = clock::now() - start;
+
+		uint32_t count;
+		memcpy(&count, packet.bytes.data(), sizeof(count));
+		uniqueLock.lock();
+		sendTime += elapsed;
+		nPacketsSent++;
+		nMigrantsSent += count;
+	}
+}
+
+// ----------------------------------------------------------------------------
@@ -0,0 +1,87 @@
+#ifndef MIGRATION_HPP_
+#define MIGRATION_HPP_
+
+#include "GeneticAlgorithm.hpp"
+#include "../igcl/Node.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Migration of individuals between the islands (one GA per node) of a group. Every "interval" generations,
+ * exchange() packs "nMigrants" emigrants in one packet and leaves it to a sender thread, and puts the
+ * immigrants received since its last call into the population, so evolution never waits for the network.
+ * A packet not sent yet when the next one is ready is replaced by it (it holds older individuals).
+ * Immigrants are evaluated again when they arrive. Packets travel as igcl migrants, apart from the messages of
+ * the application.
+ */
+class Migration
+{
+public:
+	enum Topology
+	{
+		DOWNSTREAM,		// the downstream peers of the group layout (e.g. the next node of a ring layout)
+		ALL,			// every known peer
+		RANDOM			// one known peer, chosen at random for each packet
+	};
+
+	enum Policy
+	{
+		BEST,			// (emigrants) the best individuals; (replaced by immigrants) the worst ones
+		RANDOM_INDIVIDUALS
+	};
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	struct Packet
+	{
+		std::vector<igcl::peer_id> destinations;
+		std::vector<char> bytes;		// the number of migrants (uint32_t), then their genomes
+	};
+
+	igcl::Node * node;
+	GeneticAlgorithm * ga;
+	Topology topology;
+	unsigned interval, nMigrants;
+	Policy emigrantPolicy, replacementPolicy;
+	bool coordinatorIsIsland;
+	rng_type rng;
+
+	Packet pending;
+	bool hasPending;
+	std::mutex mutex;
+	std::condition_variable condVar;
+	bool stopping;
+	std::thread * senderThread;
+
+	// stats
+	unsigned nPacketsSent, nPacketsReplaced, nMigrantsSent;
+	unsigned nPacketsReceived, nMigrantsReceived, nMigrantsRejected;
+	clock::duration exchangeTime, sendTime;
+
+public:
+	Migration(igcl::Node * node, GeneticAlgorithm * ga, Topology topology, unsigned interval, unsigned nMigrants,
+			Policy emigrantPolicy = BEST, Policy replacementPolicy = BEST);
+	~Migration();
+
+	void setCoordinatorIsIsland(bool isIsland);
+	void exchange();
+	std::string statsToString();
+
+private:
+	std::vector<igcl::peer_id> chooseDestinations();
+	void emigrate();
+	void immigrate();
+	void sendLoop();
+};
+
+// ----------------------------------------------------------------------------
+
+#endif /* MIGRATION_HPP_ */
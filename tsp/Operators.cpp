@@ -20,15 +20,14 @@ HalfAndHalfUnion::HalfAndHalfUnion(IndividualSortingFunctor * sortingFunctor) :
 
 void HalfAndHalfUnion::unite(std::vector<Individual *> & population, std::vector<Individual *> & offspring, std::vector<Individual *> & newPopulation)
 {
-	std::vector<Individual *> joinedPopulation(population.size() + offspring.size());
+	joinedPopulation.resize(population.size() + offspring.size());
 	std::copy(population.begin(), population.end(), joinedPopulation.begin());
 	std::copy(offspring.begin(), offspring.end(), joinedPopulation.begin()+population.size());
 	std::sort(joinedPopulation.begin(), joinedPopulation.end(), *sortingFunctor);
 
-	// clone all to new population
-	newPopulation.resize(population.size());
+	// copy all to new population
 	for (unsigned i = 0;  i < population.size();  i++)
-		newPopulation[i] = joinedPopulation[i]->clone();
+		newPopulation[i]->copyFrom(joinedPopulation[i]);
 }
 
 // ----------------------------------------------------------------------------
@@ -43,14 +42,13 @@ void SurvivorBasedUnion::unite(std::vector<Individual *> & population, std::vect
 	std::sort(population.begin(), population.end(), *sortingFunctor);
 	std::sort(offspring.begin(), offspring.end(), *sortingFunctor);
 
-	// clone all to new population
-	newPopulation.resize(population.size());
+	// copy all to new population
 	unsigned nSurvivors = (int) (survivorFraction * population.size());
 	
 	for (unsigned i = 0;  i < nSurvivors;  i++)
-		newPopulation[i] = population[i]->clone();
+		newPopulation[i]->copyFrom(population[i]);
 	for (unsigned i = 0;  i < population.size()-nSurvivors;  i++)
-		newPopulation[nSurvivors+i] = offspring[i]->clone();
+		newPopulation[nSurvivors+i]->copyFrom(offspring[i]);
 
 	std::sort(newPopulation.begin(), newPopulation.end(), *sortingFunctor);
 }
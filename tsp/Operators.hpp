@@ -7,6 +7,8 @@
 
 // ----------------------------------------------------------------------------
 
+// strategies copy the individuals of the new population into "newPopulation", which must already hold
+// population.size() individuals (so that no individual is allocated in each generation)
 class UnionStrategy
 {
 protected:
@@ -22,6 +24,9 @@ public:
 
 class HalfAndHalfUnion : public UnionStrategy
 {
+private:
+	std::vector<Individual *> joinedPopulation;		// (reused)
+
 public:
 	HalfAndHalfUnion(IndividualSortingFunctor * sortingFunctor);
 	virtual void unite(std::vector<Individual *> & population, std::vector<Individual *> & offspring, std::vector<Individual *> & newPopulation);
@@ -0,0 +1,120 @@
+#ifndef RANDOM_HPP_
+#define RANDOM_HPP_
+
+#include <cstdint>
+#include <limits>
+#include <iterator>
+#include <utility>
+
+// ----------------------------------------------------------------------------
+
+/*
+ * xoshiro256** (Blackman and Vigna): 4 words of state and a handful of instructions per number.
+ * Streams of the same seed are 2^128 (jump) or 2^192 (longJump) numbers apart, so they never overlap:
+ * the GA gives each island a long jump and each of its threads a jump, and a run then depends only on
+ * the seed, the island and the number of threads.
+ * It is a UniformRandomBitGenerator, so std:: distributions and algorithms accept it too.
+ */
+class Xoshiro256
+{
+public:
+	typedef uint64_t result_type;
+
+private:
+	uint64_t s[4];
+
+public:
+	Xoshiro256(uint64_t seed = 1) {
+		this->seed(seed);
+	}
+
+	// (the state comes from splitmix64, so that similar seeds give unrelated states)
+	void seed(uint64_t seed)
+	{
+		for (uint64_t & word : s) {
+			uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			word = z ^ (z >> 31);
+		}
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	inline result_type operator()()
+	{
+		const uint64_t result = rotl(s[1] * 5, 7) * 9;
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	// in [0, 1)
+	inline double uniform() {
+		return ((*this)() >> 11) * (1.0 / (UINT64_C(1) << 53));
+	}
+
+	// in [0, n), without modulo bias (Lemire's multiply and reject, which almost never rejects)
+	inline uint32_t below(uint32_t n)
+	{
+		uint64_t m = (uint64_t) (uint32_t) ((*this)() >> 32) * n;
+		if ((uint32_t) m < n) {
+			const uint32_t threshold = (uint32_t) -n % n;
+			while ((uint32_t) m < threshold)
+				m = (uint64_t) (uint32_t) ((*this)() >> 32) * n;
+		}
+		return m >> 32;
+	}
+
+	// Fisher-Yates
+	template <typename RandomIt>
+	void shuffle(RandomIt first, RandomIt last)
+	{
+		for (auto i = std::distance(first, last) - 1;  i > 0;  i--)
+			std::swap(first[i], first[below(i+1)]);
+	}
+
+	void jump() {
+		static const uint64_t polynomial[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+		advance(polynomial);
+	}
+
+	void longJump() {
+		static const uint64_t polynomial[] = { 0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL };
+		advance(polynomial);
+	}
+
+private:
+	static inline uint64_t rotl(const uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	void advance(const uint64_t polynomial[4])
+	{
+		uint64_t t[4] = { 0, 0, 0, 0 };
+		for (int i = 0;  i < 4;  i++) {
+			for (int b = 0;  b < 64;  b++) {
+				if (polynomial[i] & (UINT64_C(1) << b)) {
+					for (int w = 0;  w < 4;  w++)
+						t[w] ^= s[w];
+				}
+				(*this)();
+			}
+		}
+		for (int w = 0;  w < 4;  w++)
+			s[w] = t[w];
+	}
+};
+
+// the generator of the GA and its operators (any class with the interface above will do)
+typedef Xoshiro256 rng_type;
+
+// ----------------------------------------------------------------------------
+
+#endif /* RANDOM_HPP_ */
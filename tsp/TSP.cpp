@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <sstream>
+#include <cstring>
 
 // ----------------------------------------------------------------------------
 
@@ -17,6 +18,14 @@ TSPIndividual * TSPIndividual::clone()
 	return newIndiv;
 }
 
+void TSPIndividual::copyFrom(const Individual * other)
+{
+	const TSPIndividual & indiv = *(const TSPIndividual *) other;
+	pointOrder.assign(indiv.pointOrder.begin(), indiv.pointOrder.end());	// (same size, so no allocation)
+	fitness = indiv.fitness;
+	hasChanged = indiv.hasChanged;
+}
+
 // ----------------------------------------------------------------------------
 
 bool TSPIndividualSortingFunctor::operator() (const Individual * indiv1, const Individual * indiv2) const
@@ -26,10 +35,19 @@ bool TSPIndividualSortingFunctor::operator() (const Individual * indiv1, const I
 
 // ----------------------------------------------------------------------------
 
-TSP::TSP(TSPInstance & instance, int seed) : GeneticAlgorithm(seed)
+TSP::TSP(const TSPInstance & instance, int seed) : GeneticAlgorithm(seed), instance(instance)
+{
+}
+
+
+void TSP::prepareThreads(unsigned nThreads)
 {
-	this->instance = instance;
-	this->uint_dist = std::uniform_int_distribution<uint32_t>(0, instance.points.size()-1);
+	oxMarkers.resize(nThreads);
+	for (OxMarkers & markers : oxMarkers) {
+		markers.used1.assign(instance.points.size(), 0);
+		markers.used2.assign(instance.points.size(), 0);
+		markers.stamp = 0;
+	}
 }
 
 
@@ -39,14 +57,46 @@ float TSP::evaluateExternalIndividual(const TSPIndividual * indiv)
 }
 
 
-Individual * TSP::generateIndividual()
+unsigned TSP::genomeSize()
+{
+	return instance.points.size() * sizeof(order_type);
+}
+
+
+void TSP::writeGenome(const Individual * indiv, char * bytes)
+{
+	memcpy(bytes, ((const TSPIndividual *) indiv)->pointOrder.data(), genomeSize());
+}
+
+
+// (only permutations of the points are accepted)
+bool TSP::readGenome(Individual * indiv, const char * bytes)
+{
+	unsigned size = instance.points.size();
+	const order_type * order = (const order_type *) bytes;
+	seenPoints.assign(size, false);
+
+	for (unsigned i = 0;  i < size;  i++) {
+		order_type point;
+		memcpy(&point, &order[i], sizeof(point));
+		if (point < 0 or (unsigned) point >= size or seenPoints[point])
+			return false;
+		seenPoints[point] = true;
+	}
+
+	memcpy(((TSPIndividual *) indiv)->pointOrder.data(), bytes, genomeSize());
+	return true;
+}
+
+
+Individual * TSP::generateIndividual(unsigned thread)
 {
 	std::vector<order_type> order(instance.points.size());
 
 	for (unsigned i = 0;  i < instance.points.size();  i++)
 		order[i] = i;
 
-	std::random_shuffle(order.begin(), order.end());
+	rngOf(thread).shuffle(order.begin(), order.end());
 
 	return new TSPIndividual(order);
 }
@@ -59,44 +109,66 @@ float TSP::evaluateIndividual(const Individual * indivPointer)
 	float fitness = 0;
 
 	for (unsigned i = 0;  i < indiv.pointOrder.size()-1;  i++) {
-		fitness += instance.dists[ indiv.pointOrder[i] ][ indiv.pointOrder[i+1] ];
+		fitness += instance.dist( indiv.pointOrder[i], indiv.pointOrder[i+1] );
 	}
-	fitness += instance.dists[ indiv.pointOrder[indiv.pointOrder.size()-1] ][ indiv.pointOrder[0] ];
+	fitness += instance.dist( indiv.pointOrder[indiv.pointOrder.size()-1], indiv.pointOrder[0] );
 
 	return fitness;
 }
 
 
-void TSP::mutateIndividual(Individual * indivPointer)
+// 2-opt move: reverses the items between ini and end, and updates the fitness with the edges that changed
+bool TSP::mutateIndividual(Individual * indivPointer, unsigned thread)
 {
 	TSPIndividual & indiv = *(TSPIndividual *) indivPointer;
 
 	int ini, end;
-	getRandomOrderedPairOfIndexes(ini, end);
+	getRandomOrderedPairOfIndexes(ini, end, thread);
 
-	for (int i = ini;  i < end-i;  i++)	// reverse items between ini and end
-	{
-		int t = indiv.pointOrder[i];
-		indiv.pointOrder[i] = indiv.pointOrder[end-i];
-		indiv.pointOrder[end-i] = t;
-	}
+	indiv.fitness += reversalDelta(indiv, ini, end);
+	std::reverse(indiv.pointOrder.begin() + ini, indiv.pointOrder.begin() + end + 1);
+	return true;
 }
 
 
-void TSP::recombinePair(Individual * indiv1, Individual * indiv2)
+// change of the tour's length if the items between ini and end are reversed: edges a-b and c-d become a-c and b-d
+float TSP::reversalDelta(const TSPIndividual & indiv, int ini, int end)
 {
-	ox(*(TSPIndividual *) indiv1, *(TSPIndividual *) indiv2);
+	const std::vector<order_type> & order = indiv.pointOrder;
+	int size = order.size();
+	if (end - ini + 2 >= size)		// (all the items, or all but one: the same tour, backwards)
+		return 0;
+
+	order_type a = order[(ini + size - 1) % size];
+	order_type b = order[ini];
+	order_type c = order[end];
+	order_type d = order[(end + 1) % size];
+	return instance.dist(a, c) + instance.dist(b, d) - instance.dist(a, b) - instance.dist(c, d);
 }
 
 
-void TSP::ox(TSPIndividual & indiv1, TSPIndividual & indiv2)
+void TSP::recombinePair(Individual * indiv1, Individual * indiv2, unsigned thread)
+{
+	ox(*(TSPIndividual *) indiv1, *(TSPIndividual *) indiv2, thread);
+}
+
+
+void TSP::ox(TSPIndividual & indiv1, TSPIndividual & indiv2, unsigned thread)
 {
 	unsigned size = instance.points.size();
 	int ini, end;
-	getRandomOrderedPairOfIndexes(ini, end);
+	getRandomOrderedPairOfIndexes(ini, end, thread);
 
-	std::set<order_type> used1(indiv2.pointOrder.begin()+ini, indiv2.pointOrder.begin()+end+1);
-	std::set<order_type> used2(indiv1.pointOrder.begin()+ini, indiv1.pointOrder.begin()+end+1);
+	OxMarkers & markers = oxMarkers[thread];
+	if (++markers.stamp == 0) {		// (wrapped around: old markers could match again)
+		std::fill(markers.used1.begin(), markers.used1.end(), 0);
+		std::fill(markers.used2.begin(), markers.used2.end(), 0);
+		markers.stamp = 1;
+	}
+	for (int i = ini;  i < end+1;  i++) {
+		markers.used1[ indiv2.pointOrder[i] ] = markers.stamp;
+		markers.used2[ indiv1.pointOrder[i] ] = markers.stamp;
+	}
 
 	unsigned curr1, curr2;
 	curr1 = curr2 = (end+1) % size;
@@ -107,8 +179,8 @@ void TSP::ox(TSPIndividual & indiv1, TSPIndividual & indiv2)
 		if (i < 0)
 			i = size + i;
 
-		oxAuxiliar(used1, indiv1, curr1, indiv1.pointOrder[i], size);
-		oxAuxiliar(used2, indiv2, curr2, indiv2.pointOrder[i], size);
+		oxAuxiliar(markers.used1, markers.stamp, indiv1, curr1, indiv1.pointOrder[i], size);
+		oxAuxiliar(markers.used2, markers.stamp, indiv2, curr2, indiv2.pointOrder[i], size);
 	}
 
 	for (int i = ini;  i < end+1;  i++)
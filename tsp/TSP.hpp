@@ -5,8 +5,6 @@
 #include "TSPInstance.hpp"
 
 #include <vector>
-#include <set>
-#include <random>
 
 typedef short order_type;
 
@@ -19,6 +17,7 @@ public:
 
 	TSPIndividual(std::vector<order_type> & pointOrder);
 	TSPIndividual * clone();
+	void copyFrom(const Individual * other);
 
 	friend std::ostream & operator << (std::ostream & os, TSPIndividual & p);
 };
@@ -36,26 +35,43 @@ public:
 class TSP : public GeneticAlgorithm
 {
 private:
-	TSPInstance instance;
-	std::uniform_int_distribution<uint32_t> uint_dist;
+	const TSPInstance & instance;		// (shared, not copied)
+
+	// (ox, one per thread) a point is used in a child if its marker holds the current stamp, so markers are
+	// never cleared
+	struct OxMarkers
+	{
+		std::vector<uint32_t> used1, used2;
+		uint32_t stamp;
+	};
+	std::vector<OxMarkers> oxMarkers;
+	std::vector<bool> seenPoints;		// (readGenome)
 
 public:
-	TSP(TSPInstance & instance, int seed=0);
+	TSP(const TSPInstance & instance, int seed=0);
 	float evaluateExternalIndividual(const TSPIndividual * indiv);
 
+	unsigned genomeSize();
+	void writeGenome(const Individual * indiv, char * bytes);
+	bool readGenome(Individual * indiv, const char * bytes);
+
 protected:
-	virtual Individual * generateIndividual();
+	virtual Individual * generateIndividual(unsigned thread);
 	virtual float evaluateIndividual(const Individual * indiv);
-	virtual void mutateIndividual(Individual * indiv);
-	virtual void recombinePair(Individual * indiv1, Individual * indiv2);
+	virtual bool mutateIndividual(Individual * indiv, unsigned thread);
+	virtual void recombinePair(Individual * indiv1, Individual * indiv2, unsigned thread);
+	virtual void prepareThreads(unsigned nThreads);
 
 private:
-	void ox(TSPIndividual & indiv1, TSPIndividual & indiv2);
+	void ox(TSPIndividual & indiv1, TSPIndividual & indiv2, unsigned thread);
+	float reversalDelta(const TSPIndividual & indiv, int ini, int end);
 
-	inline void getRandomOrderedPairOfIndexes(int & ini, int & end)
+	inline void getRandomOrderedPairOfIndexes(int & ini, int & end, unsigned thread)
 	{
-		ini = uint_dist(rng);
-		while (ini == (end = uint_dist(rng)));
+		rng_type & rng = rngOf(thread);
+		const uint32_t n = instance.points.size();
+		ini = rng.below(n);
+		while (ini == (end = rng.below(n)));
 
 		if (ini > end)	// ini must come before end
 		{
@@ -65,12 +81,12 @@ private:
 		}
 	}
 
-	inline void oxAuxiliar(std::set<order_type> & used, TSPIndividual & indiv, unsigned & curr, const order_type value, const unsigned size)
+	inline void oxAuxiliar(std::vector<uint32_t> & usedMarkers, uint32_t usedStamp, TSPIndividual & indiv, unsigned & curr, const order_type value, const unsigned size)
 	{
-		if (used.count(value) == 0)
+		if (usedMarkers[value] != usedStamp)
 		{
 			indiv.pointOrder[curr] = value;
-			used.insert(value);
+			usedMarkers[value] = usedStamp;
 			if (++curr == size)
 				curr = 0;
 		}
@@ -1,71 +1,222 @@
 #include "TSPInstance.hpp"
 
-#include <fstream>
-#include <sstream>
 #include <cmath>
+#include <cstring>
+#include <cstdlib>
 #include <algorithm>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // ----------------------------------------------------------------------------
 
-bool TSPInstance::initializeFromFile(const std::string & filepath)
+namespace
 {
-	std::ifstream file;
-	file.open(filepath);
-	if (file.fail())
+	// (the mapped file is not NUL-terminated, so parsing never reads past "end")
+
+	inline bool isSpace(char c) {
+		return c == ' ' or c == '\t' or c == '\r' or c == '\n';
+	}
+
+	// moves "p" past the first line that starts with "word" (and past "word", if found)
+	bool findLineStartingWith(const char * & p, const char * end, const char * word)
+	{
+		size_t length = strlen(word);
+		while (p < end)
+		{
+			if ((size_t) (end - p) >= length and memcmp(p, word, length) == 0) {
+				p += length;
+				return true;
+			}
+			p = (const char *) memchr(p, '\n', end - p);
+			if (p == NULL)
+				break;
+			p++;
+		}
+		p = end;
 		return false;
-	std::string line, elem, search;
-	std::istringstream iss;
-
-	//std::cout << "START" << '\n';
-	search = "DIMENSION";
-	do {
-		std::getline(file, line);
-		//std::cout << line << '\n';
-	} while (line.compare(0, search.length(), search) != 0);
-
-	int ind = line.find_last_of(" ");
-	//std::cout << "ind: " << ind << '\n';
-	int size;
-	sscanf(line.substr(ind+1).c_str(), "%d", &size);
-	//std::cout << "substr: " << line.substr(ind+1) << '\n';
-	points.resize(size);
-
-	//std::cout << size << '\n';
-
-	search = "NODE_COORD_SECTION";
-	do {
-		std::getline(file, line);
-	} while (line.compare(0, search.length(), search) != 0);
-
-	int dummy;
-	for (int i = 0;  i < size;  ++i)
+	}
+
+	bool parseNumber(const char * & p, const char * end, double & value)
 	{
-		std::getline(file, line);
-		//std::cout << line << '\n';
-		sscanf(line.c_str(), "%d %f %f", &dummy, &points[i].x, &points[i].y);
-		//std::cout << dummy << ' '<< points[i].x << ' ' << points[i].y << '\n';
+		while (p < end and (isSpace(*p) or *p == ':'))
+			p++;
+
+		char token[64];
+		size_t length = 0;
+		while (p < end and !isSpace(*p) and length < sizeof(token)-1)
+			token[length++] = *p++;
+		token[length] = '\0';
+
+		char * tokenEnd;
+		value = strtod(token, &tokenEnd);
+		return length > 0 and tokenEnd == token + length;
 	}
 
-	file.close();
-	return true;
+	// header of a cache file, whose distances start at offset TSPInstance::ALIGNMENT
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t n, stride;
+		uint32_t triangular, quantized;
+		float quantum;
+		uint64_t pointsHash;
+	};
+
+	const char CACHE_MAGIC[8] = "TSPDIST";
+	const uint32_t CACHE_VERSION = 1;
+}
+
+// ----------------------------------------------------------------------------
+
+const unsigned TSPInstance::ALIGNMENT;
+
+
+TSPInstance::TSPInstance()
+	: n(0), stride(0), triangular(false), quantized(false), dists(NULL), quantizedDists(NULL), quantum(1),
+	  ownedMemory(NULL), mapping(NULL), mappingSize(0), nNeighbours(0)
+{
 }
 
 
-void TSPInstance::precalculateDistances()
+TSPInstance::~TSPInstance()
 {
-	dists.resize(points.size());
+	freeDistances();
+}
 
-	for (unsigned i = 0;  i < points.size();  ++i)
-		dists[i].resize(points.size());
 
-	for (unsigned i = 0;  i < points.size()-1;  ++i)
+// reads the DIMENSION and the NODE_COORD_SECTION of a TSPLIB file (mapped into memory)
+bool TSPInstance::initializeFromFile(const std::string & filepath)
+{
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 or st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	size_t fileSize = st.st_size;
+	void * file = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED)
+		return false;
+	madvise(file, fileSize, MADV_SEQUENTIAL);
+
+	const char * p = (const char *) file;
+	const char * end = p + fileSize;
+	double size = 0;
+	bool valid = findLineStartingWith(p, end, "DIMENSION") and parseNumber(p, end, size) and size >= 0
+			and findLineStartingWith(p, end, "NODE_COORD_SECTION");
+
+	if (valid) {
+		points.resize((size_t) size);
+		for (point & city : points) {
+			double id, x, y;
+			if (!parseNumber(p, end, id) or !parseNumber(p, end, x) or !parseNumber(p, end, y)) {
+				valid = false;
+				break;
+			}
+			city.x = x;
+			city.y = y;
+		}
+	}
+
+	munmap(file, fileSize);
+	return valid;
+}
+
+
+// (triangular) only i <= j is kept; (quantized) 16-bit multiples of the longest distance / 65535
+void TSPInstance::precalculateDistances(bool triangular, bool quantized)
+{
+	freeDistances();
+	n = points.size();
+	this->triangular = triangular;
+
+	size_t elemSize = (quantized ? sizeof(uint16_t) : sizeof(float));
+	unsigned elemsPerLine = ALIGNMENT / elemSize;
+	stride = (n + elemsPerLine - 1) / elemsPerLine * elemsPerLine;
+	size_t nElems = nStoredDistances();
+
+	float * values = NULL;
+	if (posix_memalign((void **) &values, ALIGNMENT, nElems * sizeof(float)) != 0)
+		throw std::bad_alloc();
+	std::fill(values, values + nElems, 0.0f);
+	dists = values;
+	ownedMemory = values;
+
+	float longest = 0;
+	for (unsigned i = 0;  i < n;  ++i)
 	{
-		for (unsigned j = i+1;  j < points.size();  ++j)
+		for (unsigned j = i+1;  j < n;  ++j)
 		{
 			float xx = points[i].x - points[j].x;
 			float yy = points[i].y - points[j].y;
-			dists[i][j] = dists[j][i] = (float) sqrt(xx * xx + yy * yy);
+			float d = (float) sqrt(xx * xx + yy * yy);
+			values[triangular ? (size_t) i * n - (size_t) i * (i+1) / 2 + j : (size_t) i * stride + j] = d;
+			if (!triangular)
+				values[(size_t) j * stride + i] = d;
+			longest = std::max(longest, d);
+		}
+	}
+
+	if (quantized)
+	{
+		uint16_t * quantizedValues = NULL;
+		if (posix_memalign((void **) &quantizedValues, ALIGNMENT, nElems * sizeof(uint16_t)) != 0)
+			throw std::bad_alloc();
+		quantum = (longest > 0 ? longest / 65535 : 1);
+		for (size_t k = 0;  k < nElems;  ++k)
+			quantizedValues[k] = (uint16_t) lround(values[k] / quantum);
+
+		free(values);
+		dists = NULL;
+		quantizedDists = quantizedValues;
+		ownedMemory = quantizedValues;
+	}
+	this->quantized = quantized;
+}
+
+
+// maps the matrix from "cacheFile" if it holds the distances of these points (with the same options), or
+// calculates it and writes it there (the file is replaced atomically, so concurrent runs may share it).
+// returns true if the cache was used
+bool TSPInstance::precalculateDistancesCached(const std::string & cacheFile, bool triangular, bool quantized)
+{
+	this->triangular = triangular;
+	this->quantized = quantized;
+	uint64_t pointsHash = hashPoints();
+	if (mapCache(cacheFile, pointsHash))
+		return true;
+
+	precalculateDistances(triangular, quantized);
+	writeCache(cacheFile, pointsHash);
+	return false;
+}
+
+
+// keeps the k nearest cities of each city (for local search operators)
+void TSPInstance::precalculateNeighbours(unsigned k)
+{
+	nNeighbours = std::min(k, (unsigned) points.size()-1);
+	neighbours.resize((size_t) points.size() * nNeighbours);
+	std::vector<uint32_t> others;
+
+	for (unsigned i = 0;  i < points.size();  ++i)
+	{
+		others.clear();
+		for (unsigned j = 0;  j < points.size();  ++j) {
+			if (j != i)
+				others.push_back(j);
 		}
+
+		const auto & nearer = [this, i](uint32_t a, uint32_t b) { return dist(i, a) < dist(i, b); };
+		std::partial_sort(others.begin(), others.begin() + nNeighbours, others.end(), nearer);
+		std::copy(others.begin(), others.begin() + nNeighbours, neighbours.begin() + (size_t) i * nNeighbours);
 	}
 }
 
@@ -81,4 +232,115 @@ void TSPInstance::calculatePointLimits(float & minX, float & maxX, float & minY,
 	maxY = max_element(points.begin(), points.end(), fy)->y;
 }
 
+
+void TSPInstance::freeDistances()
+{
+	free(ownedMemory);
+	if (mapping != NULL)
+		munmap(mapping, mappingSize);
+	ownedMemory = mapping = NULL;
+	dists = NULL;
+	quantizedDists = NULL;
+}
+
+
+size_t TSPInstance::nStoredDistances() const
+{
+	return (triangular ? (size_t) n * (n+1) / 2 : (size_t) n * stride);
+}
+
+
+// (FNV-1a)
+uint64_t TSPInstance::hashPoints() const
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char * bytes = (const unsigned char *) points.data();
+	for (size_t i = 0;  i < points.size() * sizeof(point);  ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+bool TSPInstance::mapCache(const std::string & cacheFile, uint64_t pointsHash)
+{
+	int fd = open(cacheFile.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 or (size_t) st.st_size < ALIGNMENT) {
+		close(fd);
+		return false;
+	}
+	size_t fileSize = st.st_size;
+	void * file = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED)
+		return false;
+
+	const CacheHeader & header = *(const CacheHeader *) file;
+	unsigned nPoints = points.size();
+	bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 and header.version == CACHE_VERSION
+			and header.n == nPoints and header.triangular == triangular and header.quantized == quantized
+			and header.pointsHash == pointsHash;
+	if (valid) {
+		size_t elemSize = (quantized ? sizeof(uint16_t) : sizeof(float));
+		size_t nElems = (triangular ? (size_t) nPoints * (nPoints+1) / 2 : (size_t) nPoints * header.stride);
+		valid = (fileSize == ALIGNMENT + nElems * elemSize);
+	}
+	if (!valid) {
+		munmap(file, fileSize);
+		return false;
+	}
+
+	freeDistances();
+	n = nPoints;
+	stride = header.stride;
+	quantum = header.quantum;
+	mapping = file;
+	mappingSize = fileSize;
+	const char * data = (const char *) file + ALIGNMENT;
+	if (quantized)
+		quantizedDists = (const uint16_t *) data;
+	else
+		dists = (const float *) data;
+	return true;
+}
+
+
+void TSPInstance::writeCache(const std::string & cacheFile, uint64_t pointsHash) const
+{
+	static_assert(sizeof(CacheHeader) <= ALIGNMENT, "the cache header must fit before the distances");
+
+	char header[ALIGNMENT] = {};
+	CacheHeader & fields = *(CacheHeader *) header;
+	memcpy(fields.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	fields.version = CACHE_VERSION;
+	fields.n = n;
+	fields.stride = stride;
+	fields.triangular = triangular;
+	fields.quantized = quantized;
+	fields.quantum = quantum;
+	fields.pointsHash = pointsHash;
+
+	const char * data = (quantized ? (const char *) quantizedDists : (const char *) dists);
+	size_t dataSize = nStoredDistances() * (quantized ? sizeof(uint16_t) : sizeof(float));
+
+	std::string tmpFile = cacheFile + ".tmp" + std::to_string(getpid());
+	int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+	bool ok = (write(fd, header, ALIGNMENT) == (ssize_t) ALIGNMENT);
+	for (size_t done = 0;  ok and done < dataSize; ) {
+		ssize_t written = write(fd, data + done, dataSize - done);
+		ok = (written > 0);
+		done += (ok ? written : 0);
+	}
+	ok = (close(fd) == 0) and ok;
+
+	if (!ok or rename(tmpFile.c_str(), cacheFile.c_str()) != 0)
+		unlink(tmpFile.c_str());
+}
+
 // ----------------------------------------------------------------------------
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 // ----------------------------------------------------------------------------
 
@@ -15,15 +17,86 @@ struct point
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Distances are kept in one flat array (rows aligned to cache lines), which users share by reference.
+ * Large instances may keep only the upper triangle of the (symmetric) matrix, and/or 16-bit distances, in
+ * multiples of "quantum" (a rounding error of at most quantum/2 per edge).
+ * The matrix may also be kept in a cache file, which later runs (and the other nodes of the same machine)
+ * map into memory instead of calculating it again.
+ */
 class TSPInstance
 {
 public:
+	static const unsigned ALIGNMENT = 64;
+
 	std::vector<point> points;
-	std::vector< std::vector<float> > dists;
+
+private:
+	unsigned n;
+	unsigned stride;				// (full matrix) elements per row
+	bool triangular, quantized;
+	const float * dists;
+	const uint16_t * quantizedDists;
+	float quantum;
+	void * ownedMemory;				// (the matrix, if not mapped from a cache file)
+	void * mapping;
+	size_t mappingSize;
+
+	unsigned nNeighbours;
+	std::vector<uint32_t> neighbours;		// nNeighbours per city, nearest first
+
+public:
+	TSPInstance();
+	~TSPInstance();
+	TSPInstance(const TSPInstance &) = delete;
+	TSPInstance & operator=(const TSPInstance &) = delete;
 
 	bool initializeFromFile(const std::string & filepath);
-	void precalculateDistances();
+	void precalculateDistances(bool triangular = false, bool quantized = false);
+	bool precalculateDistancesCached(const std::string & cacheFile, bool triangular = false, bool quantized = false);
+	void precalculateNeighbours(unsigned k);
 	void calculatePointLimits(float & minX, float & maxX, float & minY, float & maxY);
+
+	inline float dist(unsigned i, unsigned j) const
+	{
+		size_t index;
+		if (triangular) {
+			if (i > j) {
+				unsigned t = i;
+				i = j;
+				j = t;
+			}
+			index = (size_t) i * n - (size_t) i * (i+1) / 2 + j;	// (row i starts after the i longer rows above it)
+		} else {
+			index = (size_t) i * stride + j;
+		}
+		return (quantized ? quantizedDists[index] * quantum : dists[index]);
+	}
+
+	// row i of the matrix (only if it is stored full and not quantized)
+	inline const float * row(unsigned i) const {
+		return dists + (size_t) i * stride;
+	}
+
+	inline unsigned getStride() const {
+		return stride;
+	}
+
+	// the k nearest cities of city i, nearest first (after precalculateNeighbours(k))
+	inline const uint32_t * neighboursOf(unsigned i) const {
+		return &neighbours[(size_t) i * nNeighbours];
+	}
+
+	inline unsigned getNNeighbours() const {
+		return nNeighbours;
+	}
+
+private:
+	void freeDistances();
+	size_t nStoredDistances() const;
+	uint64_t hashPoints() const;
+	bool mapCache(const std::string & cacheFile, uint64_t pointsHash);
+	void writeCache(const std::string & cacheFile, uint64_t pointsHash) const;
 };
 
 // ----------------------------------------------------------------------------
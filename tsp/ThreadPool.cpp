@@ -0,0 +1,59 @@
+#include "ThreadPool.hpp"
+
+// ----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(unsigned nThreads) : invoke(NULL), task(NULL), round(0), nRunning(0), stopping(false)
+{
+	for (unsigned i = 1;  i < nThreads;  i++)
+		threads.push_back(std::thread(&ThreadPool::loop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+		stopping = true;
+		startCondVar.notify_all();
+	}
+	for (std::thread & thread : threads)
+		thread.join();
+}
+
+void ThreadPool::start(void (*invoke)(void *, unsigned), void * task)
+{
+	std::lock_guard<std::mutex> lockWhileInsideScope(mutex);
+	this->invoke = invoke;
+	this->task = task;
+	nRunning = threads.size();
+	round++;
+	startCondVar.notify_all();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> uniqueLock(mutex);
+	endCondVar.wait(uniqueLock, [this] { return nRunning == 0; });
+}
+
+void ThreadPool::loop(unsigned thread)
+{
+	unsigned long doneRound = 0;
+	std::unique_lock<std::mutex> uniqueLock(mutex);
+
+	while (1)
+	{
+		startCondVar.wait(uniqueLock, [this, doneRound] { return stopping or round != doneRound; });
+		if (stopping)
+			return;
+		doneRound = round;
+
+		uniqueLock.unlock();
+		invoke(task, thread);
+		uniqueLock.lock();
+
+		if (--nRunning == 0)
+			endCondVar.notify_one();
+	}
+}
+
+// ----------------------------------------------------------------------------
@@ -0,0 +1,58 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Threads that run the same task at once, each with its index (0 is the calling thread), and wait for all of
+ * them to finish it. Tasks are passed by reference, so running one allocates nothing.
+ */
+class ThreadPool
+{
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable startCondVar, endCondVar;
+	void (*invoke)(void * task, unsigned thread);
+	void * task;
+	unsigned long round;
+	unsigned nRunning;
+	bool stopping;
+
+public:
+	ThreadPool(unsigned nThreads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	inline unsigned size() const {
+		return threads.size() + 1;
+	}
+
+	// calls task(thread) in every thread
+	template <typename Task>
+	void run(Task & task)
+	{
+		if (threads.empty()) {
+			task(0);
+			return;
+		}
+		start([](void * task, unsigned thread) { (*(Task *) task)(thread); }, &task);
+		task(0);
+		wait();
+	}
+
+private:
+	void start(void (*invoke)(void *, unsigned), void * task);
+	void wait();
+	void loop(unsigned thread);
+};
+
+// ----------------------------------------------------------------------------
+
+#endif /* THREADPOOL_HPP_ */